@@ -0,0 +1,170 @@
+#include "bandwidthbudget.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Per-user segment name ("/name" for shm_open, "Local\name" on Windows)
+const char BUDGET_SEGMENT[] = "wvncc-bandwidth-budget";
+const int64_t NANOS_PER_SECOND = 1000000000;
+
+namespace {
+
+int64_t nowNanos()
+{
+    // steady_clock is system-wide, so every process refills against the same timeline
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+BandwidthBudget::~BandwidthBudget()
+{
+    detach();
+}
+
+bool BandwidthBudget::attach()
+{
+    detach();
+
+    size_t size = sizeof(BandwidthBudgetState);
+    bool created = false;
+    void *base = nullptr;
+
+#ifdef _WIN32
+    std::string objectName = std::string("Local\\") + BUDGET_SEGMENT;
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0,
+                                        static_cast<DWORD>(size), objectName.c_str());
+    if (!mapping) {
+        std::cerr << "[ERROR] CreateFileMapping failed for " << objectName << ": " << GetLastError() << std::endl;
+        return false;
+    }
+    created = GetLastError() != ERROR_ALREADY_EXISTS;
+    base = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (!base) {
+        std::cerr << "[ERROR] MapViewOfFile failed for " << objectName << ": " << GetLastError() << std::endl;
+        CloseHandle(mapping);
+        return false;
+    }
+    m_mapping = mapping;
+#else
+    std::string objectName = std::string("/") + BUDGET_SEGMENT;
+    int fd = shm_open(objectName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    created = fd >= 0;
+    if (fd < 0 && errno == EEXIST) {
+        fd = shm_open(objectName.c_str(), O_RDWR, 0600);
+    }
+    if (fd < 0) {
+        std::cerr << "[ERROR] shm_open failed for " << objectName << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    // Extending to the same size is harmless if another process got there first
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        std::cerr << "[ERROR] ftruncate failed for " << objectName << ": " << strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+    base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        std::cerr << "[ERROR] mmap failed for " << objectName << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+#endif
+
+    // Zero-filled memory is a valid state, the atomics only need to be lock-free to be shared
+    m_base = base;
+    m_state = static_cast<BandwidthBudgetState *>(base);
+    m_state->sessions.fetch_add(1, std::memory_order_relaxed);
+    return created;
+}
+
+void BandwidthBudget::detach()
+{
+    if (!m_base) {
+        return;
+    }
+    bool last = m_state->sessions.fetch_sub(1, std::memory_order_relaxed) == 1;
+
+#ifdef _WIN32
+    // The mapping goes away with its last handle
+    (void)last;
+    UnmapViewOfFile(m_base);
+    CloseHandle(static_cast<HANDLE>(m_mapping));
+    m_mapping = nullptr;
+#else
+    munmap(m_base, sizeof(BandwidthBudgetState));
+    if (last) {
+        shm_unlink((std::string("/") + BUDGET_SEGMENT).c_str());
+    }
+#endif
+
+    m_base = nullptr;
+    m_state = &m_local;
+}
+
+void BandwidthBudget::setBytesPerSecond(int64_t bytesPerSecond)
+{
+    m_state->bytesPerSecond.store(std::max<int64_t>(0, bytesPerSecond), std::memory_order_relaxed);
+    // Start the new rate from an empty bucket rather than old debt or credit
+    m_state->tokens.store(0, std::memory_order_relaxed);
+    m_state->refillNanos.store(nowNanos(), std::memory_order_relaxed);
+}
+
+void BandwidthBudget::refill(int64_t now)
+{
+    int64_t rate = m_state->bytesPerSecond.load(std::memory_order_relaxed);
+    int64_t last = m_state->refillNanos.load(std::memory_order_relaxed);
+    if (now <= last) {
+        return;
+    }
+    // Only the session that moves the refill time forward adds the tokens for that interval
+    if (!m_state->refillNanos.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+        return;
+    }
+    if (last == 0) {
+        return;
+    }
+
+    int64_t elapsed = std::min(now - last, NANOS_PER_SECOND);
+    int64_t added = static_cast<int64_t>(static_cast<double>(elapsed) * rate / NANOS_PER_SECOND);
+    int64_t tokens = m_state->tokens.fetch_add(added, std::memory_order_relaxed) + added;
+
+    // Idle periods bank at most one second of traffic
+    while (tokens > rate && !m_state->tokens.compare_exchange_weak(tokens, rate, std::memory_order_relaxed)) {
+    }
+}
+
+void BandwidthBudget::consume(uint64_t bytes)
+{
+    if (bytes == 0 || bytesPerSecond() == 0) {
+        return;
+    }
+    refill(nowNanos());
+    m_state->tokens.fetch_sub(static_cast<int64_t>(std::min<uint64_t>(bytes, INT64_MAX / 2)), std::memory_order_relaxed);
+}
+
+std::chrono::nanoseconds BandwidthBudget::delay()
+{
+    int64_t rate = bytesPerSecond();
+    if (rate == 0) {
+        return std::chrono::nanoseconds(0);
+    }
+    refill(nowNanos());
+    int64_t tokens = m_state->tokens.load(std::memory_order_relaxed);
+    if (tokens >= 0) {
+        return std::chrono::nanoseconds(0);
+    }
+    return std::chrono::nanoseconds(static_cast<int64_t>(static_cast<double>(-tokens) * NANOS_PER_SECOND / rate));
+}
@@ -0,0 +1,55 @@
+#ifndef BANDWIDTHBUDGET_H
+#define BANDWIDTHBUDGET_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Token bucket shared by every wvncc process of the user, in a small shared-memory segment.
+// All-zero is a valid state (unlimited, empty bucket), so a freshly created segment needs no
+// initialisation and processes can attach in any order.
+struct BandwidthBudgetState
+{
+    std::atomic<int64_t> bytesPerSecond;  // 0 = unlimited
+    std::atomic<int64_t> tokens;          // Bytes that may still be received; negative is debt
+    std::atomic<int64_t> refillNanos;     // steady_clock time of the last refill, 0 = never
+    std::atomic<int32_t> sessions;        // Attached processes; the last one removes the segment
+
+    static_assert(std::atomic<int64_t>::is_always_lock_free, "the budget is shared between processes");
+};
+
+class BandwidthBudget
+{
+public:
+    BandwidthBudget() = default;
+    ~BandwidthBudget();
+
+    BandwidthBudget(const BandwidthBudget &) = delete;
+    BandwidthBudget &operator=(const BandwidthBudget &) = delete;
+
+    // Opens the machine-wide budget, creating it if this is the first session. Returns true if
+    // it was created. Without shared memory the budget only covers this process.
+    bool attach();
+    void detach();
+    bool isShared() const { return m_base != nullptr; }
+
+    int64_t bytesPerSecond() const { return m_state->bytesPerSecond.load(std::memory_order_relaxed); }
+    void setBytesPerSecond(int64_t bytesPerSecond);
+
+    // Bytes received by any session; their cost is paid back by later waits
+    void consume(uint64_t bytes);
+    // How long to hold off reading until the bucket is out of debt
+    std::chrono::nanoseconds delay();
+
+private:
+    void refill(int64_t now);
+
+    BandwidthBudgetState m_local{};
+    BandwidthBudgetState *m_state = &m_local;
+    void *m_base = nullptr;
+#ifdef _WIN32
+    void *m_mapping = nullptr;
+#endif
+};
+
+#endif // BANDWIDTHBUDGET_H
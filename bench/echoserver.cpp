@@ -0,0 +1,97 @@
+// Stand-in VNC server for wvncc's latency probe. Every pointer event paints a marker under
+// the pointer and every key press flashes a patch in the top-left corner, each in a new
+// colour, so each input event produces exactly one visible framebuffer change.
+//
+//   wvncc_echo_server [-rfbport 5901] [WIDTHxHEIGHT]
+//   wvncc 127.0.0.1 5901      then enable "Measure Latency" in the popup menu
+
+extern "C" {
+#include <rfb/rfb.h>
+}
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+const int MARKER_SIZE = 8;
+const int KEY_PATCH_SIZE = 32;
+
+uint32_t g_colour = 0x00ff4000;
+
+uint32_t nextColour()
+{
+    // Golden-ratio hue walk keeps consecutive colours distinct
+    g_colour = (g_colour + 0x009e3779) & 0x00ffffff;
+    return g_colour;
+}
+
+void fill(rfbScreenInfoPtr screen, int x, int y, int w, int h, uint32_t colour)
+{
+    int x0 = x < 0 ? 0 : x;
+    int y0 = y < 0 ? 0 : y;
+    int x1 = x + w > screen->width ? screen->width : x + w;
+    int y1 = y + h > screen->height ? screen->height : y + h;
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+    for (int row = y0; row < y1; row++) {
+        uint32_t *line = reinterpret_cast<uint32_t *>(screen->frameBuffer + row * screen->paddedWidthInBytes);
+        for (int column = x0; column < x1; column++) {
+            line[column] = colour;
+        }
+    }
+    rfbMarkRectAsModified(screen, x0, y0, x1, y1);
+}
+
+void onPointer(int buttonMask, int x, int y, rfbClientPtr client)
+{
+    fill(client->screen, x - MARKER_SIZE / 2, y - MARKER_SIZE / 2, MARKER_SIZE, MARKER_SIZE, nextColour());
+    rfbDefaultPtrAddEvent(buttonMask, x, y, client);
+}
+
+void onKey(rfbBool down, rfbKeySym key, rfbClientPtr client)
+{
+    (void)key;
+    if (down) {
+        fill(client->screen, 0, 0, KEY_PATCH_SIZE, KEY_PATCH_SIZE, nextColour());
+    }
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    int width = 1280;
+    int height = 720;
+
+    // rfbGetScreen handles the -rfb* options and leaves other arguments alone
+    for (int i = 1; i < argc; i++) {
+        int w = 0;
+        int h = 0;
+        if (std::sscanf(argv[i], "%dx%d", &w, &h) == 2 && w > 0 && h > 0) {
+            width = w;
+            height = h;
+        }
+    }
+    rfbScreenInfoPtr screen = rfbGetScreen(&argc, argv, width, height, 8, 3, 4);
+    if (!screen) {
+        return 1;
+    }
+
+    screen->frameBuffer = static_cast<char *>(std::calloc(static_cast<size_t>(width) * height, 4));
+    screen->desktopName = "wvncc echo";
+    screen->alwaysShared = TRUE;
+    screen->ptrAddEvent = onPointer;
+    screen->kbdAddEvent = onKey;
+
+    rfbInitServer(screen);
+    std::printf("[INFO] Echo server %dx%d on port %d\n", width, height, screen->port);
+    rfbRunEventLoop(screen, 1000, FALSE);
+
+    std::free(screen->frameBuffer);
+    rfbScreenCleanup(screen);
+    return 0;
+}
@@ -0,0 +1,433 @@
+// Microbenchmarks for wvncc's per-frame and per-event kernels.
+//
+// Run with JSON output to compare builds:
+//   wvncc_microbench --benchmark_format=json --benchmark_out=before.json
+//   compare.py benchmarks before.json after.json   (from Google Benchmark's tools/)
+//
+// Before timing anything it checks that the vectorized kernels write exactly what their
+// scalar versions do, and exits with 1 if not.
+
+#include <benchmark/benchmark.h>
+
+#include <QImage>
+#include <QPainter>
+#include <QString>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "framebufferops.h"
+#include "keymap.h"
+#include "viewport.h"
+
+namespace {
+
+// Client area of a typical window the framebuffer is scaled into
+const QRect WINDOW_AREA(0, 32, 1600, 868);
+
+struct FramebufferSize
+{
+    const char *label;
+    int width;
+    int height;
+};
+
+const FramebufferSize SIZES[] = {
+    {"1080p", 1920, 1080},
+    {"1440p", 2560, 1440},
+    {"4K", 3840, 2160},
+    {"5K", 5120, 2880},
+    {"8K", 7680, 4320},
+};
+
+void framebufferSizes(benchmark::internal::Benchmark *b)
+{
+    for (int i = 0; i < static_cast<int>(sizeof(SIZES) / sizeof(SIZES[0])); i++) {
+        b->Arg(i);
+    }
+}
+
+// Desktop-like content: flat areas with some gradients so scaling and compares do real work
+std::vector<uint8_t> makeFramebuffer(int width, int height, int bytesPerPixel)
+{
+    std::vector<uint8_t> fb(static_cast<size_t>(width) * height * bytesPerPixel);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint32_t pixel = ((x / 64 + y / 64) & 1) ? 0x00f0f0f0 : ((x * 255 / width) << 16) | ((y * 255 / height) << 8) | 0x40;
+            uint8_t *dst = fb.data() + (static_cast<size_t>(y) * width + x) * bytesPerPixel;
+            if (bytesPerPixel == 4) {
+                *reinterpret_cast<uint32_t *>(dst) = pixel;
+            } else {
+                *reinterpret_cast<uint16_t *>(dst) = static_cast<uint16_t>(((pixel >> 8) & 0xf800) | ((pixel >> 5) & 0x07e0) | ((pixel >> 3) & 0x001f));
+            }
+        }
+    }
+    return fb;
+}
+
+const FramebufferSize &sizeFor(const benchmark::State &state)
+{
+    return SIZES[state.range(0)];
+}
+
+// fbops::fillRect as a plain loop over pixels
+void scalarFill(uint8_t *fb, int stride, int bytesPerPixel, int x, int y, int w, int h, uint32_t colour)
+{
+    uint16_t colour16 = static_cast<uint16_t>(colour);
+    uint8_t colour8 = static_cast<uint8_t>(colour);
+    const void *pixel = bytesPerPixel == 4 ? static_cast<const void *>(&colour)
+                      : bytesPerPixel == 2 ? static_cast<const void *>(&colour16) : &colour8;
+    for (int row = y; row < y + h; row++) {
+        for (int column = x; column < x + w; column++) {
+            memcpy(fb + row * stride + column * bytesPerPixel, pixel, bytesPerPixel);
+        }
+    }
+}
+
+// fbops::fillRect against scalarFill for every pixel size, framebuffer address modulo 16,
+// stride padding, start column and width up to several vectors; the bytes around the
+// rectangle must stay untouched too. Addresses and strides off the pixel grid are included:
+// fillRect has to notice them and fill them bytewise.
+bool fillMatchesScalar()
+{
+    const int rows = 3;
+    for (int bytesPerPixel : {1, 2, 4}) {
+        for (int offset = 0; offset < 16; offset++) {
+            for (int padding = 0; padding < 2 * bytesPerPixel; padding++) {
+                int width = 80;
+                int stride = width * bytesPerPixel + padding;
+                std::vector<uint8_t> expected(stride * rows + 32);
+                std::vector<uint8_t> actual(expected.size());
+                // Both buffers at the same address modulo 16
+                uint8_t *base = actual.data() + ((16 - reinterpret_cast<uintptr_t>(actual.data()) % 16) % 16) + offset;
+                size_t start = base - actual.data();
+                for (int x = 0; x < 8; x++) {
+                    for (int w = 1; x + w <= width; w++) {
+                        uint32_t colour = 0x11223344u * static_cast<uint32_t>(w + 1) + static_cast<uint32_t>(x);
+                        std::fill(expected.begin(), expected.end(), 0xa5);
+                        std::fill(actual.begin(), actual.end(), 0xa5);
+                        scalarFill(expected.data() + start, stride, bytesPerPixel, x, 1, w, rows - 1, colour);
+                        fbops::fillRect(base, stride, bytesPerPixel, x, 1, w, rows - 1, colour);
+                        if (expected != actual) {
+                            std::cerr << "[ERROR] fillRect differs from the scalar fill: " << bytesPerPixel
+                                      << " bytes per pixel, address offset " << offset << ", stride " << stride
+                                      << ", x " << x << ", width " << w << std::endl;
+                            return false;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+// Hextile-style solid 16x16 tiles over the whole framebuffer
+static void BM_FillRectTiles(benchmark::State &state)
+{
+    const FramebufferSize &size = sizeFor(state);
+    std::vector<uint8_t> fb = makeFramebuffer(size.width, size.height, 4);
+    int stride = size.width * 4;
+    uint32_t colour = 0;
+    for (auto _ : state) {
+        for (int y = 0; y + 16 <= size.height; y += 16) {
+            for (int x = 0; x + 16 <= size.width; x += 16) {
+                fbops::fillRect(fb.data(), stride, 4, x, y, 16, 16, colour++);
+            }
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetLabel(size.label);
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(fb.size()));
+}
+BENCHMARK(BM_FillRectTiles)->Apply(framebufferSizes);
+
+// Hextile tiles as a busy desktop sends them: a background fill per tile, then up to a
+// dozen subrectangles, a third of them single pixels
+static void BM_FillRectHextileSubrects(benchmark::State &state)
+{
+    const FramebufferSize &size = sizeFor(state);
+    std::vector<uint8_t> fb = makeFramebuffer(size.width, size.height, 4);
+    int stride = size.width * 4;
+    struct Fill
+    {
+        int x, y, w, h;
+        uint32_t colour;
+    };
+    std::vector<Fill> fills;
+    uint32_t seed = 1;
+    auto next = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return seed >> 8;
+    };
+    for (int y = 0; y + 16 <= size.height; y += 16) {
+        for (int x = 0; x + 16 <= size.width; x += 16) {
+            fills.push_back({x, y, 16, 16, next()});
+            for (int n = next() % 12; n > 0; n--) {
+                int sx = next() % 16;
+                int sy = next() % 16;
+                int sw = next() % 3 == 0 ? 1 : 1 + next() % (16 - sx);
+                int sh = next() % 3 == 0 ? 1 : 1 + next() % (16 - sy);
+                fills.push_back({x + sx, y + sy, sw, sh, next()});
+            }
+        }
+    }
+    for (auto _ : state) {
+        for (const Fill &fill : fills) {
+            fbops::fillRect(fb.data(), stride, 4, fill.x, fill.y, fill.w, fill.h, fill.colour);
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetLabel(size.label);
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(fills.size()));
+}
+BENCHMARK(BM_FillRectHextileSubrects)->Apply(framebufferSizes);
+
+// Raw encoding: full-width rows copied from the receive buffer
+static void BM_PutBitmapFullFrame(benchmark::State &state)
+{
+    const FramebufferSize &size = sizeFor(state);
+    std::vector<uint8_t> fb(static_cast<size_t>(size.width) * size.height * 4);
+    std::vector<uint8_t> src = makeFramebuffer(size.width, size.height, 4);
+    for (auto _ : state) {
+        fbops::putBitmap(fb.data(), size.width * 4, 4, src.data(), 0, 0, size.width, size.height);
+        benchmark::ClobberMemory();
+    }
+    state.SetLabel(size.label);
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(fb.size()));
+}
+BENCHMARK(BM_PutBitmapFullFrame)->Apply(framebufferSizes);
+
+// CopyRect scroll of the whole desktop by 32 rows (overlapping move)
+static void BM_CopyRectScroll(benchmark::State &state)
+{
+    const FramebufferSize &size = sizeFor(state);
+    std::vector<uint8_t> fb = makeFramebuffer(size.width, size.height, 4);
+    for (auto _ : state) {
+        fbops::copyRect(fb.data(), size.width * 4, 4, 0, 32, size.width, size.height - 32, 0, 0);
+        benchmark::ClobberMemory();
+    }
+    state.SetLabel(size.label);
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(size.width) * (size.height - 32) * 4);
+}
+BENCHMARK(BM_CopyRectScroll)->Apply(framebufferSizes);
+
+// Full-frame comparison behind waitChange/waitMatch, with and without a tolerance
+static void BM_CountDifferentPixels(benchmark::State &state)
+{
+    const FramebufferSize &size = sizeFor(state);
+    std::vector<uint8_t> fb = makeFramebuffer(size.width, size.height, 4);
+    std::vector<uint8_t> reference = fb;
+    int tolerance = static_cast<int>(state.range(1));
+    for (auto _ : state) {
+        int64_t count = 0;
+        for (int row = 0; row < size.height; row++) {
+            size_t offset = static_cast<size_t>(row) * size.width * 4;
+            count += fbops::countDifferentPixels(fb.data() + offset, reference.data() + offset, 4, size.width, tolerance);
+        }
+        benchmark::DoNotOptimize(count);
+    }
+    state.SetLabel(size.label);
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(fb.size()));
+}
+BENCHMARK(BM_CountDifferentPixels)->Apply([](benchmark::internal::Benchmark *b) {
+    for (int tolerance : {0, 8}) {
+        for (int i = 0; i < static_cast<int>(sizeof(SIZES) / sizeof(SIZES[0])); i++) {
+            b->Args({i, tolerance});
+        }
+    }
+});
+
+// Tile hashes that tell unchanged rectangles apart, over a whole frame
+static void BM_HashTilesFullFrame(benchmark::State &state)
+{
+    const FramebufferSize &size = sizeFor(state);
+    std::vector<uint8_t> fb = makeFramebuffer(size.width, size.height, 4);
+    int stride = size.width * 4;
+    for (auto _ : state) {
+        uint64_t combined = 0;
+        for (int y = 0; y < size.height; y += 16) {
+            for (int x = 0; x < size.width; x += 16) {
+                combined ^= fbops::hashRows(fb.data() + y * stride + x * 4, stride, std::min(16, size.width - x) * 4,
+                                            std::min(16, size.height - y));
+            }
+        }
+        benchmark::DoNotOptimize(combined);
+    }
+    state.SetLabel(size.label);
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(fb.size()));
+}
+BENCHMARK(BM_HashTilesFullFrame)->Apply(framebufferSizes);
+
+// RGB565 framebuffer converted for display
+static void BM_PixelFormatRGB16ToRGB32(benchmark::State &state)
+{
+    const FramebufferSize &size = sizeFor(state);
+    std::vector<uint8_t> fb = makeFramebuffer(size.width, size.height, 2);
+    QImage source(fb.data(), size.width, size.height, size.width * 2, QImage::Format_RGB16);
+    for (auto _ : state) {
+        QImage converted = source.convertToFormat(QImage::Format_RGB32);
+        benchmark::DoNotOptimize(converted.constBits());
+    }
+    state.SetLabel(size.label);
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(fb.size()));
+}
+BENCHMARK(BM_PixelFormatRGB16ToRGB32)->Apply(framebufferSizes);
+
+// getScaledFramebufferRect: fit-to-window mapping
+static void BM_ViewportFit(benchmark::State &state)
+{
+    const FramebufferSize &size = sizeFor(state);
+    QSize framebufferSize(size.width, size.height);
+    for (auto _ : state) {
+        ViewportMapping mapping = computeViewportMapping(framebufferSize, WINDOW_AREA, 0.0, QPointF());
+        benchmark::DoNotOptimize(mapping);
+    }
+    state.SetLabel(size.label);
+}
+BENCHMARK(BM_ViewportFit)->Apply(framebufferSizes);
+
+// Zoomed viewport mapping plus the update request rectangle derived from it
+static void BM_ViewportZoomRequest(benchmark::State &state)
+{
+    const FramebufferSize &size = sizeFor(state);
+    QSize framebufferSize(size.width, size.height);
+    QPointF center(size.width / 3.0, size.height / 3.0);
+    for (auto _ : state) {
+        ViewportMapping mapping = computeViewportMapping(framebufferSize, WINDOW_AREA, 1.5, center);
+        QRect request = mapping.requestRect(framebufferSize, 0.25);
+        benchmark::DoNotOptimize(request);
+    }
+    state.SetLabel(size.label);
+}
+BENCHMARK(BM_ViewportZoomRequest)->Apply(framebufferSizes);
+
+// Window-to-remote pointer mapping as done for every mouse event
+static void BM_WindowToRemote(benchmark::State &state)
+{
+    const FramebufferSize &size = sizeFor(state);
+    ViewportMapping mapping = computeViewportMapping(QSize(size.width, size.height), WINDOW_AREA, 0.0, QPointF());
+    std::vector<QPointF> points;
+    for (int i = 0; i < 1024; i++) {
+        points.emplace_back(WINDOW_AREA.x() + (i * 37) % WINDOW_AREA.width(), WINDOW_AREA.y() + (i * 53) % WINDOW_AREA.height());
+    }
+    for (auto _ : state) {
+        for (const QPointF &point : points) {
+            QPointF remote = mapping.toRemote(point);
+            int x = std::clamp(static_cast<int>(std::round(remote.x())), 0, size.width - 1);
+            int y = std::clamp(static_cast<int>(std::round(remote.y())), 0, size.height - 1);
+            bool inside = mapping.target.contains(point.toPoint());
+            benchmark::DoNotOptimize(x);
+            benchmark::DoNotOptimize(y);
+            benchmark::DoNotOptimize(inside);
+        }
+    }
+    state.SetLabel(size.label);
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(points.size()));
+}
+BENCHMARK(BM_WindowToRemote)->Apply(framebufferSizes);
+
+static void BM_QtKeyToX11Keysym(benchmark::State &state)
+{
+    struct KeyInput { int key; QString text; };
+    std::vector<KeyInput> keys;
+    for (char c = 'a'; c <= 'z'; c++) {
+        keys.push_back({Qt::Key_A + (c - 'a'), QString(QChar(c))});
+    }
+    for (int key : {Qt::Key_Return, Qt::Key_Backspace, Qt::Key_Left, Qt::Key_F5, Qt::Key_Shift, Qt::Key_Control}) {
+        keys.push_back({key, QString()});
+    }
+    for (auto _ : state) {
+        for (const KeyInput &input : keys) {
+            benchmark::DoNotOptimize(qtKeyToX11Keysym(input.key, Qt::NoModifier, input.text));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(keys.size()));
+}
+BENCHMARK(BM_QtKeyToX11Keysym);
+
+// paintEvent's smooth scale of the whole framebuffer into the window
+static void BM_PaintScaleFit(benchmark::State &state)
+{
+    const FramebufferSize &size = sizeFor(state);
+    std::vector<uint8_t> fb = makeFramebuffer(size.width, size.height, 4);
+    QImage framebuffer(fb.data(), size.width, size.height, QImage::Format_RGB32);
+    QImage window(WINDOW_AREA.width(), WINDOW_AREA.height() + WINDOW_AREA.y(), QImage::Format_RGB32);
+    ViewportMapping mapping = computeViewportMapping(framebuffer.size(), WINDOW_AREA, 0.0, QPointF());
+    for (auto _ : state) {
+        QPainter painter(&window);
+        painter.setRenderHint(QPainter::SmoothPixmapTransform, true);
+        painter.drawImage(QRectF(mapping.target), framebuffer, mapping.source);
+    }
+    state.SetLabel(size.label);
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(fb.size()));
+}
+BENCHMARK(BM_PaintScaleFit)->Apply(framebufferSizes)->Unit(benchmark::kMillisecond);
+
+// paintEvent when zoomed to actual pixels: only the visible region is sampled
+static void BM_PaintScaleZoomed(benchmark::State &state)
+{
+    const FramebufferSize &size = sizeFor(state);
+    std::vector<uint8_t> fb = makeFramebuffer(size.width, size.height, 4);
+    QImage framebuffer(fb.data(), size.width, size.height, QImage::Format_RGB32);
+    QImage window(WINDOW_AREA.width(), WINDOW_AREA.height() + WINDOW_AREA.y(), QImage::Format_RGB32);
+    ViewportMapping mapping = computeViewportMapping(framebuffer.size(), WINDOW_AREA, 1.0,
+                                                     QPointF(size.width / 2.0, size.height / 2.0));
+    for (auto _ : state) {
+        QPainter painter(&window);
+        painter.setRenderHint(QPainter::SmoothPixmapTransform, true);
+        painter.drawImage(QRectF(mapping.target), framebuffer, mapping.source);
+    }
+    state.SetLabel(size.label);
+}
+BENCHMARK(BM_PaintScaleZoomed)->Apply(framebufferSizes)->Unit(benchmark::kMillisecond);
+
+// onClipboardChanged / handleServerClipboard UTF-8 conversions, 1 KiB to 1 MiB of mixed text
+static void BM_ClipboardToUtf8(benchmark::State &state)
+{
+    QString text;
+    const QString chunk = QString::fromUtf8("log line 42: température élevée ✓ ");
+    while (text.size() < state.range(0)) {
+        text += chunk;
+    }
+    text.truncate(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        QByteArray utf8 = text.toUtf8();
+        benchmark::DoNotOptimize(utf8.constData());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0) * 2);
+}
+BENCHMARK(BM_ClipboardToUtf8)->RangeMultiplier(32)->Range(1 << 10, 1 << 20);
+
+static void BM_ClipboardFromUtf8(benchmark::State &state)
+{
+    QByteArray utf8;
+    const QByteArray chunk = QByteArray("log line 42: température élevée ✓ ");
+    while (utf8.size() < state.range(0)) {
+        utf8 += chunk;
+    }
+    for (auto _ : state) {
+        QString text = QString::fromUtf8(utf8.constData(), static_cast<int>(state.range(0)));
+        benchmark::DoNotOptimize(text.constData());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ClipboardFromUtf8)->RangeMultiplier(32)->Range(1 << 10, 1 << 20);
+
+int main(int argc, char **argv)
+{
+    if (!fillMatchesScalar()) {
+        return 1;
+    }
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
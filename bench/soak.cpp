@@ -0,0 +1,600 @@
+// Endurance run of the session lifecycle. Each cycle opens a MainWindow, connects it to a
+// LibVNCServer stand-in running in this process, streams for a while and closes the window.
+// Some cycles have the server drop the client mid-stream or refuse it during the handshake,
+// others connect to a server that stalls in the middle of a message.
+// Resident memory, open descriptors/handles and threads are sampled after every cycle.
+// The run fails if they keep growing once the first cycles have warmed up caches and pools.
+//
+//   wvncc_soak [--cycles 2000] [--port 5990] [--stream-ms 200] [--drop-rate 0.3]
+//              [--refuse-rate 0.05] [--stall-rate 0.05] [--seed 1] [--max-rss-growth-kb 8192]
+//              [--verbose]
+//
+// Runs on the offscreen Qt platform unless QT_QPA_PLATFORM says otherwise. Settings go
+// to a temporary directory (the registry on Windows, under the 127.0.0.1:<port> key).
+// The stalling server listens on the next port.
+
+extern "C" {
+#include <rfb/rfb.h>
+}
+
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QSettings>
+#include <QTemporaryDir>
+#include <QTimer>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#include <tlhelp32.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+#include "mainwindow.h"
+
+namespace {
+
+const int SERVER_WIDTH = 1280;
+const int SERVER_HEIGHT = 720;
+const int PAINT_INTERVAL_MS = 10;
+const int BAR_WIDTH = 64;
+// How long a closed session may take to disappear on the server side
+const int SERVER_IDLE_TIMEOUT_MS = 2000;
+// Resource samples taken after warm-up and at the end are compared by their medians
+const int SAMPLE_WINDOW = 20;
+// Longest acceptable close of a window whose server stopped mid-message
+const int STALLED_TEARDOWN_LIMIT_MS = 1000;
+// How often the stalling server checks whether it should stop
+const int STALLED_POLL_MS = 50;
+
+struct Options
+{
+    int cycles = 2000;
+    int port = 5990;
+    int streamMs = 200;
+    double dropRate = 0.3;
+    double refuseRate = 0.05;
+    double stallRate = 0.05;
+    unsigned seed = 1;
+    long maxRssGrowthKb = 8192;
+    bool verbose = false;
+};
+
+struct Resources
+{
+    long rssKb = -1;
+    long handles = -1;
+    long threads = -1;
+};
+
+// Discards the sessions' [INFO] lines unless --verbose
+class NullBuffer : public std::streambuf
+{
+protected:
+    int overflow(int c) override { return c == traits_type::eof() ? 0 : c; }
+};
+
+#ifdef _WIN32
+Resources sampleResources()
+{
+    Resources resources;
+    PROCESS_MEMORY_COUNTERS memory;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &memory, sizeof(memory))) {
+        resources.rssKb = static_cast<long>(memory.WorkingSetSize / 1024);
+    }
+    DWORD handles = 0;
+    if (GetProcessHandleCount(GetCurrentProcess(), &handles)) {
+        resources.handles = static_cast<long>(handles);
+    }
+    HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+    if (snapshot != INVALID_HANDLE_VALUE) {
+        THREADENTRY32 entry;
+        entry.dwSize = sizeof(entry);
+        resources.threads = 0;
+        for (BOOL more = Thread32First(snapshot, &entry); more; more = Thread32Next(snapshot, &entry)) {
+            if (entry.th32OwnerProcessID == GetCurrentProcessId()) {
+                resources.threads++;
+            }
+        }
+        CloseHandle(snapshot);
+    }
+    return resources;
+}
+#else
+long countEntries(const char *path)
+{
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return -1;
+    }
+    long count = 0;
+    while (dirent *entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+            count++;
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+Resources sampleResources()
+{
+    Resources resources;
+    long pages = 0;
+    long resident = 0;
+    if (FILE *statm = std::fopen("/proc/self/statm", "r")) {
+        if (std::fscanf(statm, "%ld %ld", &pages, &resident) == 2) {
+            resources.rssKb = resident * (sysconf(_SC_PAGESIZE) / 1024);
+        }
+        std::fclose(statm);
+    }
+    // One less than listed: the directory being read is an open descriptor too
+    long descriptors = countEntries("/proc/self/fd");
+    resources.handles = descriptors > 0 ? descriptors - 1 : descriptors;
+    resources.threads = countEntries("/proc/self/task");
+    return resources;
+}
+#endif
+
+// Waits for a server's session count to drop to zero
+bool waitForNone(const std::atomic<int> &clients, int timeoutMs)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (clients.load() > 0) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// The server side: a moving bar keeps updates flowing, clients can be dropped or refused
+class StandInServer
+{
+public:
+    bool start(const char *program, int port)
+    {
+        // No -rfb* options: the port comes from the soak's own arguments
+        int argc = 1;
+        char *argv[] = {const_cast<char *>(program), nullptr};
+        m_screen = rfbGetScreen(&argc, argv, SERVER_WIDTH, SERVER_HEIGHT, 8, 3, 4);
+        if (!m_screen) {
+            return false;
+        }
+        m_pixels.assign(static_cast<size_t>(SERVER_WIDTH) * SERVER_HEIGHT, 0x00204060);
+        m_screen->frameBuffer = reinterpret_cast<char *>(m_pixels.data());
+        m_screen->desktopName = "wvncc soak";
+        m_screen->alwaysShared = TRUE;
+        m_screen->port = port;
+        m_screen->ipv6port = 0;
+        m_screen->listenInterface = htonl(INADDR_LOOPBACK);
+        m_screen->screenData = this;
+        m_screen->newClientHook = onNewClient;
+        rfbInitServer(m_screen);
+        if (m_screen->listenSock == RFB_INVALID_SOCKET) {
+            return false;
+        }
+        rfbRunEventLoop(m_screen, -1, TRUE);
+        m_painter = std::thread([this]() { paint(); });
+        return true;
+    }
+
+    void stop()
+    {
+        m_stopping = true;
+        if (m_painter.joinable()) {
+            m_painter.join();
+        }
+        if (m_screen) {
+            rfbShutdownServer(m_screen, TRUE);
+            rfbScreenCleanup(m_screen);
+            m_screen = nullptr;
+        }
+    }
+
+    void refuseNext(bool refuse) { m_refuseNext = refuse; }
+    int clients() const { return m_clients.load(); }
+
+    void dropClients()
+    {
+        rfbClientIteratorPtr iterator = rfbGetClientIterator(m_screen);
+        while (rfbClientPtr client = rfbClientIteratorNext(iterator)) {
+            rfbCloseClient(client);
+        }
+        rfbReleaseClientIterator(iterator);
+    }
+
+    bool waitIdle(int timeoutMs) const { return waitForNone(m_clients, timeoutMs); }
+
+private:
+    static enum rfbNewClientAction onNewClient(rfbClientPtr client)
+    {
+        StandInServer *server = static_cast<StandInServer *>(client->screen->screenData);
+        if (server->m_refuseNext.exchange(false)) {
+            return RFB_CLIENT_REFUSE;
+        }
+        server->m_clients++;
+        client->clientGoneHook = onClientGone;
+        return RFB_CLIENT_ACCEPT;
+    }
+
+    static void onClientGone(rfbClientPtr client)
+    {
+        static_cast<StandInServer *>(client->screen->screenData)->m_clients--;
+    }
+
+    void paint()
+    {
+        int x = 0;
+        uint32_t colour = 0x00ff4000;
+        while (!m_stopping) {
+            // Clear the previous bar, draw the next one
+            for (int row = 0; row < SERVER_HEIGHT; row++) {
+                uint32_t *line = m_pixels.data() + static_cast<size_t>(row) * SERVER_WIDTH;
+                std::fill(line + x, line + x + BAR_WIDTH, 0x00204060);
+            }
+            rfbMarkRectAsModified(m_screen, x, 0, x + BAR_WIDTH, SERVER_HEIGHT);
+            x = (x + BAR_WIDTH / 4) % (SERVER_WIDTH - BAR_WIDTH);
+            colour = (colour + 0x009e3779) & 0x00ffffff;
+            for (int row = 0; row < SERVER_HEIGHT; row++) {
+                uint32_t *line = m_pixels.data() + static_cast<size_t>(row) * SERVER_WIDTH;
+                std::fill(line + x, line + x + BAR_WIDTH, colour);
+            }
+            rfbMarkRectAsModified(m_screen, x, 0, x + BAR_WIDTH, SERVER_HEIGHT);
+            std::this_thread::sleep_for(std::chrono::milliseconds(PAINT_INTERVAL_MS));
+        }
+    }
+
+    rfbScreenInfoPtr m_screen = nullptr;
+    std::vector<uint32_t> m_pixels;
+    std::thread m_painter;
+    std::atomic<bool> m_stopping{false};
+    std::atomic<bool> m_refuseNext{false};
+    std::atomic<int> m_clients{0};
+};
+
+// A server that stops in the middle of a message: it completes an RFB 3.8 handshake
+// without authentication, sends the start of a FramebufferUpdate header and from then on
+// only reads. Sessions are served one at a time, like the cycles.
+class StalledServer
+{
+public:
+    bool start(int port)
+    {
+        m_listen = rfbListenOnTCPPort(port, htonl(INADDR_LOOPBACK));
+        if (m_listen == RFB_INVALID_SOCKET) {
+            return false;
+        }
+        m_thread = std::thread([this]() { run(); });
+        return true;
+    }
+
+    void stop()
+    {
+        m_stopping = true;
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+        if (m_listen != RFB_INVALID_SOCKET) {
+            closeSocket(m_listen);
+            m_listen = RFB_INVALID_SOCKET;
+        }
+    }
+
+    bool waitIdle(int timeoutMs) const { return waitForNone(m_clients, timeoutMs); }
+
+private:
+    static void closeSocket(rfbSocket sock)
+    {
+#ifdef _WIN32
+        closesocket(sock);
+#else
+        close(sock);
+#endif
+    }
+
+    // Waits up to STALLED_POLL_MS for the socket to become readable
+    static bool readable(rfbSocket sock)
+    {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(sock, &fds);
+        timeval timeout = {0, STALLED_POLL_MS * 1000};
+        return select(static_cast<int>(sock) + 1, &fds, nullptr, nullptr, &timeout) > 0;
+    }
+
+    static bool sendAll(rfbSocket sock, const void *data, size_t size)
+    {
+        const char *bytes = static_cast<const char *>(data);
+        while (size > 0) {
+            auto sent = send(sock, bytes, static_cast<int>(size), 0);
+            if (sent <= 0) {
+                return false;
+            }
+            bytes += sent;
+            size -= static_cast<size_t>(sent);
+        }
+        return true;
+    }
+
+    bool receiveAll(rfbSocket sock, void *data, size_t size)
+    {
+        char *bytes = static_cast<char *>(data);
+        while (size > 0 && !m_stopping) {
+            if (!readable(sock)) {
+                continue;
+            }
+            auto received = recv(sock, bytes, static_cast<int>(size), 0);
+            if (received <= 0) {
+                return false;
+            }
+            bytes += received;
+            size -= static_cast<size_t>(received);
+        }
+        return size == 0;
+    }
+
+    bool handshake(rfbSocket sock)
+    {
+        char version[12];
+        uint8_t securityType = 0;
+        uint8_t shared = 0;
+        const uint8_t securityTypes[] = {1, rfbSecTypeNone};
+        const uint8_t securityResult[] = {0, 0, 0, 0};
+        // 1280x720, 32 bpp true colour with 8-bit channels at 16/8/0, name "stalled"
+        const uint8_t serverInit[] = {
+            SERVER_WIDTH >> 8, SERVER_WIDTH & 0xff, SERVER_HEIGHT >> 8, SERVER_HEIGHT & 0xff,
+            32, 24, 0, 1, 0, 255, 0, 255, 0, 255, 16, 8, 0, 0, 0, 0,
+            0, 0, 0, 7, 's', 't', 'a', 'l', 'l', 'e', 'd'};
+        return sendAll(sock, "RFB 003.008\n", 12) && receiveAll(sock, version, sizeof(version))
+            && sendAll(sock, securityTypes, sizeof(securityTypes)) && receiveAll(sock, &securityType, 1)
+            && sendAll(sock, securityResult, sizeof(securityResult)) && receiveAll(sock, &shared, 1)
+            && sendAll(sock, serverInit, sizeof(serverInit));
+    }
+
+    void run()
+    {
+        while (!m_stopping) {
+            if (!readable(m_listen)) {
+                continue;
+            }
+            rfbSocket sock = accept(m_listen, nullptr, nullptr);
+            if (sock == RFB_INVALID_SOCKET) {
+                continue;
+            }
+            m_clients++;
+            // Message type and padding of a FramebufferUpdate; the rectangle count never follows
+            const uint8_t partialUpdate[] = {rfbFramebufferUpdate, 0};
+            if (handshake(sock) && sendAll(sock, partialUpdate, sizeof(partialUpdate))) {
+                // Swallow the client's messages until it goes away
+                char discard[4096];
+                while (!m_stopping) {
+                    if (readable(sock) && recv(sock, discard, sizeof(discard), 0) <= 0) {
+                        break;
+                    }
+                }
+            }
+            closeSocket(sock);
+            m_clients--;
+        }
+    }
+
+    rfbSocket m_listen = RFB_INVALID_SOCKET;
+    std::thread m_thread;
+    std::atomic<bool> m_stopping{false};
+    std::atomic<int> m_clients{0};
+};
+
+void processEventsFor(int ms)
+{
+    QEventLoop loop;
+    QTimer::singleShot(ms, &loop, &QEventLoop::quit);
+    loop.exec();
+}
+
+bool parseOptions(int argc, char *argv[], Options &options)
+{
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (std::strcmp(arg, "--verbose") == 0) {
+            options.verbose = true;
+            continue;
+        }
+        if (!value) {
+            return false;
+        }
+        if (std::strcmp(arg, "--cycles") == 0) {
+            options.cycles = std::atoi(value);
+        } else if (std::strcmp(arg, "--port") == 0) {
+            options.port = std::atoi(value);
+        } else if (std::strcmp(arg, "--stream-ms") == 0) {
+            options.streamMs = std::atoi(value);
+        } else if (std::strcmp(arg, "--drop-rate") == 0) {
+            options.dropRate = std::atof(value);
+        } else if (std::strcmp(arg, "--refuse-rate") == 0) {
+            options.refuseRate = std::atof(value);
+        } else if (std::strcmp(arg, "--stall-rate") == 0) {
+            options.stallRate = std::atof(value);
+        } else if (std::strcmp(arg, "--seed") == 0) {
+            options.seed = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+        } else if (std::strcmp(arg, "--max-rss-growth-kb") == 0) {
+            options.maxRssGrowthKb = std::atol(value);
+        } else {
+            return false;
+        }
+        i++;
+    }
+    return options.cycles > 0 && options.port > 0 && options.port < 65535 && options.streamMs > 0;
+}
+
+double percentile(std::vector<double> values, double p)
+{
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = std::min(values.size() - 1, static_cast<size_t>(p * (values.size() - 1) + 0.5));
+    return values[index];
+}
+
+long median(std::vector<long> values)
+{
+    std::sort(values.begin(), values.end());
+    return values.empty() ? -1 : values[values.size() / 2];
+}
+
+Resources medianResources(const std::vector<Resources> &samples, size_t begin, size_t end)
+{
+    std::vector<long> rss;
+    std::vector<long> handles;
+    std::vector<long> threads;
+    for (size_t i = begin; i < end && i < samples.size(); i++) {
+        rss.push_back(samples[i].rssKb);
+        handles.push_back(samples[i].handles);
+        threads.push_back(samples[i].threads);
+    }
+    return {median(rss), median(handles), median(threads)};
+}
+
+void printLatency(const char *label, const std::vector<double> &ms)
+{
+    std::printf("%-9s p50 %7.2f ms  p90 %7.2f ms  p99 %7.2f ms  max %7.2f ms\n", label, percentile(ms, 0.5),
+                percentile(ms, 0.9), percentile(ms, 0.99), percentile(ms, 1.0));
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::fprintf(stderr, "Usage: %s [--cycles n] [--port p] [--stream-ms ms] [--drop-rate 0-1] [--refuse-rate 0-1]"
+                             " [--stall-rate 0-1] [--seed n] [--max-rss-growth-kb kb] [--verbose]\n", argv[0]);
+        return 2;
+    }
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication app(argc, argv);
+
+    QTemporaryDir settingsDir;
+    QSettings::setPath(QSettings::NativeFormat, QSettings::UserScope, settingsDir.path());
+    QSettings::setPath(QSettings::IniFormat, QSettings::UserScope, settingsDir.path());
+
+    StandInServer server;
+    if (!server.start(argv[0], options.port)) {
+        std::fprintf(stderr, "[ERROR] Stand-in server failed to listen on port %d\n", options.port);
+        return 1;
+    }
+    StalledServer stalledServer;
+    if (!stalledServer.start(options.port + 1)) {
+        std::fprintf(stderr, "[ERROR] Stalling server failed to listen on port %d\n", options.port + 1);
+        server.stop();
+        return 1;
+    }
+
+    NullBuffer nullBuffer;
+    std::streambuf *coutBuffer = std::cout.rdbuf();
+    if (!options.verbose) {
+        std::cout.rdbuf(&nullBuffer);
+    }
+
+    std::mt19937 random(options.seed);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    std::uniform_int_distribution<int> streamTime(options.streamMs / 4 + 1, options.streamMs);
+    std::vector<double> setupMs;
+    std::vector<double> teardownMs;
+    std::vector<Resources> samples;
+    int drops = 0;
+    int refusals = 0;
+    int stalls = 0;
+    int slowStalledTeardowns = 0;
+    int stuck = 0;
+
+    for (int cycle = 0; cycle < options.cycles; cycle++) {
+        bool stall = chance(random) < options.stallRate;
+        bool refuse = !stall && chance(random) < options.refuseRate;
+        bool drop = !stall && !refuse && chance(random) < options.dropRate;
+        int streamMs = streamTime(random);
+        server.refuseNext(refuse);
+
+        QElapsedTimer timer;
+        timer.start();
+        MainWindow *window = new MainWindow();
+        window->show();
+        window->connectToServer("127.0.0.1", stall ? options.port + 1 : options.port);
+        setupMs.push_back(timer.nsecsElapsed() / 1e6);
+
+        if (drop) {
+            processEventsFor(streamMs / 2);
+            server.dropClients();
+            processEventsFor(streamMs - streamMs / 2);
+            drops++;
+        } else {
+            processEventsFor(streamMs);
+        }
+        refusals += refuse ? 1 : 0;
+        stalls += stall ? 1 : 0;
+
+        timer.restart();
+        window->close();
+        delete window;
+        QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+        teardownMs.push_back(timer.nsecsElapsed() / 1e6);
+        if (stall && teardownMs.back() > STALLED_TEARDOWN_LIMIT_MS) {
+            slowStalledTeardowns++;
+        }
+
+        if (!server.waitIdle(SERVER_IDLE_TIMEOUT_MS) || !stalledServer.waitIdle(SERVER_IDLE_TIMEOUT_MS)) {
+            stuck++;
+        }
+        samples.push_back(sampleResources());
+
+        if ((cycle + 1) % 100 == 0) {
+            const Resources &now = samples.back();
+            std::fprintf(stderr, "[INFO] %d/%d cycles, RSS %ld KB, %ld fds, %ld threads\n", cycle + 1, options.cycles,
+                         now.rssKb, now.handles, now.threads);
+        }
+    }
+
+    std::cout.rdbuf(coutBuffer);
+    stalledServer.stop();
+    server.stop();
+
+    // Warm-up is a tenth of the run; growth is judged between the windows after it and at the end
+    size_t warmup = std::max<size_t>(samples.size() / 10, 1);
+    size_t sampleWindow = std::max<size_t>(1, std::min<size_t>(SAMPLE_WINDOW, (samples.size() - warmup) / 2));
+    Resources baseline = medianResources(samples, warmup, warmup + sampleWindow);
+    Resources last = medianResources(samples, samples.size() - sampleWindow, samples.size());
+
+    std::printf("%d cycles (%d server drops, %d refused handshakes, %d stalled servers), %d sessions the server did"
+                " not see go away\n", options.cycles, drops, refusals, stalls, stuck);
+    std::printf("%d closes of a stalled session took longer than %d ms\n", slowStalledTeardowns, STALLED_TEARDOWN_LIMIT_MS);
+    printLatency("setup", setupMs);
+    printLatency("teardown", teardownMs);
+    std::printf("RSS       %ld KB -> %ld KB\n", baseline.rssKb, last.rssKb);
+    std::printf("fds       %ld -> %ld\n", baseline.handles, last.handles);
+    std::printf("threads   %ld -> %ld\n", baseline.threads, last.threads);
+
+    bool flat = stuck == 0 && slowStalledTeardowns == 0 && last.rssKb - baseline.rssKb <= options.maxRssGrowthKb
+        && last.handles <= baseline.handles && last.threads <= baseline.threads;
+    std::printf("%s\n", flat ? "PASS" : "FAIL");
+    return flat ? 0 : 1;
+}
@@ -0,0 +1,243 @@
+#include "compressedframebuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef WVNCC_HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Rows per band: big enough to compress well, small enough that a typing update
+// decompresses little
+const int BAND_ROWS = 32;
+// Compressing must at least halve the framebuffer to be worth the work
+const int MIN_COMPRESSION_RATIO = 2;
+
+QByteArray packFramebufferBytes(const uint8_t *data, int size)
+{
+#ifdef WVNCC_HAVE_LZ4
+    QByteArray packed(LZ4_compressBound(size), Qt::Uninitialized);
+    int length = LZ4_compress_default(reinterpret_cast<const char *>(data), packed.data(), size, packed.size());
+    packed.resize(std::max(0, length));
+    // Shrinking keeps the worst-case allocation, which is as big as the input
+    packed.squeeze();
+    return packed;
+#else
+    return qCompress(data, size, 1);
+#endif
+}
+
+bool unpackFramebufferBytes(const QByteArray &packed, uint8_t *dst, int size)
+{
+#ifdef WVNCC_HAVE_LZ4
+    return LZ4_decompress_safe(packed.constData(), reinterpret_cast<char *>(dst), packed.size(), size) == size;
+#else
+    QByteArray bytes = qUncompress(packed);
+    if (bytes.size() != size) {
+        return false;
+    }
+    memcpy(dst, bytes.constData(), size);
+    return true;
+#endif
+}
+
+namespace {
+
+size_t pageSize()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+// Hands the whole pages inside [begin, end) back to the OS; their contents become undefined
+// but they stay mapped, so a decoder writing there just faults in a fresh page
+void releasePages(uint8_t *begin, uint8_t *end)
+{
+    static const uintptr_t page = pageSize();
+    uintptr_t first = (reinterpret_cast<uintptr_t>(begin) + page - 1) & ~(page - 1);
+    uintptr_t last = reinterpret_cast<uintptr_t>(end) & ~(page - 1);
+    if (last <= first) {
+        return;
+    }
+#ifdef _WIN32
+    VirtualAlloc(reinterpret_cast<void *>(first), last - first, MEM_RESET, PAGE_READWRITE);
+    // Unlocking pages that are not locked drops them from the working set
+    VirtualUnlock(reinterpret_cast<void *>(first), last - first);
+#else
+    madvise(reinterpret_cast<void *>(first), last - first, MADV_DONTNEED);
+#endif
+}
+
+} // namespace
+
+bool CompressedFramebuffer::compress(const FramebufferView &fb)
+{
+    drop();
+    if (!fb.pixels || fb.width <= 0 || fb.height <= 0) {
+        return false;
+    }
+    m_pixels = fb.pixels;
+    m_width = fb.width;
+    m_height = fb.height;
+    m_stride = fb.stride;
+
+    int bands = (fb.height + BAND_ROWS - 1) / BAND_ROWS;
+    m_bands.resize(bands);
+    m_compressedBytes = 0;
+    for (int band = 0; band < bands; band++) {
+        m_bands[band].data = packFramebufferBytes(bandStart(fb, band), bandBytes(fb, band));
+        if (m_bands[band].data.isEmpty()) {
+            drop();
+            return false;
+        }
+        m_compressedBytes += m_bands[band].data.size();
+    }
+    if (m_compressedBytes * MIN_COMPRESSION_RATIO > static_cast<size_t>(fb.stride) * fb.height) {
+        drop();
+        return false;
+    }
+
+    for (int band = 0; band < bands; band++) {
+        releasePages(bandStart(fb, band), bandStart(fb, band) + bandBytes(fb, band));
+    }
+    m_active.store(true, std::memory_order_release);
+    return true;
+}
+
+void CompressedFramebuffer::restore(const FramebufferView &fb)
+{
+    if (matches(fb)) {
+        for (int band = 0; band < static_cast<int>(m_bands.size()); band++) {
+            materialize(fb, band);
+        }
+    }
+    drop();
+}
+
+void CompressedFramebuffer::prepareWrite(const FramebufferView &fb, const QRect &rect)
+{
+    if (!matches(fb)) {
+        drop();
+        return;
+    }
+    int first = std::max(0, rect.y()) / BAND_ROWS;
+    int last = std::min(fb.height - 1, rect.bottom()) / BAND_ROWS;
+    for (int band = first; band <= last; band++) {
+        materialize(fb, band);
+    }
+}
+
+void CompressedFramebuffer::rectWritten(const FramebufferView &fb, const QRect &rect)
+{
+    if (!matches(fb)) {
+        drop();
+        return;
+    }
+    // The rectangle holds new pixels, the rest of the band is undefined: merge with the stored band
+    QRect written = rect & QRect(0, 0, fb.width, fb.height);
+    if (written.isEmpty()) {
+        return;
+    }
+    int rowBytes = written.width() * fb.bytesPerPixel;
+    for (int band = written.y() / BAND_ROWS; band <= written.bottom() / BAND_ROWS; band++) {
+        if (m_bands[band].resident) {
+            continue;
+        }
+        int bytes = bandBytes(fb, band);
+        m_scratch.resize(bytes);
+        if (!unpackFramebufferBytes(m_bands[band].data, m_scratch.data(), bytes)) {
+            m_scratch.assign(bytes, 0);
+        }
+        int firstRow = std::max(written.y(), band * BAND_ROWS);
+        int endRow = std::min(written.bottom() + 1, (band + 1) * BAND_ROWS);
+        for (int row = firstRow; row < endRow; row++) {
+            size_t offset = static_cast<size_t>(row - band * BAND_ROWS) * fb.stride + written.x() * fb.bytesPerPixel;
+            memcpy(m_scratch.data() + offset, bandStart(fb, band) + offset, rowBytes);
+        }
+        memcpy(bandStart(fb, band), m_scratch.data(), bytes);
+        m_bands[band].resident = true;
+        m_residentBands.push_back(band);
+    }
+}
+
+void CompressedFramebuffer::updateFinished(const FramebufferView &fb)
+{
+    if (!matches(fb)) {
+        drop();
+        return;
+    }
+    for (int band : m_residentBands) {
+        if (!pack(fb, band)) {
+            // Out of memory or a codec failure: keep the framebuffer whole from here on
+            restore(fb);
+            return;
+        }
+    }
+    m_residentBands.clear();
+}
+
+bool CompressedFramebuffer::matches(const FramebufferView &fb) const
+{
+    return fb.pixels == m_pixels && fb.width == m_width && fb.height == m_height && fb.stride == m_stride;
+}
+
+void CompressedFramebuffer::drop()
+{
+    m_active.store(false, std::memory_order_release);
+    m_bands.clear();
+    m_residentBands.clear();
+    m_scratch.clear();
+    m_scratch.shrink_to_fit();
+    m_pixels = nullptr;
+    m_width = m_height = m_stride = 0;
+    m_compressedBytes = 0;
+}
+
+uint8_t *CompressedFramebuffer::bandStart(const FramebufferView &fb, int band) const
+{
+    return fb.pixels + static_cast<size_t>(band) * BAND_ROWS * fb.stride;
+}
+
+int CompressedFramebuffer::bandBytes(const FramebufferView &fb, int band) const
+{
+    return std::min(BAND_ROWS, fb.height - band * BAND_ROWS) * fb.stride;
+}
+
+void CompressedFramebuffer::materialize(const FramebufferView &fb, int band)
+{
+    Band &entry = m_bands[band];
+    if (entry.resident) {
+        return;
+    }
+    if (!unpackFramebufferBytes(entry.data, bandStart(fb, band), bandBytes(fb, band))) {
+        memset(bandStart(fb, band), 0, bandBytes(fb, band));
+    }
+    entry.resident = true;
+    m_residentBands.push_back(band);
+}
+
+bool CompressedFramebuffer::pack(const FramebufferView &fb, int band)
+{
+    Band &entry = m_bands[band];
+    QByteArray data = packFramebufferBytes(bandStart(fb, band), bandBytes(fb, band));
+    if (data.isEmpty()) {
+        return false;
+    }
+    m_compressedBytes += data.size() - entry.data.size();
+    entry.data = data;
+    entry.resident = false;
+    releasePages(bandStart(fb, band), bandStart(fb, band) + bandBytes(fb, band));
+    return true;
+}
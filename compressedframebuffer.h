@@ -0,0 +1,67 @@
+#ifndef COMPRESSEDFRAMEBUFFER_H
+#define COMPRESSEDFRAMEBUFFER_H
+
+#include <QByteArray>
+#include <QRect>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+#include "framebufferops.h"
+
+// Framebuffer bytes compressed with LZ4 when built with it (WVNCC_HAVE_LZ4), zlib otherwise.
+// An empty result means compression failed.
+QByteArray packFramebufferBytes(const uint8_t *data, int size);
+bool unpackFramebufferBytes(const QByteArray &packed, uint8_t *dst, int size);
+
+// Framebuffer of a session nobody is looking at, kept compressed in bands of rows. The
+// decoders still write into the framebuffer, so its pages stay mapped; the pages of
+// compressed bands are handed back to the OS (their contents become undefined) and a band is
+// decompressed in place when an update touches it, then compressed and released again at the
+// end of the update. restore() brings the whole framebuffer back before it is shown.
+//
+// Everything but isActive() runs on the VNC thread. A framebuffer that changed address or
+// size (desktop resize) is fresh, the stored bands are simply dropped.
+class CompressedFramebuffer
+{
+public:
+    bool isActive() const { return m_active.load(std::memory_order_acquire); }
+
+    // Compresses fb and releases its pages; false (and nothing changed) if that saves little
+    bool compress(const FramebufferView &fb);
+    // Decompresses every band back into fb
+    void restore(const FramebufferView &fb);
+
+    // Before a drawing hook writes rect, and after a decoder wrote rect by other means
+    void prepareWrite(const FramebufferView &fb, const QRect &rect);
+    void rectWritten(const FramebufferView &fb, const QRect &rect);
+    // Recompresses and releases the bands the update touched
+    void updateFinished(const FramebufferView &fb);
+
+    size_t compressedBytes() const { return m_compressedBytes; }
+
+private:
+    struct Band
+    {
+        QByteArray data;
+        bool resident = false;   // Decompressed in the framebuffer during this update
+    };
+
+    bool matches(const FramebufferView &fb) const;
+    void drop();
+    uint8_t *bandStart(const FramebufferView &fb, int band) const;
+    int bandBytes(const FramebufferView &fb, int band) const;
+    void materialize(const FramebufferView &fb, int band);
+    bool pack(const FramebufferView &fb, int band);
+
+    std::atomic<bool> m_active{false};
+    std::vector<Band> m_bands;
+    std::vector<int> m_residentBands;
+    std::vector<uint8_t> m_scratch;
+    const uint8_t *m_pixels = nullptr;
+    int m_width = 0;
+    int m_height = 0;
+    int m_stride = 0;
+    size_t m_compressedBytes = 0;
+};
+
+#endif // COMPRESSEDFRAMEBUFFER_H
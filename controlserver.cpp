@@ -0,0 +1,320 @@
+#include "controlserver.h"
+#include "inputqueue.h"
+#include "regionwatcher.h"
+
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QTimer>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// JSON-RPC 2.0 error codes
+const int ERROR_PARSE = -32700;
+const int ERROR_METHOD_NOT_FOUND = -32601;
+const int ERROR_INVALID_PARAMS = -32602;
+const int ERROR_UNAVAILABLE = -32000;
+const int ERROR_TIMEOUT = -32001;
+
+const int DEFAULT_WAIT_TIMEOUT_MS = 5000;
+
+ControlServer::ControlServer(InputQueue *input, RegionWatcher *watcher, InfoProvider info, QObject *parent)
+    : QObject(parent)
+    , m_input(input)
+    , m_watcher(watcher)
+    , m_info(std::move(info))
+{
+    connect(m_watcher, &RegionWatcher::finished, this, &ControlServer::regionWaitFinished, Qt::QueuedConnection);
+}
+
+bool ControlServer::listen(const QString &name)
+{
+    m_server = new QLocalServer(this);
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    QLocalServer::removeServer(name);
+    if (!m_server->listen(name)) {
+        std::cerr << "[ERROR] Failed to listen for control connections on " << name.toStdString()
+                  << ": " << m_server->errorString().toStdString() << std::endl;
+        return false;
+    }
+    connect(m_server, &QLocalServer::newConnection, this, &ControlServer::acceptConnections);
+    std::cout << "[INFO] Control socket listening on " << m_server->fullServerName().toStdString() << std::endl;
+    return true;
+}
+
+void ControlServer::acceptConnections()
+{
+    while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+        connect(socket, &QLocalSocket::readyRead, this, &ControlServer::readRequests);
+        connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+    }
+}
+
+void ControlServer::readRequests()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+    if (!socket) {
+        return;
+    }
+
+    while (socket->canReadLine()) {
+        QByteArray line = socket->readLine().trimmed();
+        if (line.isEmpty()) {
+            continue;
+        }
+        QJsonParseError parseError;
+        QJsonDocument document = QJsonDocument::fromJson(line, &parseError);
+        if (parseError.error != QJsonParseError::NoError || !document.isObject()) {
+            sendError(socket, QJsonValue(), ERROR_PARSE, "Invalid JSON request");
+            continue;
+        }
+        handleRequest(socket, document.object());
+    }
+}
+
+void ControlServer::handleRequest(QLocalSocket *socket, const QJsonObject &request)
+{
+    QJsonValue id = request.value("id");
+    QString method = request.value("method").toString();
+    QJsonObject params = request.value("params").toObject();
+
+    if (method == "info") {
+        sendResult(socket, id, m_info());
+    } else if (method == "input") {
+        handleInput(socket, id, params);
+    } else if (method == "region") {
+        handleRegion(socket, id, params);
+    } else if (method == "waitUpdate") {
+        handleWaitUpdate(socket, id, params);
+    } else if (method == "waitChange") {
+        handleWaitRegion(socket, id, params, false);
+    } else if (method == "waitMatch") {
+        handleWaitRegion(socket, id, params, true);
+    } else {
+        sendError(socket, id, ERROR_METHOD_NOT_FOUND, "Unknown method: " + method);
+    }
+}
+
+void ControlServer::handleInput(QLocalSocket *socket, const QJsonValue &id, const QJsonObject &params)
+{
+    if (!m_info().value("connected").toBool()) {
+        sendError(socket, id, ERROR_UNAVAILABLE, "Not connected");
+        return;
+    }
+
+    std::vector<InputEvent> events;
+    const QJsonArray array = params.value("events").toArray();
+    events.reserve(array.size());
+    for (const QJsonValue &value : array) {
+        QJsonObject object = value.toObject();
+        InputEvent event;
+        QString type = object.value("type").toString();
+        if (type == "key") {
+            event.type = InputEvent::Key;
+            event.keysym = static_cast<uint32_t>(object.value("keysym").toDouble());
+            event.down = object.value("down").toBool();
+        } else if (type == "pointer") {
+            event.type = InputEvent::Pointer;
+            event.x = object.value("x").toInt();
+            event.y = object.value("y").toInt();
+            event.buttonMask = object.value("buttons").toInt();
+        } else {
+            sendError(socket, id, ERROR_INVALID_PARAMS, "Unknown event type: " + type);
+            return;
+        }
+        event.delayMs = std::max(0, object.value("delayMs").toInt());
+        events.push_back(event);
+    }
+
+    QPointer<QLocalSocket> target(socket);
+    m_input->enqueue(events, [target, id](int sent) {
+        if (target) {
+            QJsonObject result;
+            result["sent"] = sent;
+            sendResult(target, id, result);
+        }
+    });
+}
+
+void ControlServer::handleRegion(QLocalSocket *socket, const QJsonValue &id, const QJsonObject &params)
+{
+    QJsonObject info = m_info();
+    QJsonObject shm = info.value("shm").toObject();
+    if (shm.isEmpty()) {
+        sendError(socket, id, ERROR_UNAVAILABLE, "Shared framebuffer not available");
+        return;
+    }
+
+    int width = info.value("width").toInt();
+    int height = info.value("height").toInt();
+    int x = params.value("x").toInt();
+    int y = params.value("y").toInt();
+    int w = params.value("width").toInt(width - x);
+    int h = params.value("height").toInt(height - y);
+    if (x < 0 || y < 0 || w <= 0 || h <= 0 || x + w > width || y + h > height) {
+        sendError(socket, id, ERROR_INVALID_PARAMS, "Region outside the framebuffer");
+        return;
+    }
+
+    // The reader maps the segment once and reads rows in place
+    int bytesPerPixel = info.value("bitsPerPixel").toInt() / 8;
+    qint64 stride = static_cast<qint64>(shm.value("stride").toDouble());
+    QJsonObject result;
+    result["shm"] = shm.value("name");
+    result["offset"] = static_cast<qint64>(shm.value("pixelOffset").toDouble()) + y * stride + static_cast<qint64>(x) * bytesPerPixel;
+    result["stride"] = stride;
+    result["width"] = w;
+    result["height"] = h;
+    result["bitsPerPixel"] = info.value("bitsPerPixel");
+    sendResult(socket, id, result);
+}
+
+void ControlServer::handleWaitUpdate(QLocalSocket *socket, const QJsonValue &id, const QJsonObject &params)
+{
+    int timeoutMs = params.value("timeoutMs").toInt(DEFAULT_WAIT_TIMEOUT_MS);
+    uint64_t key = m_nextWait++;
+    m_waits[key] = PendingWait{socket, id};
+
+    QTimer::singleShot(timeoutMs, this, [this, key]() {
+        auto it = m_waits.find(key);
+        if (it == m_waits.end()) {
+            return;
+        }
+        if (it->second.socket) {
+            sendError(it->second.socket, it->second.id, ERROR_TIMEOUT, "Timed out waiting for an update");
+        }
+        m_waits.erase(it);
+    });
+}
+
+void ControlServer::handleWaitRegion(QLocalSocket *socket, const QJsonValue &id, const QJsonObject &params, bool match)
+{
+    QJsonObject info = m_info();
+    if (!info.value("connected").toBool() || !info.contains("width")) {
+        sendError(socket, id, ERROR_UNAVAILABLE, "Not connected");
+        return;
+    }
+
+    RegionWatcher::Watch watch;
+    watch.match = match;
+    watch.tolerance = std::clamp(params.value("tolerance").toInt(), 0, 255);
+    QImage image;
+    if (match) {
+        image = QImage::fromData(QByteArray::fromBase64(params.value("image").toString().toLatin1()));
+        if (image.isNull()) {
+            sendError(socket, id, ERROR_INVALID_PARAMS, "waitMatch needs a base64 image");
+            return;
+        }
+        watch.threshold = std::max<qint64>(0, static_cast<qint64>(params.value("maxPixels").toDouble()));
+    } else {
+        watch.threshold = std::max<qint64>(1, static_cast<qint64>(params.value("minPixels").toDouble(1))) - 1;
+    }
+
+    int width = info.value("width").toInt();
+    int height = info.value("height").toInt();
+    int x = params.value("x").toInt();
+    int y = params.value("y").toInt();
+    int w = params.value("width").toInt(match ? image.width() : width - x);
+    int h = params.value("height").toInt(match ? image.height() : height - y);
+    if (x < 0 || y < 0 || w <= 0 || h <= 0 || x + w > width || y + h > height) {
+        sendError(socket, id, ERROR_INVALID_PARAMS, "Region outside the framebuffer");
+        return;
+    }
+    watch.rect = QRect(x, y, w, h);
+
+    if (match) {
+        if (image.size() != watch.rect.size()) {
+            sendError(socket, id, ERROR_INVALID_PARAMS, "Image size differs from the region");
+            return;
+        }
+        // Same layout as the framebuffer: xRGB for 32-bit sessions, RGB565 for 16-bit ones
+        int bitsPerPixel = info.value("bitsPerPixel").toInt();
+        if (bitsPerPixel != 32 && bitsPerPixel != 16) {
+            sendError(socket, id, ERROR_UNAVAILABLE, "Unsupported framebuffer format");
+            return;
+        }
+        image = image.convertToFormat(bitsPerPixel == 32 ? QImage::Format_RGB32 : QImage::Format_RGB16);
+        int rowBytes = w * bitsPerPixel / 8;
+        watch.reference.resize(rowBytes * h);
+        for (int row = 0; row < h; row++) {
+            memcpy(watch.reference.data() + row * rowBytes, image.constScanLine(row), rowBytes);
+        }
+    }
+
+    uint64_t key = m_watcher->add(watch);
+    m_regionWaits[key] = PendingWait{socket, id};
+
+    int timeoutMs = params.value("timeoutMs").toInt(DEFAULT_WAIT_TIMEOUT_MS);
+    QTimer::singleShot(timeoutMs, this, [this, key]() {
+        auto it = m_regionWaits.find(key);
+        if (it == m_regionWaits.end()) {
+            return;
+        }
+        m_watcher->cancel(key);
+        if (it->second.socket) {
+            sendError(it->second.socket, it->second.id, ERROR_TIMEOUT, "Timed out waiting for the region");
+        }
+        m_regionWaits.erase(it);
+    });
+}
+
+void ControlServer::regionWaitFinished(quint64 key, qint64 differentPixels, int updates, const QString &error)
+{
+    auto it = m_regionWaits.find(key);
+    if (it == m_regionWaits.end()) {
+        return;
+    }
+    if (it->second.socket) {
+        if (error.isEmpty()) {
+            QJsonObject result;
+            result["differentPixels"] = differentPixels;
+            result["updates"] = updates;
+            sendResult(it->second.socket, it->second.id, result);
+        } else {
+            sendError(it->second.socket, it->second.id, ERROR_UNAVAILABLE, error);
+        }
+    }
+    m_regionWaits.erase(it);
+}
+
+void ControlServer::framebufferUpdated()
+{
+    m_updateCount++;
+    if (m_waits.empty()) {
+        return;
+    }
+
+    QJsonObject result;
+    result["updates"] = static_cast<qint64>(m_updateCount);
+    std::map<uint64_t, PendingWait> waits;
+    waits.swap(m_waits);
+    for (auto &entry : waits) {
+        if (entry.second.socket) {
+            sendResult(entry.second.socket, entry.second.id, result);
+        }
+    }
+}
+
+void ControlServer::sendResult(QLocalSocket *socket, const QJsonValue &id, const QJsonObject &result)
+{
+    QJsonObject response;
+    response["jsonrpc"] = "2.0";
+    response["id"] = id;
+    response["result"] = result;
+    socket->write(QJsonDocument(response).toJson(QJsonDocument::Compact) + '\n');
+}
+
+void ControlServer::sendError(QLocalSocket *socket, const QJsonValue &id, int code, const QString &message)
+{
+    QJsonObject error;
+    error["code"] = code;
+    error["message"] = message;
+    QJsonObject response;
+    response["jsonrpc"] = "2.0";
+    response["id"] = id;
+    response["error"] = error;
+    socket->write(QJsonDocument(response).toJson(QJsonDocument::Compact) + '\n');
+}
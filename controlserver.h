@@ -0,0 +1,76 @@
+#ifndef CONTROLSERVER_H
+#define CONTROLSERVER_H
+
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QObject>
+#include <QPointer>
+#include <cstdint>
+#include <functional>
+#include <map>
+
+class QLocalServer;
+class QLocalSocket;
+class InputQueue;
+class RegionWatcher;
+
+// Local automation API (WVNCC_CONTROL_SOCKET): newline-delimited JSON-RPC 2.0 over a
+// Unix socket / named pipe. Methods:
+//   info                                   desktop size, pixel format and shared-memory segment
+//   input      {events:[...]}              key {type:"key",keysym,down,delayMs} and pointer
+//                                          {type:"pointer",x,y,buttons,delayMs} events, replied once sent
+//   region     {x,y,width,height}          offset/stride of a rectangle inside the shared segment
+//   waitUpdate {timeoutMs}                 replied after the next completed framebuffer update
+//   waitChange {x,y,width,height,tolerance,minPixels,timeoutMs}
+//                                          replied once at least minPixels of the rectangle differ
+//                                          from what it showed when the request arrived
+//   waitMatch  {x,y,width,height,image,tolerance,maxPixels,timeoutMs}
+//                                          replied once at most maxPixels differ from the base64
+//                                          image (PNG or any format Qt reads)
+class ControlServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    using InfoProvider = std::function<QJsonObject()>;
+
+    ControlServer(InputQueue *input, RegionWatcher *watcher, InfoProvider info, QObject *parent = nullptr);
+
+    bool listen(const QString &name);
+
+public slots:
+    // Called on the UI thread after each FinishedFrameBufferUpdate
+    void framebufferUpdated();
+
+private slots:
+    void acceptConnections();
+    void readRequests();
+    void regionWaitFinished(quint64 id, qint64 differentPixels, int updates, const QString &error);
+
+private:
+    struct PendingWait
+    {
+        QPointer<QLocalSocket> socket;
+        QJsonValue id;
+    };
+
+    void handleRequest(QLocalSocket *socket, const QJsonObject &request);
+    void handleInput(QLocalSocket *socket, const QJsonValue &id, const QJsonObject &params);
+    void handleRegion(QLocalSocket *socket, const QJsonValue &id, const QJsonObject &params);
+    void handleWaitUpdate(QLocalSocket *socket, const QJsonValue &id, const QJsonObject &params);
+    void handleWaitRegion(QLocalSocket *socket, const QJsonValue &id, const QJsonObject &params, bool match);
+
+    static void sendResult(QLocalSocket *socket, const QJsonValue &id, const QJsonObject &result);
+    static void sendError(QLocalSocket *socket, const QJsonValue &id, int code, const QString &message);
+
+    QLocalServer *m_server = nullptr;
+    InputQueue *m_input;
+    RegionWatcher *m_watcher;
+    InfoProvider m_info;
+    std::map<uint64_t, PendingWait> m_waits;
+    uint64_t m_nextWait = 1;
+    uint64_t m_updateCount = 0;
+    std::map<uint64_t, PendingWait> m_regionWaits;  // By RegionWatcher id
+};
+
+#endif // CONTROLSERVER_H
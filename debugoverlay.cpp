@@ -0,0 +1,238 @@
+#include "debugoverlay.h"
+
+#include <QPainter>
+#include <QTimer>
+#include <algorithm>
+#include <cmath>
+
+// Outline lifetime and redraw rate while the overlay is shown
+const qint64 FADE_MS = 1000;
+const int TICK_MS = 50;
+// Heat map resolution in remote pixels
+const int HEAT_CELL = 16;
+// Bounds on what is kept between ticks if the UI falls behind
+const size_t MAX_PENDING = 16384;
+const size_t MAX_RECENT = 4096;
+// Rectangles narrower or lower than this (window pixels) get no byte label
+const int LABEL_MIN_SIZE = 48;
+
+namespace {
+
+QColor encodingColour(int encoding)
+{
+    switch (encoding) {
+        case SessionMetrics::Raw: return QColor(255, 64, 64);
+        case SessionMetrics::CopyRect: return QColor(64, 128, 255);
+        case SessionMetrics::Hextile: return QColor(64, 220, 64);
+        default: return QColor(255, 200, 0);
+    }
+}
+
+QString formatBytes(double bytes)
+{
+    if (bytes >= 1024.0 * 1024.0) {
+        return QString::number(bytes / (1024.0 * 1024.0), 'f', 1) + " MiB";
+    }
+    if (bytes >= 1024.0) {
+        return QString::number(bytes / 1024.0, 'f', 1) + " KiB";
+    }
+    return QString::number(static_cast<qint64>(bytes)) + " B";
+}
+
+}
+
+DebugOverlay::DebugOverlay(MappingProvider mapping, QWidget *parent)
+    : QWidget(parent)
+    , m_mapping(std::move(mapping))
+{
+    setAttribute(Qt::WA_TransparentForMouseEvents);
+    setAttribute(Qt::WA_NoSystemBackground);
+    setFocusPolicy(Qt::NoFocus);
+    hide();
+
+    m_timer = new QTimer(this);
+    m_timer->setInterval(TICK_MS);
+    connect(m_timer, &QTimer::timeout, this, &DebugOverlay::tick);
+    m_clock.start();
+}
+
+void DebugOverlay::setActive(bool active)
+{
+    if (active == isActive()) {
+        return;
+    }
+
+    // Each session starts from an empty heat map
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        m_pending.clear();
+    }
+    m_recent.clear();
+    std::fill(m_heat.begin(), m_heat.end(), 0);
+    m_heatMax = 0;
+    m_heatDirty = true;
+    std::fill(std::begin(m_rectCount), std::end(m_rectCount), 0);
+    std::fill(std::begin(m_byteCount), std::end(m_byteCount), 0);
+
+    m_active.store(active, std::memory_order_relaxed);
+    if (active) {
+        raise();
+        show();
+        m_timer->start();
+    } else {
+        m_timer->stop();
+        hide();
+    }
+}
+
+void DebugOverlay::setFramebufferSize(const QSize &size)
+{
+    if (size == m_framebufferSize) {
+        return;
+    }
+    m_framebufferSize = size;
+    int columns = (size.width() + HEAT_CELL - 1) / HEAT_CELL;
+    int rows = (size.height() + HEAT_CELL - 1) / HEAT_CELL;
+    m_heat.assign(static_cast<size_t>(columns) * rows, 0);
+    m_heatMax = 0;
+    m_heatImage = QImage(columns, rows, QImage::Format_ARGB32_Premultiplied);
+    m_heatImage.fill(Qt::transparent);
+    m_heatDirty = false;
+}
+
+void DebugOverlay::record(int x, int y, int w, int h, int encoding, int bytes)
+{
+    if (!isActive()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_pendingMutex);
+    if (m_pending.size() < MAX_PENDING) {
+        m_pending.push_back({QRect(x, y, w, h), encoding, bytes, m_clock.elapsed()});
+    }
+}
+
+void DebugOverlay::accumulate(const Damage &damage)
+{
+    int encoding = std::clamp(damage.encoding, 0, static_cast<int>(SessionMetrics::EncodingCount) - 1);
+    m_rectCount[encoding]++;
+    m_byteCount[encoding] += static_cast<uint64_t>(damage.bytes);
+
+    if (m_heatImage.isNull()) {
+        return;
+    }
+    QRect rect = damage.rect.intersected(QRect(QPoint(0, 0), m_framebufferSize));
+    if (rect.isEmpty()) {
+        return;
+    }
+    int columns = m_heatImage.width();
+    for (int row = rect.top() / HEAT_CELL; row <= rect.bottom() / HEAT_CELL; row++) {
+        for (int column = rect.left() / HEAT_CELL; column <= rect.right() / HEAT_CELL; column++) {
+            uint32_t &cell = m_heat[static_cast<size_t>(row) * columns + column];
+            cell++;
+            m_heatMax = std::max(m_heatMax, cell);
+        }
+    }
+    m_heatDirty = true;
+}
+
+void DebugOverlay::tick()
+{
+    std::vector<Damage> pending;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        pending.swap(m_pending);
+    }
+    for (const Damage &damage : pending) {
+        accumulate(damage);
+        m_recent.push_back(damage);
+    }
+
+    qint64 now = m_clock.elapsed();
+    while (!m_recent.empty() && (now - m_recent.front().timeMs > FADE_MS || m_recent.size() > MAX_RECENT)) {
+        m_recent.pop_front();
+    }
+
+    // Log scale, so a blinking cursor does not wash out everything else
+    if (m_heatDirty && !m_heatImage.isNull()) {
+        double scale = m_heatMax ? 1.0 / std::log1p(static_cast<double>(m_heatMax)) : 0.0;
+        int columns = m_heatImage.width();
+        for (int row = 0; row < m_heatImage.height(); row++) {
+            QRgb *line = reinterpret_cast<QRgb *>(m_heatImage.scanLine(row));
+            for (int column = 0; column < columns; column++) {
+                uint32_t count = m_heat[static_cast<size_t>(row) * columns + column];
+                int alpha = count ? static_cast<int>(160.0 * std::log1p(static_cast<double>(count)) * scale) : 0;
+                line[column] = qPremultiply(qRgba(255, 96, 0, alpha));
+            }
+        }
+        m_heatDirty = false;
+    }
+
+    update();
+}
+
+void DebugOverlay::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+
+    ViewportMapping mapping = m_mapping();
+    if (!mapping.isValid()) {
+        return;
+    }
+
+    QPainter painter(this);
+    painter.setClipRect(mapping.target);
+
+    // Heat map, one image pixel per cell stretched over the same mapping as the framebuffer
+    if (!m_heatImage.isNull()) {
+        QRectF heatSource(mapping.source.x() / HEAT_CELL, mapping.source.y() / HEAT_CELL,
+                          mapping.source.width() / HEAT_CELL, mapping.source.height() / HEAT_CELL);
+        painter.drawImage(QRectF(mapping.target), m_heatImage, heatSource);
+    }
+
+    // Fading outlines of recent rectangles
+    double scaleX = mapping.target.width() / mapping.source.width();
+    double scaleY = mapping.target.height() / mapping.source.height();
+    qint64 now = m_clock.elapsed();
+    for (const Damage &damage : m_recent) {
+        QRectF window(mapping.target.x() + (damage.rect.x() - mapping.source.x()) * scaleX,
+                      mapping.target.y() + (damage.rect.y() - mapping.source.y()) * scaleY,
+                      damage.rect.width() * scaleX, damage.rect.height() * scaleY);
+        if (!window.intersects(QRectF(mapping.target))) {
+            continue;
+        }
+        double life = 1.0 - static_cast<double>(now - damage.timeMs) / FADE_MS;
+        QColor colour = encodingColour(damage.encoding);
+        colour.setAlphaF(std::clamp(life, 0.0, 1.0));
+        painter.setPen(colour);
+        QColor fill = colour;
+        fill.setAlphaF(std::clamp(life, 0.0, 1.0) * 0.2);
+        painter.fillRect(window, fill);
+        painter.drawRect(window.adjusted(0, 0, -1, -1));
+        if (damage.bytes > 0 && window.width() >= LABEL_MIN_SIZE && window.height() >= LABEL_MIN_SIZE) {
+            painter.drawText(window.adjusted(3, 2, -3, -2), Qt::AlignLeft | Qt::AlignTop, formatBytes(damage.bytes));
+        }
+    }
+
+    // Legend with totals since the overlay was switched on
+    painter.setClipping(false);
+    QStringList lines;
+    for (int i = 0; i < SessionMetrics::EncodingCount; i++) {
+        lines << QString("%1: %2 rects, %3").arg(SessionMetrics::encodingName(i))
+                     .arg(m_rectCount[i]).arg(formatBytes(static_cast<double>(m_byteCount[i])));
+    }
+    QFontMetrics metrics = painter.fontMetrics();
+    int lineHeight = metrics.height();
+    int legendWidth = 0;
+    for (const QString &line : lines) {
+        legendWidth = std::max(legendWidth, metrics.horizontalAdvance(line));
+    }
+    QRect legend(mapping.target.left() + 8, mapping.target.top() + 8, legendWidth + 24, lineHeight * lines.size() + 8);
+    painter.fillRect(legend, QColor(0, 0, 0, 160));
+    for (int i = 0; i < lines.size(); i++) {
+        QRect swatch(legend.left() + 4, legend.top() + 4 + i * lineHeight + (lineHeight - 10) / 2, 10, 10);
+        painter.fillRect(swatch, encodingColour(i));
+        painter.setPen(Qt::white);
+        painter.drawText(QRect(legend.left() + 20, legend.top() + 4 + i * lineHeight, legendWidth, lineHeight),
+                         Qt::AlignLeft | Qt::AlignVCenter, lines[i]);
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef DEBUGOVERLAY_H
+#define DEBUGOVERLAY_H
+
+#include <QElapsedTimer>
+#include <QImage>
+#include <QRect>
+#include <QWidget>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "metrics.h"
+#include "viewport.h"
+
+class QTimer;
+
+// Damage/encoding debug layer drawn as a transparent child widget over the framebuffer, so
+// the main paintEvent is untouched and the overlay costs nothing while it is hidden.
+// Received rectangles are outlined in their encoding's colour and fade out; a heat map
+// accumulates how often each area of the desktop was updated.
+class DebugOverlay : public QWidget
+{
+    Q_OBJECT
+
+public:
+    using MappingProvider = std::function<ViewportMapping()>;
+
+    DebugOverlay(MappingProvider mapping, QWidget *parent = nullptr);
+
+    bool isActive() const { return m_active.load(std::memory_order_relaxed); }
+    void setActive(bool active);
+    // Resets the heat map when the remote desktop size changes
+    void setFramebufferSize(const QSize &size);
+
+    // Called on the VNC thread for each decoded rectangle while active. bytes is the
+    // rectangle's estimated wire size, 0 if unknown.
+    void record(int x, int y, int w, int h, int encoding, int bytes);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+
+private slots:
+    void tick();
+
+private:
+    struct Damage
+    {
+        QRect rect;
+        int encoding;
+        int bytes;
+        qint64 timeMs;
+    };
+
+    void accumulate(const Damage &damage);
+
+    MappingProvider m_mapping;
+    std::atomic<bool> m_active{false};
+    QTimer *m_timer = nullptr;
+    QElapsedTimer m_clock;
+
+    // Handed from the VNC thread to the UI thread
+    std::mutex m_pendingMutex;
+    std::vector<Damage> m_pending;
+
+    std::deque<Damage> m_recent;          // Outlines still fading
+    QSize m_framebufferSize;
+    std::vector<uint32_t> m_heat;         // Updates per HEAT_CELL x HEAT_CELL block
+    uint32_t m_heatMax = 0;
+    QImage m_heatImage;                   // One pixel per block, rebuilt when m_heat changes
+    bool m_heatDirty = false;
+    uint64_t m_rectCount[SessionMetrics::EncodingCount] = {};
+    uint64_t m_byteCount[SessionMetrics::EncodingCount] = {};
+};
+
+#endif // DEBUGOVERLAY_H
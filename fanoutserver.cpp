@@ -0,0 +1,248 @@
+#include "fanoutserver.h"
+
+#include <QDir>
+#include <QFile>
+#include <QRandomGenerator>
+#include <QStandardPaths>
+#include <iostream>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+extern "C" {
+#include "rfb/rfb.h"
+#include "rfb/rfbclient.h"
+}
+
+// An owner idle for this long loses input to the next viewer that sends any
+const std::chrono::milliseconds OWNER_IDLE_TIMEOUT(3000);
+
+// VNC authentication only uses the first 8 characters of a password
+const int PASSWORD_LENGTH = 8;
+
+struct FanoutCallbacks
+{
+    static FanoutServer *server(rfbClientPtr client)
+    {
+        return static_cast<FanoutServer *>(client->screen->screenData);
+    }
+
+    static void pointer(int buttonMask, int x, int y, rfbClientPtr client)
+    {
+        FanoutServer *fanout = server(client);
+        if (fanout->claimInput(client)) {
+            emit fanout->pointerEvent(x, y, buttonMask);
+        }
+    }
+
+    static void key(rfbBool down, rfbKeySym keysym, rfbClientPtr client)
+    {
+        FanoutServer *fanout = server(client);
+        if (fanout->claimInput(client)) {
+            emit fanout->keyEvent(keysym, down != 0);
+        }
+    }
+
+    static void cutText(char *text, int length, rfbClientPtr client)
+    {
+        FanoutServer *fanout = server(client);
+        if (length > 0 && fanout->claimInput(client)) {
+            emit fanout->clipboardText(QByteArray(text, length));
+        }
+    }
+
+    static void clientGone(rfbClientPtr client)
+    {
+        FanoutServer *fanout = server(client);
+        fanout->releaseInput(client);
+        int viewers = --fanout->m_viewers;
+        std::cout << "[INFO] Fan-out viewer disconnected (" << viewers << " left)" << std::endl;
+    }
+
+    static rfbNewClientAction newClient(rfbClientPtr client)
+    {
+        client->clientGoneHook = clientGone;
+        int viewers = ++server(client)->m_viewers;
+        std::cout << "[INFO] Fan-out viewer connected (" << viewers << " watching)" << std::endl;
+        return RFB_CLIENT_ACCEPT;
+    }
+};
+
+namespace {
+
+// Followers get the decoded pixels exactly as upstream delivered them
+void copyFormat(rfbScreenInfoPtr screen, rfbClient *upstream)
+{
+    screen->serverFormat.bitsPerPixel = upstream->format.bitsPerPixel;
+    screen->serverFormat.depth = upstream->format.depth;
+    screen->serverFormat.trueColour = TRUE;
+    screen->serverFormat.bigEndian = upstream->format.bigEndian;
+    screen->serverFormat.redShift = upstream->format.redShift;
+    screen->serverFormat.greenShift = upstream->format.greenShift;
+    screen->serverFormat.blueShift = upstream->format.blueShift;
+    screen->serverFormat.redMax = upstream->format.redMax;
+    screen->serverFormat.greenMax = upstream->format.greenMax;
+    screen->serverFormat.blueMax = upstream->format.blueMax;
+}
+
+}
+
+FanoutServer::FanoutServer(QObject *parent)
+    : QObject(parent)
+{
+}
+
+FanoutServer::~FanoutServer()
+{
+    stop();
+}
+
+bool FanoutServer::start(rfbClient *upstream, int port)
+{
+    stop();
+
+    int bytesPerPixel = upstream->format.bitsPerPixel / 8;
+    rfbScreenInfoPtr screen = rfbGetScreen(nullptr, nullptr, upstream->width, upstream->height, 8, 3, bytesPerPixel);
+    if (!screen) {
+        std::cerr << "[ERROR] Failed to create the fan-out server" << std::endl;
+        return false;
+    }
+
+    screen->frameBuffer = reinterpret_cast<char *>(upstream->frameBuffer);
+    copyFormat(screen, upstream);
+    m_desktopName = upstream->desktopName ? QByteArray(upstream->desktopName) : QByteArray("wvncc");
+    screen->desktopName = m_desktopName.constData();
+    screen->screenData = this;
+    screen->port = port;
+    screen->ipv6port = 0;
+    screen->autoPort = FALSE;
+    screen->listenInterface = htonl(INADDR_LOOPBACK);
+    screen->alwaysShared = TRUE;
+    screen->ptrAddEvent = FanoutCallbacks::pointer;
+    screen->kbdAddEvent = FanoutCallbacks::key;
+    screen->setXCutText = FanoutCallbacks::cutText;
+    screen->newClientHook = FanoutCallbacks::newClient;
+    // Other users of the machine can reach the loopback port too
+    if (!writePassword(port)) {
+        rfbScreenCleanup(screen);
+        return false;
+    }
+    m_passwords[0] = m_password.data();
+    screen->authPasswdData = m_passwords;
+    screen->passwordCheck = rfbCheckPasswordByList;
+    // The upstream cursor is not part of the framebuffer; viewers keep their local one
+    screen->cursor = nullptr;
+
+    rfbInitServer(screen);
+    if (screen->listenSock == RFB_INVALID_SOCKET) {
+        std::cerr << "[ERROR] Fan-out server could not listen on 127.0.0.1:" << port << std::endl;
+        rfbScreenCleanup(screen);
+        QFile::remove(m_passwordFile);
+        m_passwordFile.clear();
+        return false;
+    }
+    rfbRunEventLoop(screen, -1, TRUE);
+
+    m_screen = screen;
+    std::cout << "[INFO] Sharing this session with local viewers on 127.0.0.1:" << port
+              << ", password in " << QDir::toNativeSeparators(m_passwordFile).toStdString() << std::endl;
+    return true;
+}
+
+bool FanoutServer::writePassword(int port)
+{
+    static const char ALPHABET[] = "ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz23456789";
+    m_password.clear();
+    for (int i = 0; i < PASSWORD_LENGTH; i++) {
+        m_password.append(ALPHABET[QRandomGenerator::system()->bounded(static_cast<int>(sizeof(ALPHABET) - 1))]);
+    }
+
+    // Next to the settings, in the user's own profile
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::GenericConfigLocation) + "/wvncc";
+    m_passwordFile = dir + "/share-" + QString::number(port) + ".passwd";
+    QDir().mkpath(dir);
+    QFile::remove(m_passwordFile);
+    QFile file(m_passwordFile);
+    // Restricted before the password goes in
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+        || !file.setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner)
+        || file.write(m_password + "\n") != m_password.size() + 1) {
+        std::cerr << "[ERROR] Failed to write the fan-out password to "
+                  << QDir::toNativeSeparators(m_passwordFile).toStdString() << std::endl;
+        file.close();
+        QFile::remove(m_passwordFile);
+        m_passwordFile.clear();
+        return false;
+    }
+    return true;
+}
+
+void FanoutServer::stop()
+{
+    if (!m_screen) {
+        return;
+    }
+    rfbShutdownServer(m_screen, TRUE);
+    // The framebuffer belongs to the upstream client
+    m_screen->frameBuffer = nullptr;
+    rfbScreenCleanup(m_screen);
+    m_screen = nullptr;
+    m_viewers = 0;
+    QFile::remove(m_passwordFile);
+    m_passwordFile.clear();
+
+    std::lock_guard<std::mutex> lock(m_ownerMutex);
+    m_owner = nullptr;
+}
+
+void FanoutServer::markModified(int x, int y, int w, int h)
+{
+    if (m_screen) {
+        rfbMarkRectAsModified(m_screen, x, y, x + w, y + h);
+    }
+}
+
+void FanoutServer::framebufferReallocated(rfbClient *upstream)
+{
+    if (!m_screen) {
+        return;
+    }
+    // Viewers that support it are told the new size, the others are disconnected by LibVNCServer
+    int bytesPerPixel = upstream->format.bitsPerPixel / 8;
+    rfbNewFramebuffer(m_screen, reinterpret_cast<char *>(upstream->frameBuffer),
+                      upstream->width, upstream->height, 8, 3, bytesPerPixel);
+    copyFormat(m_screen, upstream);
+}
+
+void FanoutServer::sendClipboard(const QByteArray &text)
+{
+    if (m_screen) {
+        rfbSendServerCutText(m_screen, const_cast<char *>(text.constData()), text.size());
+    }
+}
+
+bool FanoutServer::claimInput(rfbClientPtr client)
+{
+    std::lock_guard<std::mutex> lock(m_ownerMutex);
+    auto now = std::chrono::steady_clock::now();
+    if (m_owner && m_owner != client && now - m_ownerLastInput < OWNER_IDLE_TIMEOUT) {
+        return false;
+    }
+    if (m_owner != client) {
+        std::cout << "[INFO] Fan-out input now owned by " << (client->host ? client->host : "viewer") << std::endl;
+    }
+    m_owner = client;
+    m_ownerLastInput = now;
+    return true;
+}
+
+void FanoutServer::releaseInput(rfbClientPtr client)
+{
+    std::lock_guard<std::mutex> lock(m_ownerMutex);
+    if (m_owner == client) {
+        m_owner = nullptr;
+    }
+}
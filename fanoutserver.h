@@ -0,0 +1,70 @@
+#ifndef FANOUTSERVER_H
+#define FANOUTSERVER_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+// Forward declare the libvnc types to keep their headers out of this one
+struct _rfbClient;
+typedef struct _rfbClient rfbClient;
+struct _rfbScreenInfo;
+struct _rfbClientRec;
+
+// Re-serves the upstream session to local viewers (--share <port>): a LibVNCServer screen on
+// the loopback interface whose framebuffer is the upstream client's decoded framebuffer, so
+// followers get the upstream dirty rectangles without another connection to the server.
+// Input from followers is forwarded upstream for one owner at a time; ownership passes to
+// another viewer once the owner has been idle for a few seconds or disconnects. Viewers
+// authenticate with a password generated per start, left in a file only the user can read.
+class FanoutServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FanoutServer(QObject *parent = nullptr);
+    ~FanoutServer();
+
+    // Serves upstream's framebuffer and pixel format on 127.0.0.1:port
+    bool start(rfbClient *upstream, int port);
+    void stop();
+    bool isRunning() const { return m_screen != nullptr; }
+    int viewerCount() const { return m_viewers.load(std::memory_order_relaxed); }
+
+    // VNC thread: after a rectangle was decoded / after the framebuffer was reallocated
+    void markModified(int x, int y, int w, int h);
+    void framebufferReallocated(rfbClient *upstream);
+    // Upstream clipboard, passed on to every viewer
+    void sendClipboard(const QByteArray &text);
+
+signals:
+    // Emitted on LibVNCServer's threads for the input owner; connect queued
+    void pointerEvent(int x, int y, int buttonMask);
+    void keyEvent(uint32_t keysym, bool down);
+    void clipboardText(const QByteArray &text);
+
+private:
+    // LibVNCServer hooks, defined next to the code that needs rfb/rfb.h
+    friend struct FanoutCallbacks;
+
+    // True if client holds (or just took) input ownership
+    bool claimInput(_rfbClientRec *client);
+    void releaseInput(_rfbClientRec *client);
+    bool writePassword(int port);
+
+    _rfbScreenInfo *m_screen = nullptr;
+    QByteArray m_desktopName;
+    QByteArray m_password;
+    char *m_passwords[2] = {};   // Null-terminated list for rfbCheckPasswordByList
+    QString m_passwordFile;
+    std::atomic<int> m_viewers{0};
+    std::mutex m_ownerMutex;
+    _rfbClientRec *m_owner = nullptr;
+    std::chrono::steady_clock::time_point m_ownerLastInput;
+};
+
+#endif // FANOUTSERVER_H
@@ -0,0 +1,273 @@
+#include "framebufferops.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WVNCC_SSE2 1
+#endif
+
+namespace fbops {
+
+namespace {
+
+// Needs the framebuffer address and the stride on the pixel grid, so every Pixel store is aligned
+template <typename Pixel>
+void fillRows(uint8_t *fb, int stride, int x, int y, int w, int h, Pixel value)
+{
+    for (int row = 0; row < h; row++) {
+        Pixel *dst = reinterpret_cast<Pixel *>(fb + (y + row) * stride) + x;
+        for (int i = 0; i < w; i++) {
+            dst[i] = value;
+        }
+    }
+}
+
+// Any address and stride: one byte copy per pixel
+void fillRowsUnaligned(uint8_t *fb, int stride, int bytesPerPixel, int x, int y, int w, int h, uint32_t colour)
+{
+    uint8_t pixel[4];
+    if (bytesPerPixel == 2) {
+        uint16_t value = static_cast<uint16_t>(colour);
+        memcpy(pixel, &value, 2);
+    } else {
+        memcpy(pixel, &colour, 4);
+    }
+    for (int row = 0; row < h; row++) {
+        uint8_t *dst = fb + (y + row) * stride + x * bytesPerPixel;
+        for (int i = 0; i < w; i++, dst += bytesPerPixel) {
+            memcpy(dst, pixel, bytesPerPixel);
+        }
+    }
+}
+
+#ifdef WVNCC_SSE2
+// Rows of at least 16 bytes: one unaligned store for the head, aligned stores for the body
+// and one unaligned store ending at the last byte. The overlapping stores write the same
+// pixels again, which is only right while the aligned stores are in phase with the pattern:
+// the framebuffer address and the stride must both be multiples of bytesPerPixel.
+void fillRowsSse2(uint8_t *fb, int stride, int bytesPerPixel, int x, int y, int w, int h, __m128i pattern)
+{
+    int rowBytes = w * bytesPerPixel;
+    for (int row = 0; row < h; row++) {
+        uint8_t *dst = fb + (y + row) * stride + x * bytesPerPixel;
+        uint8_t *end = dst + rowBytes;
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), pattern);
+        uint8_t *aligned = reinterpret_cast<uint8_t *>((reinterpret_cast<uintptr_t>(dst) + 16) & ~static_cast<uintptr_t>(15));
+        for (; aligned + 16 <= end; aligned += 16) {
+            _mm_store_si128(reinterpret_cast<__m128i *>(aligned), pattern);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(end - 16), pattern);
+    }
+}
+#endif
+
+inline int bitCount(unsigned value)
+{
+    int count = 0;
+    for (; value; value &= value - 1) {
+        count++;
+    }
+    return count;
+}
+
+int countDifferent32(const uint8_t *a, const uint8_t *b, int w, int tolerance)
+{
+    int count = 0;
+    int i = 0;
+#ifdef WVNCC_SSE2
+    // Per-byte |a - b| above the tolerance, then one flag per pixel
+    const __m128i channels = _mm_set1_epi32(0x00ffffff);
+    const __m128i limit = _mm_set1_epi8(static_cast<char>(tolerance));
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= w; i += 4) {
+        __m128i pa = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i * 4));
+        __m128i pb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i * 4));
+        __m128i diff = _mm_or_si128(_mm_subs_epu8(pa, pb), _mm_subs_epu8(pb, pa));
+        __m128i over = _mm_and_si128(_mm_subs_epu8(diff, limit), channels);
+        int same = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(over, zero)));
+        count += 4 - bitCount(static_cast<unsigned>(same));
+    }
+#endif
+    for (; i < w; i++) {
+        const uint8_t *pa = a + i * 4;
+        const uint8_t *pb = b + i * 4;
+        int channel = 0;
+        for (; channel < 3; channel++) {
+            if (std::abs(pa[channel] - pb[channel]) > tolerance) {
+                break;
+            }
+        }
+        count += channel < 3 ? 1 : 0;
+    }
+    return count;
+}
+
+int countDifferent16(const uint8_t *a, const uint8_t *b, int w, int tolerance)
+{
+    const uint16_t *pa = reinterpret_cast<const uint16_t *>(a);
+    const uint16_t *pb = reinterpret_cast<const uint16_t *>(b);
+    int count = 0;
+    int i = 0;
+    if (tolerance == 0) {
+#ifdef WVNCC_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 8 <= w; i += 8) {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pa + i));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pb + i));
+            // Two mask bits per equal 16-bit pixel
+            __m128i same = _mm_cmpeq_epi16(va, vb);
+            count += 8 - bitCount(static_cast<unsigned>(_mm_movemask_epi8(_mm_packs_epi16(same, zero))));
+        }
+#endif
+        for (; i < w; i++) {
+            count += pa[i] != pb[i] ? 1 : 0;
+        }
+        return count;
+    }
+    // Channels widened to 8 bits like the reference image they are compared with
+    for (; i < w; i++) {
+        if (pa[i] == pb[i]) {
+            continue;
+        }
+        int dr = std::abs(((pa[i] >> 11) & 0x1f) - ((pb[i] >> 11) & 0x1f)) << 3;
+        int dg = std::abs(((pa[i] >> 5) & 0x3f) - ((pb[i] >> 5) & 0x3f)) << 2;
+        int db = std::abs((pa[i] & 0x1f) - (pb[i] & 0x1f)) << 3;
+        count += (dr > tolerance || dg > tolerance || db > tolerance) ? 1 : 0;
+    }
+    return count;
+}
+
+// Multiply-rotate rounds on four independent lanes, with constants from xxHash64
+const uint64_t HASH_PRIME1 = 0x9E3779B185EBCA87ULL;
+const uint64_t HASH_PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t HASH_PRIME3 = 0x165667B19E3779F9ULL;
+
+inline uint64_t rotateLeft(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+inline uint64_t hashRound(uint64_t lane, uint64_t input)
+{
+    return rotateLeft(lane + input * HASH_PRIME2, 31) * HASH_PRIME1;
+}
+
+inline uint64_t load64(const uint8_t *p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+} // namespace
+
+uint64_t hashRows(const uint8_t *pixels, int stride, int rowBytes, int rows)
+{
+    uint64_t lanes[4] = {HASH_PRIME1 + HASH_PRIME2, HASH_PRIME2, 0, 0 - HASH_PRIME1};
+    for (int row = 0; row < rows; row++) {
+        const uint8_t *p = pixels + row * stride;
+        int i = 0;
+        for (; i + 32 <= rowBytes; i += 32) {
+            lanes[0] = hashRound(lanes[0], load64(p + i));
+            lanes[1] = hashRound(lanes[1], load64(p + i + 8));
+            lanes[2] = hashRound(lanes[2], load64(p + i + 16));
+            lanes[3] = hashRound(lanes[3], load64(p + i + 24));
+        }
+        for (; i + 8 <= rowBytes; i += 8) {
+            lanes[2] = hashRound(lanes[2], load64(p + i));
+        }
+        for (; i < rowBytes; i++) {
+            lanes[3] = hashRound(lanes[3], p[i]);
+        }
+    }
+    uint64_t hash = rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7) + rotateLeft(lanes[2], 12) + rotateLeft(lanes[3], 18);
+    hash ^= static_cast<uint64_t>(rows) * rowBytes;
+    hash ^= hash >> 33;
+    hash *= HASH_PRIME2;
+    hash ^= hash >> 29;
+    hash *= HASH_PRIME3;
+    hash ^= hash >> 32;
+    return hash ? hash : 1;
+}
+
+int countDifferentPixels(const uint8_t *a, const uint8_t *b, int bytesPerPixel, int w, int tolerance)
+{
+    switch (bytesPerPixel) {
+        case 2:
+            return countDifferent16(a, b, w, tolerance);
+        case 4:
+            return countDifferent32(a, b, w, tolerance);
+    }
+    int count = 0;
+    for (int i = 0; i < w; i++) {
+        count += std::abs(a[i] - b[i]) > tolerance ? 1 : 0;
+    }
+    return count;
+}
+
+void fillRect(uint8_t *fb, int stride, int bytesPerPixel, int x, int y, int w, int h, uint32_t colour)
+{
+    // libvncclient's framebuffers are always on the pixel grid; anything else is filled bytewise
+    if ((reinterpret_cast<uintptr_t>(fb) | static_cast<uintptr_t>(stride)) % bytesPerPixel != 0) {
+        fillRowsUnaligned(fb, stride, bytesPerPixel, x, y, w, h, colour);
+        return;
+    }
+    // Hextile sends most subrectangles as single pixels
+    if (w == 1 && h == 1 && bytesPerPixel == 4) {
+        *reinterpret_cast<uint32_t *>(fb + y * stride + x * 4) = colour;
+        return;
+    }
+#ifdef WVNCC_SSE2
+    // Tile backgrounds and wide subrectangles; narrower rows are quicker pixel by pixel
+    if (w * bytesPerPixel >= 16 && (bytesPerPixel == 4 || bytesPerPixel == 2)) {
+        __m128i pattern = bytesPerPixel == 4 ? _mm_set1_epi32(static_cast<int>(colour))
+                                             : _mm_set1_epi16(static_cast<short>(colour));
+        fillRowsSse2(fb, stride, bytesPerPixel, x, y, w, h, pattern);
+        return;
+    }
+#endif
+    switch (bytesPerPixel) {
+        case 1:
+            fillRows<uint8_t>(fb, stride, x, y, w, h, static_cast<uint8_t>(colour));
+            break;
+        case 2:
+            fillRows<uint16_t>(fb, stride, x, y, w, h, static_cast<uint16_t>(colour));
+            break;
+        case 4:
+            fillRows<uint32_t>(fb, stride, x, y, w, h, colour);
+            break;
+    }
+}
+
+void putBitmap(uint8_t *fb, int stride, int bytesPerPixel, const uint8_t *src, int x, int y, int w, int h)
+{
+    int rowBytes = w * bytesPerPixel;
+    uint8_t *dst = fb + y * stride + x * bytesPerPixel;
+    for (int row = 0; row < h; row++) {
+        memcpy(dst, src, rowBytes);
+        dst += stride;
+        src += rowBytes;
+    }
+}
+
+void copyRect(uint8_t *fb, int stride, int bytesPerPixel, int srcX, int srcY, int w, int h, int destX, int destY)
+{
+    int rowBytes = w * bytesPerPixel;
+    const uint8_t *src = fb + srcY * stride + srcX * bytesPerPixel;
+    uint8_t *dst = fb + destY * stride + destX * bytesPerPixel;
+
+    // Walk rows away from the overlap; memmove handles overlap within a row
+    if (destY <= srcY) {
+        for (int row = 0; row < h; row++) {
+            memmove(dst + row * stride, src + row * stride, rowBytes);
+        }
+    } else {
+        for (int row = h - 1; row >= 0; row--) {
+            memmove(dst + row * stride, src + row * stride, rowBytes);
+        }
+    }
+}
+
+} // namespace fbops
@@ -0,0 +1,43 @@
+#ifndef FRAMEBUFFEROPS_H
+#define FRAMEBUFFEROPS_H
+
+#include <cstdint>
+
+// Decoded framebuffer as the VNC thread sees it
+struct FramebufferView
+{
+    uint8_t *pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    int stride = 0;
+    int bytesPerPixel = 0;
+};
+
+// Drawing primitives behind libvncclient's GotFillRect/GotBitmap/GotCopyRect hooks.
+// They work on a raw framebuffer (bytesPerPixel 1, 2 or 4, stride in bytes) and
+// expect rectangles already clipped to it.
+namespace fbops {
+
+void fillRect(uint8_t *fb, int stride, int bytesPerPixel, int x, int y, int w, int h, uint32_t colour);
+void putBitmap(uint8_t *fb, int stride, int bytesPerPixel, const uint8_t *src, int x, int y, int w, int h);
+
+// Overlapping source and destination are allowed
+void copyRect(uint8_t *fb, int stride, int bytesPerPixel, int srcX, int srcY, int w, int h, int destX, int destY);
+
+// Number of pixels in a row of w that differ between a and b by more than tolerance in any
+// channel. 32-bit pixels are xRGB (the padding byte is ignored), 16-bit pixels RGB565 with
+// the tolerance in 8-bit channel units, 8-bit pixels are compared as they are.
+int countDifferentPixels(const uint8_t *a, const uint8_t *b, int bytesPerPixel, int w, int tolerance);
+
+// 64-bit hash of rows x rowBytes bytes starting at pixels; never 0
+uint64_t hashRows(const uint8_t *pixels, int stride, int rowBytes, int rows);
+
+// True if the rectangle lies inside a width x height framebuffer
+inline bool rectInside(int width, int height, int x, int y, int w, int h)
+{
+    return x >= 0 && y >= 0 && w >= 0 && h >= 0 && x + w <= width && y + h <= height;
+}
+
+} // namespace fbops
+
+#endif // FRAMEBUFFEROPS_H
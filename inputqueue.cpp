@@ -0,0 +1,140 @@
+#include "inputqueue.h"
+#include "keymap.h"
+
+#include <QString>
+#include <QTimer>
+#include <QVector>
+#include <algorithm>
+
+extern "C" {
+#include "rfb/keysym.h"
+}
+
+// Events sent per timer tick at most, so huge batches don't starve the UI
+const int MAX_EVENTS_PER_DISPATCH = 256;
+
+std::vector<InputEvent> typingEvents(const QString &text, int charIntervalMs)
+{
+    std::vector<InputEvent> events;
+    auto key = [&events](uint32_t keysym, bool down, int delayMs) {
+        InputEvent event;
+        event.type = InputEvent::Key;
+        event.keysym = keysym;
+        event.down = down;
+        event.delayMs = delayMs;
+        events.push_back(event);
+    };
+
+    const QVector<uint> codepoints = text.toUcs4();
+    events.reserve(codepoints.size() * 2 + 2);
+    bool shifted = false;
+    for (int i = 0; i < codepoints.size(); i++) {
+        if (codepoints[i] == '\r' && i + 1 < codepoints.size() && codepoints[i + 1] == '\n') {
+            continue;
+        }
+        uint32_t keysym = unicodeToKeysym(codepoints[i]);
+        if (keysym == 0) {
+            continue;
+        }
+        // Runs of shifted characters share one Shift press
+        int delayMs = events.empty() ? 0 : charIntervalMs;
+        bool needsShift = keysymNeedsShift(keysym);
+        if (needsShift != shifted) {
+            key(XK_Shift_L, needsShift, delayMs);
+            shifted = needsShift;
+            delayMs = 0;
+        }
+        key(keysym, true, delayMs);
+        key(keysym, false, 0);
+    }
+    if (shifted) {
+        key(XK_Shift_L, false, 0);
+    }
+    return events;
+}
+
+InputQueue::InputQueue(Sender sender, QObject *parent)
+    : QObject(parent)
+    , m_sender(std::move(sender))
+{
+    m_timer = new QTimer(this);
+    m_timer->setSingleShot(true);
+    m_timer->setTimerType(Qt::PreciseTimer);
+    connect(m_timer, &QTimer::timeout, this, &InputQueue::dispatch);
+    m_clock.start();
+}
+
+void InputQueue::enqueue(const std::vector<InputEvent> &events, Completion done)
+{
+    if (events.empty()) {
+        if (done) {
+            done(0);
+        }
+        return;
+    }
+
+    // An idle queue counts the first delay from now
+    if (m_events.empty()) {
+        m_lastSentMs = m_clock.elapsed();
+    }
+
+    uint64_t id = m_nextBatch++;
+    for (const InputEvent &event : events) {
+        m_events.push_back({event, id});
+    }
+    m_batches.push_back({id, static_cast<int>(events.size()), 0, std::move(done)});
+    schedule();
+}
+
+void InputQueue::clear()
+{
+    m_events.clear();
+    m_timer->stop();
+
+    std::deque<Batch> batches;
+    batches.swap(m_batches);
+    for (Batch &batch : batches) {
+        if (batch.done) {
+            batch.done(batch.sent);
+        }
+    }
+}
+
+void InputQueue::schedule()
+{
+    if (m_events.empty()) {
+        return;
+    }
+    qint64 due = m_lastSentMs + m_events.front().event.delayMs;
+    qint64 wait = std::max<qint64>(0, due - m_clock.elapsed());
+    m_timer->start(static_cast<int>(wait));
+}
+
+void InputQueue::dispatch()
+{
+    int dispatched = 0;
+    while (!m_events.empty() && dispatched < MAX_EVENTS_PER_DISPATCH) {
+        qint64 now = m_clock.elapsed();
+        if (now < m_lastSentMs + m_events.front().event.delayMs) {
+            break;
+        }
+
+        Entry entry = m_events.front();
+        m_events.pop_front();
+        m_sender(entry.event);
+        m_lastSentMs = now;
+        dispatched++;
+
+        Batch &batch = m_batches.front();
+        batch.sent++;
+        if (--batch.remaining == 0) {
+            Completion done = std::move(batch.done);
+            int sent = batch.sent;
+            m_batches.pop_front();
+            if (done) {
+                done(sent);
+            }
+        }
+    }
+    schedule();
+}
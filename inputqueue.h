@@ -0,0 +1,77 @@
+#ifndef INPUTQUEUE_H
+#define INPUTQUEUE_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+class QString;
+class QTimer;
+
+// Key or pointer event sent after delayMs has passed since the previous event of the queue
+struct InputEvent
+{
+    enum Type { Key, Pointer };
+
+    Type type = Key;
+    uint32_t keysym = 0;
+    bool down = false;
+    int x = 0;
+    int y = 0;
+    int buttonMask = 0;
+    int delayMs = 0;
+};
+
+// Key presses typing text, one character every charIntervalMs (the events of a character go
+// out together). Shift is held around shifted US characters; "\r\n" is one Return.
+std::vector<InputEvent> typingEvents(const QString &text, int charIntervalMs);
+
+// Timed input injection on the UI thread. Events are sent through the sender callback in
+// order, honouring each event's delay, so scripted input never goes through Qt event dispatch.
+class InputQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    using Sender = std::function<void(const InputEvent &)>;
+    using Completion = std::function<void(int sent)>;
+
+    explicit InputQueue(Sender sender, QObject *parent = nullptr);
+
+    // Appends a batch; done runs once its last event was sent, or with the count sent so far on clear()
+    void enqueue(const std::vector<InputEvent> &events, Completion done = Completion());
+    void clear();
+    int pending() const { return static_cast<int>(m_events.size()); }
+
+private slots:
+    void dispatch();
+
+private:
+    struct Entry
+    {
+        InputEvent event;
+        uint64_t batch;
+    };
+    struct Batch
+    {
+        uint64_t id;
+        int remaining;
+        int sent;
+        Completion done;
+    };
+
+    void schedule();
+
+    Sender m_sender;
+    std::deque<Entry> m_events;
+    std::deque<Batch> m_batches;
+    uint64_t m_nextBatch = 1;
+    QTimer *m_timer = nullptr;
+    QElapsedTimer m_clock;
+    qint64 m_lastSentMs = 0;
+};
+
+#endif // INPUTQUEUE_H
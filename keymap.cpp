@@ -0,0 +1,179 @@
+#include "keymap.h"
+
+#include <QVector>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+extern "C" {
+#include "rfb/keysym.h"
+}
+
+namespace {
+
+struct UnicodeKeysym
+{
+    uint32_t codepoint;
+    uint32_t keysym;
+};
+
+// Legacy keysyms above Latin-1, sorted by code point. Each set is its ISO 8859 / KOI8-R /
+// TIS-620 charset with the set's keysym base added to the byte (Greek swaps the sigmas).
+const UnicodeKeysym LEGACY_KEYSYMS[] = {
+    {0x0100, 0x03c0}, {0x0101, 0x03e0}, {0x0102, 0x01c3}, {0x0103, 0x01e3}, {0x0104, 0x01a1}, {0x0105, 0x01b1},
+    {0x0106, 0x01c6}, {0x0107, 0x01e6}, {0x0108, 0x02c6}, {0x0109, 0x02e6}, {0x010a, 0x02c5}, {0x010b, 0x02e5},
+    {0x010c, 0x01c8}, {0x010d, 0x01e8}, {0x010e, 0x01cf}, {0x010f, 0x01ef}, {0x0110, 0x01d0}, {0x0111, 0x01f0},
+    {0x0112, 0x03aa}, {0x0113, 0x03ba}, {0x0116, 0x03cc}, {0x0117, 0x03ec}, {0x0118, 0x01ca}, {0x0119, 0x01ea},
+    {0x011a, 0x01cc}, {0x011b, 0x01ec}, {0x011c, 0x02d8}, {0x011d, 0x02f8}, {0x011e, 0x02ab}, {0x011f, 0x02bb},
+    {0x0120, 0x02d5}, {0x0121, 0x02f5}, {0x0122, 0x03ab}, {0x0123, 0x03bb}, {0x0124, 0x02a6}, {0x0125, 0x02b6},
+    {0x0126, 0x02a1}, {0x0127, 0x02b1}, {0x0128, 0x03a5}, {0x0129, 0x03b5}, {0x012a, 0x03cf}, {0x012b, 0x03ef},
+    {0x012e, 0x03c7}, {0x012f, 0x03e7}, {0x0130, 0x02a9}, {0x0131, 0x02b9}, {0x0134, 0x02ac}, {0x0135, 0x02bc},
+    {0x0136, 0x03d3}, {0x0137, 0x03f3}, {0x0138, 0x03a2}, {0x0139, 0x01c5}, {0x013a, 0x01e5}, {0x013b, 0x03a6},
+    {0x013c, 0x03b6}, {0x013d, 0x01a5}, {0x013e, 0x01b5}, {0x0141, 0x01a3}, {0x0142, 0x01b3}, {0x0143, 0x01d1},
+    {0x0144, 0x01f1}, {0x0145, 0x03d1}, {0x0146, 0x03f1}, {0x0147, 0x01d2}, {0x0148, 0x01f2}, {0x014a, 0x03bd},
+    {0x014b, 0x03bf}, {0x014c, 0x03d2}, {0x014d, 0x03f2}, {0x0150, 0x01d5}, {0x0151, 0x01f5}, {0x0152, 0x13bc},
+    {0x0153, 0x13bd}, {0x0154, 0x01c0}, {0x0155, 0x01e0}, {0x0156, 0x03a3}, {0x0157, 0x03b3}, {0x0158, 0x01d8},
+    {0x0159, 0x01f8}, {0x015a, 0x01a6}, {0x015b, 0x01b6}, {0x015c, 0x02de}, {0x015d, 0x02fe}, {0x015e, 0x01aa},
+    {0x015f, 0x01ba}, {0x0160, 0x01a9}, {0x0161, 0x01b9}, {0x0162, 0x01de}, {0x0163, 0x01fe}, {0x0164, 0x01ab},
+    {0x0165, 0x01bb}, {0x0166, 0x03ac}, {0x0167, 0x03bc}, {0x0168, 0x03dd}, {0x0169, 0x03fd}, {0x016a, 0x03de},
+    {0x016b, 0x03fe}, {0x016c, 0x02dd}, {0x016d, 0x02fd}, {0x016e, 0x01d9}, {0x016f, 0x01f9}, {0x0170, 0x01db},
+    {0x0171, 0x01fb}, {0x0172, 0x03d9}, {0x0173, 0x03f9}, {0x0178, 0x13be}, {0x0179, 0x01ac}, {0x017a, 0x01bc},
+    {0x017b, 0x01af}, {0x017c, 0x01bf}, {0x017d, 0x01ae}, {0x017e, 0x01be}, {0x02c7, 0x01b7}, {0x02d8, 0x01a2},
+    {0x02d9, 0x01ff}, {0x02db, 0x01b2}, {0x02dd, 0x01bd}, {0x0391, 0x07c1}, {0x0392, 0x07c2}, {0x0393, 0x07c3},
+    {0x0394, 0x07c4}, {0x0395, 0x07c5}, {0x0396, 0x07c6}, {0x0397, 0x07c7}, {0x0398, 0x07c8}, {0x0399, 0x07c9},
+    {0x039a, 0x07ca}, {0x039b, 0x07cb}, {0x039c, 0x07cc}, {0x039d, 0x07cd}, {0x039e, 0x07ce}, {0x039f, 0x07cf},
+    {0x03a0, 0x07d0}, {0x03a1, 0x07d1}, {0x03a3, 0x07d2}, {0x03a4, 0x07d4}, {0x03a5, 0x07d5}, {0x03a6, 0x07d6},
+    {0x03a7, 0x07d7}, {0x03a8, 0x07d8}, {0x03a9, 0x07d9}, {0x03b1, 0x07e1}, {0x03b2, 0x07e2}, {0x03b3, 0x07e3},
+    {0x03b4, 0x07e4}, {0x03b5, 0x07e5}, {0x03b6, 0x07e6}, {0x03b7, 0x07e7}, {0x03b8, 0x07e8}, {0x03b9, 0x07e9},
+    {0x03ba, 0x07ea}, {0x03bb, 0x07eb}, {0x03bc, 0x07ec}, {0x03bd, 0x07ed}, {0x03be, 0x07ee}, {0x03bf, 0x07ef},
+    {0x03c0, 0x07f0}, {0x03c1, 0x07f1}, {0x03c2, 0x07f3}, {0x03c3, 0x07f2}, {0x03c4, 0x07f4}, {0x03c5, 0x07f5},
+    {0x03c6, 0x07f6}, {0x03c7, 0x07f7}, {0x03c8, 0x07f8}, {0x03c9, 0x07f9}, {0x0401, 0x06b3}, {0x0410, 0x06e1},
+    {0x0411, 0x06e2}, {0x0412, 0x06f7}, {0x0413, 0x06e7}, {0x0414, 0x06e4}, {0x0415, 0x06e5}, {0x0416, 0x06f6},
+    {0x0417, 0x06fa}, {0x0418, 0x06e9}, {0x0419, 0x06ea}, {0x041a, 0x06eb}, {0x041b, 0x06ec}, {0x041c, 0x06ed},
+    {0x041d, 0x06ee}, {0x041e, 0x06ef}, {0x041f, 0x06f0}, {0x0420, 0x06f2}, {0x0421, 0x06f3}, {0x0422, 0x06f4},
+    {0x0423, 0x06f5}, {0x0424, 0x06e6}, {0x0425, 0x06e8}, {0x0426, 0x06e3}, {0x0427, 0x06fe}, {0x0428, 0x06fb},
+    {0x0429, 0x06fd}, {0x042a, 0x06ff}, {0x042b, 0x06f9}, {0x042c, 0x06f8}, {0x042d, 0x06fc}, {0x042e, 0x06e0},
+    {0x042f, 0x06f1}, {0x0430, 0x06c1}, {0x0431, 0x06c2}, {0x0432, 0x06d7}, {0x0433, 0x06c7}, {0x0434, 0x06c4},
+    {0x0435, 0x06c5}, {0x0436, 0x06d6}, {0x0437, 0x06da}, {0x0438, 0x06c9}, {0x0439, 0x06ca}, {0x043a, 0x06cb},
+    {0x043b, 0x06cc}, {0x043c, 0x06cd}, {0x043d, 0x06ce}, {0x043e, 0x06cf}, {0x043f, 0x06d0}, {0x0440, 0x06d2},
+    {0x0441, 0x06d3}, {0x0442, 0x06d4}, {0x0443, 0x06d5}, {0x0444, 0x06c6}, {0x0445, 0x06c8}, {0x0446, 0x06c3},
+    {0x0447, 0x06de}, {0x0448, 0x06db}, {0x0449, 0x06dd}, {0x044a, 0x06df}, {0x044b, 0x06d9}, {0x044c, 0x06d8},
+    {0x044d, 0x06dc}, {0x044e, 0x06c0}, {0x044f, 0x06d1}, {0x0451, 0x06a3}, {0x05d0, 0x0ce0}, {0x05d1, 0x0ce1},
+    {0x05d2, 0x0ce2}, {0x05d3, 0x0ce3}, {0x05d4, 0x0ce4}, {0x05d5, 0x0ce5}, {0x05d6, 0x0ce6}, {0x05d7, 0x0ce7},
+    {0x05d8, 0x0ce8}, {0x05d9, 0x0ce9}, {0x05da, 0x0cea}, {0x05db, 0x0ceb}, {0x05dc, 0x0cec}, {0x05dd, 0x0ced},
+    {0x05de, 0x0cee}, {0x05df, 0x0cef}, {0x05e0, 0x0cf0}, {0x05e1, 0x0cf1}, {0x05e2, 0x0cf2}, {0x05e3, 0x0cf3},
+    {0x05e4, 0x0cf4}, {0x05e5, 0x0cf5}, {0x05e6, 0x0cf6}, {0x05e7, 0x0cf7}, {0x05e8, 0x0cf8}, {0x05e9, 0x0cf9},
+    {0x05ea, 0x0cfa}, {0x060c, 0x05ac}, {0x061b, 0x05bb}, {0x061f, 0x05bf}, {0x0621, 0x05c1}, {0x0622, 0x05c2},
+    {0x0623, 0x05c3}, {0x0624, 0x05c4}, {0x0625, 0x05c5}, {0x0626, 0x05c6}, {0x0627, 0x05c7}, {0x0628, 0x05c8},
+    {0x0629, 0x05c9}, {0x062a, 0x05ca}, {0x062b, 0x05cb}, {0x062c, 0x05cc}, {0x062d, 0x05cd}, {0x062e, 0x05ce},
+    {0x062f, 0x05cf}, {0x0630, 0x05d0}, {0x0631, 0x05d1}, {0x0632, 0x05d2}, {0x0633, 0x05d3}, {0x0634, 0x05d4},
+    {0x0635, 0x05d5}, {0x0636, 0x05d6}, {0x0637, 0x05d7}, {0x0638, 0x05d8}, {0x0639, 0x05d9}, {0x063a, 0x05da},
+    {0x0640, 0x05e0}, {0x0641, 0x05e1}, {0x0642, 0x05e2}, {0x0643, 0x05e3}, {0x0644, 0x05e4}, {0x0645, 0x05e5},
+    {0x0646, 0x05e6}, {0x0647, 0x05e7}, {0x0648, 0x05e8}, {0x0649, 0x05e9}, {0x064a, 0x05ea}, {0x064b, 0x05eb},
+    {0x064c, 0x05ec}, {0x064d, 0x05ed}, {0x064e, 0x05ee}, {0x064f, 0x05ef}, {0x0650, 0x05f0}, {0x0651, 0x05f1},
+    {0x0652, 0x05f2}, {0x0e01, 0x0da1}, {0x0e02, 0x0da2}, {0x0e03, 0x0da3}, {0x0e04, 0x0da4}, {0x0e05, 0x0da5},
+    {0x0e06, 0x0da6}, {0x0e07, 0x0da7}, {0x0e08, 0x0da8}, {0x0e09, 0x0da9}, {0x0e0a, 0x0daa}, {0x0e0b, 0x0dab},
+    {0x0e0c, 0x0dac}, {0x0e0d, 0x0dad}, {0x0e0e, 0x0dae}, {0x0e0f, 0x0daf}, {0x0e10, 0x0db0}, {0x0e11, 0x0db1},
+    {0x0e12, 0x0db2}, {0x0e13, 0x0db3}, {0x0e14, 0x0db4}, {0x0e15, 0x0db5}, {0x0e16, 0x0db6}, {0x0e17, 0x0db7},
+    {0x0e18, 0x0db8}, {0x0e19, 0x0db9}, {0x0e1a, 0x0dba}, {0x0e1b, 0x0dbb}, {0x0e1c, 0x0dbc}, {0x0e1d, 0x0dbd},
+    {0x0e1e, 0x0dbe}, {0x0e1f, 0x0dbf}, {0x0e20, 0x0dc0}, {0x0e21, 0x0dc1}, {0x0e22, 0x0dc2}, {0x0e23, 0x0dc3},
+    {0x0e24, 0x0dc4}, {0x0e25, 0x0dc5}, {0x0e26, 0x0dc6}, {0x0e27, 0x0dc7}, {0x0e28, 0x0dc8}, {0x0e29, 0x0dc9},
+    {0x0e2a, 0x0dca}, {0x0e2b, 0x0dcb}, {0x0e2c, 0x0dcc}, {0x0e2d, 0x0dcd}, {0x0e2e, 0x0dce}, {0x0e2f, 0x0dcf},
+    {0x0e30, 0x0dd0}, {0x0e31, 0x0dd1}, {0x0e32, 0x0dd2}, {0x0e33, 0x0dd3}, {0x0e34, 0x0dd4}, {0x0e35, 0x0dd5},
+    {0x0e36, 0x0dd6}, {0x0e37, 0x0dd7}, {0x0e38, 0x0dd8}, {0x0e39, 0x0dd9}, {0x0e3a, 0x0dda}, {0x0e3f, 0x0ddf},
+    {0x0e40, 0x0de0}, {0x0e41, 0x0de1}, {0x0e42, 0x0de2}, {0x0e43, 0x0de3}, {0x0e44, 0x0de4}, {0x0e45, 0x0de5},
+    {0x0e46, 0x0de6}, {0x0e47, 0x0de7}, {0x0e48, 0x0de8}, {0x0e49, 0x0de9}, {0x0e4a, 0x0dea}, {0x0e4b, 0x0deb},
+    {0x0e4c, 0x0dec}, {0x0e4d, 0x0ded}, {0x0e4e, 0x0dee}, {0x0e4f, 0x0def}, {0x0e50, 0x0df0}, {0x0e51, 0x0df1},
+    {0x0e52, 0x0df2}, {0x0e53, 0x0df3}, {0x0e54, 0x0df4}, {0x0e55, 0x0df5}, {0x0e56, 0x0df6}, {0x0e57, 0x0df7},
+    {0x0e58, 0x0df8}, {0x0e59, 0x0df9}, {0x20ac, 0x20ac},
+};
+
+// Characters typed with Shift on a US keyboard, besides A-Z
+const char US_SHIFTED[] = "~!@#$%^&*()_+{}|:\"<>?";
+
+// Unicode keysyms are the code point with this bit set
+const uint32_t UNICODE_KEYSYM = 0x01000000;
+
+} // namespace
+
+uint32_t qtKeyToX11Keysym(int qtKey, Qt::KeyboardModifiers modifiers, const QString& text)
+{
+    // Handle printable characters from text when available
+    if (!text.isEmpty() && text[0].isPrint()) {
+        QVector<uint> codepoints = text.toUcs4();
+        return codepoints.isEmpty() ? text[0].unicode() : unicodeToKeysym(codepoints[0]);
+    }
+    
+    // Map Qt special keys to X11 keysyms
+    switch (qtKey) {
+        case Qt::Key_Backspace: return XK_BackSpace;
+        case Qt::Key_Tab: return XK_Tab;
+        case Qt::Key_Return:
+        case Qt::Key_Enter: return XK_Return;
+        case Qt::Key_Escape: return XK_Escape;
+        case Qt::Key_Delete: return XK_Delete;
+        case Qt::Key_Home: return XK_Home;
+        case Qt::Key_End: return XK_End;
+        case Qt::Key_PageUp: return XK_Page_Up;
+        case Qt::Key_PageDown: return XK_Page_Down;
+        case Qt::Key_Left: return XK_Left;
+        case Qt::Key_Up: return XK_Up;
+        case Qt::Key_Right: return XK_Right;
+        case Qt::Key_Down: return XK_Down;
+        case Qt::Key_Insert: return XK_Insert;
+        case Qt::Key_Shift: return XK_Shift_L;
+        case Qt::Key_Control: return XK_Control_L;
+        case Qt::Key_Alt: return XK_Alt_L;
+        case Qt::Key_Meta: return XK_Super_L;
+        case Qt::Key_AltGr: return XK_ISO_Level3_Shift;
+        case Qt::Key_CapsLock: return XK_Caps_Lock;
+        case Qt::Key_NumLock: return XK_Num_Lock;
+        case Qt::Key_ScrollLock: return XK_Scroll_Lock;
+        case Qt::Key_F1: return XK_F1;
+        case Qt::Key_F2: return XK_F2;
+        case Qt::Key_F3: return XK_F3;
+        case Qt::Key_F4: return XK_F4;
+        case Qt::Key_F5: return XK_F5;
+        case Qt::Key_F6: return XK_F6;
+        case Qt::Key_F7: return XK_F7;
+        case Qt::Key_F8: return XK_F8;
+        case Qt::Key_F9: return XK_F9;
+        case Qt::Key_F10: return XK_F10;
+        case Qt::Key_F11: return XK_F11;
+        case Qt::Key_F12: return XK_F12;
+        default:
+            // For unhandled keys, try to return the Qt key value directly
+            return qtKey;
+    }
+}
+
+uint32_t unicodeToKeysym(uint32_t codepoint)
+{
+    switch (codepoint) {
+        case '\n':
+        case '\r': return XK_Return;
+        case '\t': return XK_Tab;
+        case '\b': return XK_BackSpace;
+        case 0x1b: return XK_Escape;
+    }
+    if (codepoint < 0x20 || (codepoint >= 0x7f && codepoint < 0xa0) || codepoint > 0x10ffff) {
+        return 0;
+    }
+    if (codepoint <= 0xff) {
+        return codepoint;
+    }
+    auto it = std::lower_bound(std::begin(LEGACY_KEYSYMS), std::end(LEGACY_KEYSYMS), codepoint,
+                               [](const UnicodeKeysym &entry, uint32_t value) { return entry.codepoint < value; });
+    if (it != std::end(LEGACY_KEYSYMS) && it->codepoint == codepoint) {
+        return it->keysym;
+    }
+    return UNICODE_KEYSYM | codepoint;
+}
+
+bool keysymNeedsShift(uint32_t keysym)
+{
+    if (keysym >= 'A' && keysym <= 'Z') {
+        return true;
+    }
+    return keysym > 0 && keysym < 0x7f && strchr(US_SHIFTED, static_cast<int>(keysym)) != nullptr;
+}
@@ -0,0 +1,20 @@
+#ifndef KEYMAP_H
+#define KEYMAP_H
+
+#include <QString>
+#include <Qt>
+#include <cstdint>
+
+// Translate a Qt key event into the X11 keysym sent in RFB KeyEvent messages
+uint32_t qtKeyToX11Keysym(int qtKey, Qt::KeyboardModifiers modifiers, const QString& text);
+
+// Keysym typing a Unicode character: Latin-1 and the legacy keysym sets (Latin-2/3/4/9,
+// Cyrillic, Greek, Arabic, Hebrew, Thai) as they are, anything else as a Unicode keysym.
+// Newline, tab, backspace and escape give their keys; other control characters 0.
+uint32_t unicodeToKeysym(uint32_t codepoint);
+
+// True for keysyms typed with Shift on a US keyboard; servers that map keysyms to
+// scancodes (KVMs, BIOS consoles) need the Shift press spelled out
+bool keysymNeedsShift(uint32_t keysym);
+
+#endif // KEYMAP_H
@@ -0,0 +1,121 @@
+#include "latencyprobe.h"
+
+#include <algorithm>
+
+// A probe without a matching update by then is counted as a timeout
+const std::chrono::milliseconds PROBE_TIMEOUT(2000);
+// Samples kept for the percentiles
+const size_t MAX_SAMPLES = 10000;
+
+void LatencyProbe::setActive(bool active)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (active) {
+        m_samples.clear();
+        m_nextSample = 0;
+        m_timeouts = 0;
+    }
+    m_pending = false;
+    m_hit = false;
+    m_active.store(active, std::memory_order_relaxed);
+}
+
+void LatencyProbe::inputSent(const QRect &probeRegion)
+{
+    if (!isActive()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Clock::time_point now = Clock::now();
+    if (m_pending) {
+        if (now - m_sent < PROBE_TIMEOUT) {
+            return;
+        }
+        m_timeouts++;
+    }
+    m_pending = true;
+    m_hit = false;
+    m_region = probeRegion;
+    m_sent = now;
+}
+
+void LatencyProbe::rectUpdated(const QRect &rect)
+{
+    if (!isActive()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_pending && (m_region.isEmpty() || m_region.intersects(rect))) {
+        m_hit = true;
+    }
+}
+
+void LatencyProbe::updateFinished()
+{
+    if (!isActive()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_pending) {
+        return;
+    }
+    Clock::duration elapsed = Clock::now() - m_sent;
+    if (m_hit) {
+        addSample(std::chrono::duration<double, std::milli>(elapsed).count());
+        m_pending = false;
+    } else if (elapsed >= PROBE_TIMEOUT) {
+        m_timeouts++;
+        m_pending = false;
+    }
+}
+
+void LatencyProbe::addSample(double milliseconds)
+{
+    if (m_samples.size() < MAX_SAMPLES) {
+        m_samples.push_back(milliseconds);
+    } else {
+        m_samples[m_nextSample] = milliseconds;
+        m_nextSample = (m_nextSample + 1) % MAX_SAMPLES;
+    }
+}
+
+LatencyProbe::Summary LatencyProbe::summary() const
+{
+    std::vector<double> sorted;
+    Summary result;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        sorted = m_samples;
+        result.timeouts = m_timeouts;
+    }
+    if (sorted.empty()) {
+        return result;
+    }
+
+    // Nearest-rank percentiles
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&sorted](double p) {
+        size_t rank = static_cast<size_t>(p * sorted.size() + 0.999999);
+        return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+    };
+    result.samples = static_cast<int>(sorted.size());
+    result.p50 = percentile(0.50);
+    result.p90 = percentile(0.90);
+    result.p99 = percentile(0.99);
+    result.max = sorted.back();
+    return result;
+}
+
+QString LatencyProbe::summaryText() const
+{
+    Summary s = summary();
+    if (s.samples == 0) {
+        return QString("no samples, %1 timeouts").arg(s.timeouts);
+    }
+    return QString("p50 %1 ms, p90 %2 ms, p99 %3 ms, max %4 ms (%5 samples, %6 timeouts)")
+        .arg(s.p50, 0, 'f', 1).arg(s.p90, 0, 'f', 1).arg(s.p99, 0, 'f', 1).arg(s.max, 0, 'f', 1)
+        .arg(s.samples).arg(s.timeouts);
+}
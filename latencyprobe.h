@@ -0,0 +1,56 @@
+#ifndef LATENCYPROBE_H
+#define LATENCYPROBE_H
+
+#include <QRect>
+#include <QString>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+// Input-to-display latency measurement. One input event at a time is timestamped as it is
+// sent; the probe completes at the end of the first framebuffer update that changed its probe
+// region (around the pointer for pointer events, anywhere for key presses).
+class LatencyProbe
+{
+public:
+    struct Summary
+    {
+        int samples = 0;
+        int timeouts = 0;
+        double p50 = 0.0;   // Milliseconds
+        double p90 = 0.0;
+        double p99 = 0.0;
+        double max = 0.0;
+    };
+
+    bool isActive() const { return m_active.load(std::memory_order_relaxed); }
+    // Starting clears the samples of the previous run
+    void setActive(bool active);
+
+    // UI thread, as an event leaves; an empty region matches any change
+    void inputSent(const QRect &probeRegion);
+    // VNC thread, per decoded rectangle and per completed update
+    void rectUpdated(const QRect &rect);
+    void updateFinished();
+
+    Summary summary() const;
+    QString summaryText() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void addSample(double milliseconds);
+
+    std::atomic<bool> m_active{false};
+    mutable std::mutex m_mutex;
+    bool m_pending = false;
+    bool m_hit = false;
+    QRect m_region;
+    Clock::time_point m_sent;
+    std::vector<double> m_samples;   // Ring of the most recent samples
+    size_t m_nextSample = 0;
+    int m_timeouts = 0;
+};
+
+#endif // LATENCYPROBE_H
@@ -0,0 +1,253 @@
+#include "linkprofile.h"
+
+#include <QSettings>
+#include <QStringList>
+#include <algorithm>
+
+namespace {
+
+// A session shorter than this says little about the link
+const int64_t MIN_SESSION_NANOS = 10LL * 1000 * 1000 * 1000;
+// Weight of the newest session in the averages
+const double NEW_SESSION_WEIGHT = 0.5;
+
+// A second only says something about the link if it moved at least this much, was not
+// paced and left the decoder idle part of the time
+const uint64_t MIN_CAPACITY_SECOND_BYTES = 64 * 1024;
+const double DECODE_BOUND_BUSY = 0.8;
+// A round trip this far above the lowest one means data queued in front of the link
+const double QUEUEING_RTT_FACTOR = 2.0;
+const double QUEUEING_RTT_MIN_MS = 5.0;
+// Per-pixel costs need enough pixels to be more than noise
+const uint64_t MIN_COST_SECOND_PIXELS = 100 * 1000;
+const uint64_t MIN_COST_SESSION_PIXELS = 1000 * 1000;
+
+// Capacity assumed until a session measured one
+const double LAN_MAX_RTT_MS = 2.0;
+const double ASSUMED_LAN_KBPS = 100 * 1024;
+const double ASSUMED_WAN_KBPS = 1024;
+// Compression and JPEG quality for links below these rates
+const double SLOW_LINK_KBPS = 256;
+const double MEDIUM_LINK_KBPS = 2 * 1024;
+
+// Encoding lists the learned profile chooses from, by preferred encoding, with the cost
+// assumed until a session used them: hextile is cheap to decode, tight the most compact
+struct CandidateEncoding
+{
+    const char *name;
+    const char *encodings;
+    double bytesPerPixel;
+    double decodeNsPerPixel;
+};
+
+const CandidateEncoding CANDIDATE_ENCODINGS[] = {
+    {"hextile", "copyrect hextile raw", 1.0, 3.0},
+    {"zrle", "copyrect zrle zlib hextile raw", 0.25, 12.0},
+    {"tight", "copyrect tight zrle zlib hextile raw", 0.12, 15.0},
+};
+
+const CandidateEncoding *candidate(const QString &name)
+{
+    for (const CandidateEncoding &encoding : CANDIDATE_ENCODINGS) {
+        if (name == QLatin1String(encoding.name)) {
+            return &encoding;
+        }
+    }
+    return nullptr;
+}
+
+double average(double history, double sample)
+{
+    if (sample < 0) {
+        return history;
+    }
+    return history < 0 ? sample : NEW_SESSION_WEIGHT * sample + (1 - NEW_SESSION_WEIGHT) * history;
+}
+
+}
+
+LinkProfile LinkProfile::load(QSettings &settings, const QString &serverKey)
+{
+    LinkProfile link;
+    link.rttMs = settings.value(serverKey + "/link/rttMs", -1.0).toDouble();
+    link.capacityKBps = settings.value(serverKey + "/link/capacityKBps", -1.0).toDouble();
+    link.capacityMeasured = settings.value(serverKey + "/link/capacityMeasured", false).toBool();
+    link.sessions = settings.value(serverKey + "/link/sessions", 0).toInt();
+    for (const CandidateEncoding &encoding : CANDIDATE_ENCODINGS) {
+        QString prefix = serverKey + "/link/" + encoding.name;
+        if (!settings.contains(prefix + "/sessions")) {
+            continue;
+        }
+        EncodingCost &cost = link.encodings[encoding.name];
+        cost.bytesPerPixel = settings.value(prefix + "/bytesPerPixel", -1.0).toDouble();
+        cost.decodeNsPerPixel = settings.value(prefix + "/decodeNsPerPixel", -1.0).toDouble();
+        cost.sessions = settings.value(prefix + "/sessions", 0).toInt();
+    }
+    return link;
+}
+
+void LinkProfile::save(QSettings &settings, const QString &serverKey) const
+{
+    settings.setValue(serverKey + "/link/rttMs", rttMs);
+    settings.setValue(serverKey + "/link/capacityKBps", capacityKBps);
+    settings.setValue(serverKey + "/link/capacityMeasured", capacityMeasured);
+    settings.setValue(serverKey + "/link/sessions", sessions);
+    for (const auto &entry : encodings) {
+        QString prefix = serverKey + "/link/" + entry.first;
+        settings.setValue(prefix + "/bytesPerPixel", entry.second.bytesPerPixel);
+        settings.setValue(prefix + "/decodeNsPerPixel", entry.second.decodeNsPerPixel);
+        settings.setValue(prefix + "/sessions", entry.second.sessions);
+    }
+}
+
+void LinkProfile::learn(const LinkSession &session)
+{
+    if (!session.isValid()) {
+        return;
+    }
+    rttMs = average(rttMs, session.rttMs);
+
+    // Seconds that were not held back are a lower bound on the capacity; only a full link
+    // measures it, so only that may lower what earlier sessions saw
+    if (session.saturatedKBps >= 0) {
+        capacityKBps = std::max(session.unrestrictedKBps,
+                                capacityMeasured ? average(capacityKBps, session.saturatedKBps) : session.saturatedKBps);
+        capacityMeasured = true;
+    } else if (session.unrestrictedKBps >= 0) {
+        capacityKBps = std::max(capacityKBps, session.unrestrictedKBps);
+    }
+
+    if (candidate(session.encoding) && (session.cost.bytesPerPixel >= 0 || session.cost.decodeNsPerPixel >= 0)) {
+        EncodingCost &cost = encodings[session.encoding];
+        cost.bytesPerPixel = average(cost.bytesPerPixel, session.cost.bytesPerPixel);
+        cost.decodeNsPerPixel = average(cost.decodeNsPerPixel, session.cost.decodeNsPerPixel);
+        cost.sessions++;
+    }
+    sessions++;
+}
+
+SessionProfile LinkProfile::recommend() const
+{
+    SessionProfile profile;
+    if (!isKnown()) {
+        return profile;
+    }
+
+    // Until a session filled the link, what it carried only bounds the capacity from below
+    double capacity = rttMs <= LAN_MAX_RTT_MS ? ASSUMED_LAN_KBPS : ASSUMED_WAN_KBPS;
+    if (capacityMeasured) {
+        capacity = capacityKBps;
+    } else if (capacityKBps > capacity) {
+        capacity = capacityKBps;
+    }
+    // The socket reader overlaps receiving with decoding, so a pixel takes whichever is slower
+    double bytesPerNs = capacity * 1024 / 1e9;
+    const CandidateEncoding *best = nullptr;
+    double bestNs = 0;
+    for (const CandidateEncoding &encoding : CANDIDATE_ENCODINGS) {
+        double bytesPerPixel = encoding.bytesPerPixel;
+        double decodeNs = encoding.decodeNsPerPixel;
+        auto measured = encodings.find(encoding.name);
+        if (measured != encodings.end()) {
+            bytesPerPixel = measured->second.bytesPerPixel >= 0 ? measured->second.bytesPerPixel : bytesPerPixel;
+            decodeNs = measured->second.decodeNsPerPixel >= 0 ? measured->second.decodeNsPerPixel : decodeNs;
+        }
+        double ns = std::max(bytesPerPixel / bytesPerNs, decodeNs);
+        if (!best || ns < bestNs) {
+            best = &encoding;
+            bestNs = ns;
+        }
+    }
+
+    profile.name = "learned";
+    profile.encodings = QString::fromLatin1(best->encodings);
+    if (QLatin1String(best->name) == QLatin1String("hextile")) {
+        // Nothing to compress: full quality
+        profile.compressLevel = 0;
+        profile.qualityLevel = 9;
+    } else if (capacity < SLOW_LINK_KBPS) {
+        profile.compressLevel = 9;
+        profile.qualityLevel = 4;
+    } else if (capacity < MEDIUM_LINK_KBPS) {
+        profile.compressLevel = 6;
+        profile.qualityLevel = 6;
+    } else {
+        profile.compressLevel = 3;
+        profile.qualityLevel = 8;
+    }
+    return profile;
+}
+
+QString LinkProfile::preferredEncoding(const QString &encodings)
+{
+    const QStringList names = encodings.toLower().split(' ');
+    for (const QString &name : names) {
+        if (!name.isEmpty() && name != QLatin1String("copyrect")) {
+            return name;
+        }
+    }
+    return QString();
+}
+
+void LinkSampler::reset(const QString &encoding)
+{
+    *this = LinkSampler();
+    m_encoding = encoding;
+}
+
+void LinkSampler::sample(uint64_t bytesIn, uint64_t decodeNanos, uint64_t pacedNanos, uint64_t pixels,
+                         uint64_t rttUs, int64_t nowNs)
+{
+    double rtt = rttUs / 1000.0;
+    if (rttUs > 0) {
+        m_minRttMs = m_minRttMs < 0 ? rtt : std::min(m_minRttMs, rtt);
+    }
+    if (m_startNs < 0) {
+        m_startNs = nowNs;
+    } else if (nowNs > m_lastNs && bytesIn >= m_lastBytes && pixels >= m_lastPixels) {
+        double seconds = (nowNs - m_lastNs) / 1e9;
+        uint64_t bytes = bytesIn - m_lastBytes;
+        uint64_t secondPixels = pixels - m_lastPixels;
+        double busy = (decodeNanos - m_lastDecodeNanos) / 1e9 / seconds;
+        bool paced = pacedNanos > m_lastPacedNanos;
+
+        // Only seconds where the link, not this client, set the pace say what it carries
+        if (bytes >= MIN_CAPACITY_SECOND_BYTES && !paced && busy < DECODE_BOUND_BUSY) {
+            double rate = bytes / 1024.0 / seconds;
+            m_unrestrictedKBps = std::max(m_unrestrictedKBps, rate);
+            if (rttUs > 0 && rtt >= std::max(m_minRttMs * QUEUEING_RTT_FACTOR, m_minRttMs + QUEUEING_RTT_MIN_MS)) {
+                m_saturatedKBps = std::max(m_saturatedKBps, rate);
+            }
+        }
+        // Decoding time includes waits for data in the middle of a message; the least
+        // stalled second is the closest to the decoder's own cost
+        if (secondPixels >= MIN_COST_SECOND_PIXELS) {
+            double nsPerPixel = static_cast<double>(decodeNanos - m_lastDecodeNanos) / secondPixels;
+            m_decodeNsPerPixel = m_decodeNsPerPixel < 0 ? nsPerPixel : std::min(m_decodeNsPerPixel, nsPerPixel);
+        }
+        m_totalBytes += bytes;
+        m_totalPixels += secondPixels;
+    }
+    m_lastNs = nowNs;
+    m_lastBytes = bytesIn;
+    m_lastDecodeNanos = decodeNanos;
+    m_lastPacedNanos = pacedNanos;
+    m_lastPixels = pixels;
+}
+
+LinkSession LinkSampler::result() const
+{
+    LinkSession session;
+    if (m_startNs < 0 || m_lastNs - m_startNs < MIN_SESSION_NANOS) {
+        return session;
+    }
+    session.rttMs = m_minRttMs;
+    session.unrestrictedKBps = m_unrestrictedKBps;
+    session.saturatedKBps = m_saturatedKBps;
+    session.encoding = m_encoding;
+    if (m_totalPixels >= MIN_COST_SESSION_PIXELS) {
+        session.cost.bytesPerPixel = static_cast<double>(m_totalBytes) / m_totalPixels;
+        session.cost.decodeNsPerPixel = m_decodeNsPerPixel;
+    }
+    return session;
+}
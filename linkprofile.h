@@ -0,0 +1,87 @@
+#ifndef LINKPROFILE_H
+#define LINKPROFILE_H
+
+#include <QString>
+#include <cstdint>
+#include <map>
+
+#include "sessionprofile.h"
+
+class QSettings;
+
+// What sessions with an encoding cost per updated pixel. Values below zero are unknown.
+struct EncodingCost
+{
+    double bytesPerPixel = -1;      // Bytes received per decoded pixel
+    double decodeNsPerPixel = -1;   // VNC thread time per decoded pixel, in the least stalled second
+    int sessions = 0;
+};
+
+// One session's measurements, from LinkSampler::result(). Values below zero are unknown.
+struct LinkSession
+{
+    double rttMs = -1;              // Lowest smoothed TCP round trip
+    double unrestrictedKBps = -1;   // Highest rate of a second neither paced nor decoding-bound
+    double saturatedKBps = -1;      // Same, in seconds whose round trip showed a queue: the link was full
+    QString encoding;               // Preferred encoding of the session
+    EncodingCost cost;
+
+    bool isValid() const { return rttMs >= 0; }
+};
+
+// What earlier sessions measured on the link to a server, kept under <server>/link/.
+// Values below zero are unknown.
+struct LinkProfile
+{
+    double rttMs = -1;           // Lowest smoothed TCP round trip of a session
+    double capacityKBps = -1;    // Receive rate the link carries, whatever the encoding
+    bool capacityMeasured = false;   // A session filled the link; otherwise capacityKBps is a lower bound
+    int sessions = 0;
+    std::map<QString, EncodingCost> encodings;   // By preferred encoding: hextile, zrle or tight
+
+    bool isKnown() const { return sessions > 0 && rttMs >= 0; }
+
+    static LinkProfile load(QSettings &settings, const QString &serverKey);
+    void save(QSettings &settings, const QString &serverKey) const;
+
+    // Folds one session's measurements into the history; newer sessions weigh more
+    void learn(const LinkSession &session);
+
+    // The encoding list that updates the screen fastest on this link, with compression and
+    // quality for the link's capacity, named "learned"; other fields unset. Empty (all unset)
+    // while the link is unknown.
+    SessionProfile recommend() const;
+
+    // First encoding of an encodings string other than copyrect
+    static QString preferredEncoding(const QString &encodings);
+};
+
+// Measurements of the running session, fed about once a second from the UI thread
+class LinkSampler
+{
+public:
+    void reset(const QString &encoding = QString());
+    // Cumulative counters of the session; rttUs 0 if not known yet
+    void sample(uint64_t bytesIn, uint64_t decodeNanos, uint64_t pacedNanos, uint64_t pixels,
+                uint64_t rttUs, int64_t nowNs);
+
+    // This session's measurements; invalid if it was too short to tell
+    LinkSession result() const;
+
+private:
+    QString m_encoding;
+    int64_t m_startNs = -1;
+    int64_t m_lastNs = 0;
+    uint64_t m_lastBytes = 0;
+    uint64_t m_lastDecodeNanos = 0;
+    uint64_t m_lastPacedNanos = 0;
+    uint64_t m_lastPixels = 0;
+    uint64_t m_totalBytes = 0;
+    uint64_t m_totalPixels = 0;
+    double m_minRttMs = -1;
+    double m_unrestrictedKBps = -1;
+    double m_saturatedKBps = -1;
+    double m_decodeNsPerPixel = -1;
+};
+
+#endif // LINKPROFILE_H
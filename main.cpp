@@ -1,25 +1,153 @@
 #include "mainwindow.h"
+#include "monitorlayout.h"
+#include "sessionprofile.h"
+#include "trace.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
 #include <iostream>
 
-int main(int argc, char *argv[])
+// Reads a numeric option into value; prints an error and returns false for anything but a
+// number, which toInt() alone would turn into a 0 that may pass the range checks
+static bool intOption(const QCommandLineParser &parser, const QCommandLineOption &option, int &value)
 {
-    if (argc < 3) {
-        std::cout << "Usage: " << argv[0] << " <server_ip> <port> [password]" << std::endl;
-        std::cout << "Example: " << argv[0] << " 192.168.1.100 5900 mypassword" << std::endl;
-        return 1;
+    bool ok = false;
+    value = parser.value(option).toInt(&ok);
+    if (!ok) {
+        std::cerr << "[ERROR] Invalid option: --" << option.names().first().toStdString() << " must be a number, not \""
+                  << parser.value(option).toStdString() << "\"" << std::endl;
     }
+    return ok;
+}
 
+int main(int argc, char *argv[])
+{
+    // Opt-in span tracing (WVNCC_TRACE_FILE)
+    trace::configureFromEnvironment();
+    trace::setThreadName("GUI");
+    
     QApplication a(argc, argv);
+    
+    QCommandLineParser parser;
+    parser.setApplicationDescription("VNC client. Profile and overrides are remembered per server.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("server_ip", "VNC server address.");
+    parser.addPositionalArgument("port", "VNC server port.");
+    parser.addPositionalArgument("password", "VNC password.", "[password]");
+    QCommandLineOption profileOption("profile", "Tuning profile: " + SessionProfile::names().join(", ")
+                                     + ", or auto to start from what earlier sessions learned about the link.", "name");
+    QCommandLineOption encodingsOption("encodings", "Encodings in order of preference, e.g. \"tight hextile raw\".", "list");
+    QCommandLineOption compressOption("compress", "Compression level 0-9.", "level");
+    QCommandLineOption qualityOption("quality", "JPEG quality level 0-9.", "level");
+    QCommandLineOption depthOption("depth", "Bits per pixel, 32 or 16.", "bits");
+    QCommandLineOption pollOption("poll-interval", "VNC thread poll interval in microseconds.", "us");
+    QCommandLineOption maxFpsOption("max-fps", "Framebuffer updates per second, 0 = unlimited.", "fps");
+    QCommandLineOption budgetOption("bandwidth-budget", "Bytes per second shared by all sessions on this machine, "
+                                    "in KB/s, 0 = unlimited.", "kbps");
+    QCommandLineOption shareOption("share", "Re-serve the session to local viewers on 127.0.0.1:<port>.", "port");
+    QCommandLineOption monitorsOption("monitors", "Window per remote monitor: auto, off, a count, or WxH+X+Y,...", "layout");
+    parser.addOptions({profileOption, encodingsOption, compressOption, qualityOption, depthOption, pollOption, maxFpsOption,
+                       budgetOption, shareOption, monitorsOption});
+    parser.process(a);
+    
+    const QStringList args = parser.positionalArguments();
+    if (args.size() < 2) {
+        std::cout << "Usage: " << argv[0] << " [options] <server_ip> <port> [password]" << std::endl;
+        std::cout << "Example: " << argv[0] << " --profile wan 192.168.1.100 5900 mypassword" << std::endl;
+        return 1;
+    }
+    
+    // Unset fields keep the values stored for the server
+    SessionProfile overrides;
+    bool learnedProfile = parser.isSet(profileOption) && parser.value(profileOption).compare("auto", Qt::CaseInsensitive) == 0;
+    if (parser.isSet(profileOption) && !learnedProfile && !SessionProfile::named(parser.value(profileOption), overrides)) {
+        std::cerr << "[ERROR] Unknown profile " << parser.value(profileOption).toStdString()
+                  << " (expected " << SessionProfile::names().join(", ").toStdString() << ")" << std::endl;
+        return 1;
+    }
+    if (parser.isSet(encodingsOption)) {
+        overrides.encodings = parser.value(encodingsOption);
+    }
+    if (parser.isSet(compressOption) && !intOption(parser, compressOption, overrides.compressLevel)) {
+        return 1;
+    }
+    if (parser.isSet(qualityOption) && !intOption(parser, qualityOption, overrides.qualityLevel)) {
+        return 1;
+    }
+    if (parser.isSet(depthOption) && !intOption(parser, depthOption, overrides.bitsPerPixel)) {
+        return 1;
+    }
+    if (parser.isSet(pollOption) && !intOption(parser, pollOption, overrides.pollIntervalUs)) {
+        return 1;
+    }
+    if (parser.isSet(maxFpsOption) && !intOption(parser, maxFpsOption, overrides.maxFps)) {
+        return 1;
+    }
+    
+    // Check the overrides against a complete profile so bad values fail here, not at connect time
+    SessionProfile check;
+    SessionProfile::named("lan", check);
+    check.merge(overrides);
+    QString error;
+    if (!check.isValid(&error)) {
+        std::cerr << "[ERROR] Invalid option: " << error.toStdString() << std::endl;
+        return 1;
+    }
+    
+    int sharePort = 0;
+    if (parser.isSet(shareOption)) {
+        if (!intOption(parser, shareOption, sharePort)) {
+            return 1;
+        }
+        if (sharePort <= 0 || sharePort > 65535) {
+            std::cerr << "[ERROR] Invalid option: share port must be 1-65535" << std::endl;
+            return 1;
+        }
+    }
+    
+    if (parser.isSet(monitorsOption) && !MonitorLayout::isValidSpec(parser.value(monitorsOption), &error)) {
+        std::cerr << "[ERROR] Invalid option: " << error.toStdString() << std::endl;
+        return 1;
+    }
+    
+    qint64 budgetKBps = -1;
+    if (parser.isSet(budgetOption)) {
+        bool ok = false;
+        budgetKBps = parser.value(budgetOption).toLongLong(&ok);
+        if (!ok || budgetKBps < 0) {
+            std::cerr << "[ERROR] Invalid option: bandwidth budget must be a number of KB/s" << std::endl;
+            return 1;
+        }
+    }
+    
+    bool portOk = false;
+    int serverPort = args.at(1).toInt(&portOk);
+    if (!portOk || serverPort <= 0 || serverPort > 65535) {
+        std::cerr << "[ERROR] Invalid port " << args.at(1).toStdString() << " (expected 1-65535)" << std::endl;
+        return 1;
+    }
+    
     MainWindow w;
+    w.setSharePort(sharePort);
+    if (learnedProfile) {
+        w.useLearnedProfile();
+    }
+    if (budgetKBps >= 0) {
+        w.setBandwidthBudget(budgetKBps * 1024);
+    }
+    if (parser.isSet(monitorsOption)) {
+        w.setMonitorLayout(parser.value(monitorsOption));
+    }
     w.show();
     
     // Connect to VNC server
-    std::string serverIp = argv[1];
-    int serverPort = std::atoi(argv[2]);
-    std::string password = (argc > 3) ? argv[3] : "";
-    w.connectToServer(serverIp, serverPort, password);
+    std::string serverIp = args.at(0).toStdString();
+    std::string password = (args.size() > 2) ? args.at(2).toStdString() : "";
+    w.connectToServer(serverIp, serverPort, password, overrides);
+    
+    int result = a.exec();
     
-    return a.exec();
+    // The VNC thread has been joined by closeEvent, so every span buffer is quiescent
+    trace::flush();
+    return result;
 }
@@ -16,12 +16,34 @@
 #include <QApplication>
 #include <QClipboard>
 #include <QMetaObject>
+#include <QResizeEvent>
+#include <QShowEvent>
+#include <QHideEvent>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QWidgetAction>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QSlider>
+#include <QTime>
 #include <algorithm>
+#include <chrono>
+#include <climits>
 #include <iostream>
+#include "framebufferops.h"
+#include "keymap.h"
+#include "trace.h"
+#include "inputqueue.h"
+#include "controlserver.h"
+#include "debugoverlay.h"
+#include "fanoutserver.h"
+#include "regionwatcher.h"
 
 #ifdef _WIN32
 #include <winsock2.h>
 #include <windows.h>
+#else
+#include <sys/socket.h>
 #endif
 
 extern "C" {
@@ -31,6 +53,87 @@ extern "C" {
 const int TITLE_BAR_HEIGHT = 32;
 const int BUTTON_SIZE = 24;
 
+// Zoom/pan tuning
+const double ZOOM_STEP = 1.25;
+const double MAX_ZOOM = 8.0;
+const int PAN_STEP = 64;                  // Window pixels per arrow key / wheel notch
+const double PREFETCH_MARGIN = 0.25;      // Fraction of the visible area requested around it
+
+// Half-size of the area around the pointer a pointer event's latency probe watches
+const int LATENCY_PROBE_RADIUS = 32;
+
+// Server data buffered ahead of the decoder
+const size_t SOCKET_PUMP_BUFFER_BYTES = 8 * 1024 * 1024;
+
+// Longest single wait of the VNC thread when pacing updates, so it keeps checking for shutdown
+const std::chrono::milliseconds MAX_PACING_WAIT(50);
+
+// Remote resize timing
+const int REMOTE_RESIZE_DEBOUNCE_MS = 500;
+const int REMOTE_RESIZE_TIMEOUT_MS = 3000;
+// Unanswered requests in a row before falling back to scaling; a slow or rounding server
+// misses one now and then
+const int REMOTE_RESIZE_MAX_FAILURES = 3;
+
+// Offset between monitor windows that have no local monitor of their own
+const int MONITOR_WINDOW_CASCADE = 40;
+
+// A session minimized or hidden this long compresses its framebuffer
+const int BACKGROUND_COMPRESS_DELAY_MS = 10000;
+
+// Throughput is learned from the busiest interval of this length
+const int LINK_SAMPLE_INTERVAL_MS = 1000;
+
+// Rectangles seen before judging how many of them the server resent unchanged
+const uint64_t UNCHANGED_RECTS_SAMPLE = 1000;
+
+// Default pause between typed characters; slow consoles drop keys sent faster than they poll
+const int DEFAULT_TYPING_INTERVAL_MS = 8;
+
+// Rewind history kept per session once recording is switched on for the server, and the
+// rewind slider's resolution
+const int DEFAULT_REWIND_BUDGET_MB = 64;
+const int64_t REWIND_STEP_NS = 100LL * 1000 * 1000;
+
+static int64_t steadyNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Local monitors in the order remote monitors are assigned to them
+static QList<QScreen *> localMonitorsLeftToRight()
+{
+    QList<QScreen *> monitors = QApplication::screens();
+    std::sort(monitors.begin(), monitors.end(), [](QScreen *a, QScreen *b) {
+        QPoint pa = a->geometry().topLeft();
+        QPoint pb = b->geometry().topLeft();
+        return pa.x() != pb.x() ? pa.x() < pb.x() : pa.y() < pb.y();
+    });
+    return monitors;
+}
+
+// Drawing calls made by libvncclient's decoders for the current rectangle
+enum RectDrawFlag {
+    DrawFill = 1,
+    DrawBitmap = 2,
+    DrawCopy = 4
+};
+
+// Whether the drawing calls tell the offered encodings apart: raw and hextile do, but every
+// other decoder also draws with bitmaps and fills
+static bool drawCallsIdentifyEncoding(const QString &encodings)
+{
+    const QStringList names = encodings.toLower().split(' ');
+    for (const QString &name : names) {
+        if (!name.isEmpty() && name != QLatin1String("copyrect") && name != QLatin1String("hextile")
+            && name != QLatin1String("raw")) {
+            return false;
+        }
+    }
+    return true;
+}
+
 #ifdef _WIN32
 MainWindow* MainWindow::s_instance = nullptr;
 #endif
@@ -68,6 +171,42 @@ MainWindow::MainWindow(QWidget *parent)
     connect(QApplication::clipboard(), &QClipboard::dataChanged, this, &MainWindow::onClipboardChanged);
     connect(this, &MainWindow::clipboardReceived, this, &MainWindow::updateClipboardFromServer);
     
+    // Debounce window resizes before asking the server for a new desktop size
+    m_remoteResizeTimer = new QTimer(this);
+    m_remoteResizeTimer->setSingleShot(true);
+    m_remoteResizeTimer->setInterval(REMOTE_RESIZE_DEBOUNCE_MS);
+    connect(m_remoteResizeTimer, &QTimer::timeout, this, &MainWindow::requestRemoteResize);
+    
+    m_remoteResizeCheckTimer = new QTimer(this);
+    m_remoteResizeCheckTimer->setSingleShot(true);
+    m_remoteResizeCheckTimer->setInterval(REMOTE_RESIZE_TIMEOUT_MS);
+    connect(m_remoteResizeCheckTimer, &QTimer::timeout, this, &MainWindow::checkRemoteResize);
+    
+    m_typingQueue = new InputQueue([this](const InputEvent &event) {
+        if (!(m_connected && m_client)) {
+            return;
+        }
+        auto held = std::find(m_typingHeldKeys.begin(), m_typingHeldKeys.end(), event.keysym);
+        if (event.down && held == m_typingHeldKeys.end()) {
+            m_typingHeldKeys.push_back(event.keysym);
+        } else if (!event.down && held != m_typingHeldKeys.end()) {
+            m_typingHeldKeys.erase(held);
+        }
+        sendKeyEvent(event.keysym, event.down);
+    }, this);
+    
+    m_linkTimer = new QTimer(this);
+    m_linkTimer->setInterval(LINK_SAMPLE_INTERVAL_MS);
+    connect(m_linkTimer, &QTimer::timeout, this, &MainWindow::sampleLink);
+    
+    m_backgroundTimer = new QTimer(this);
+    m_backgroundTimer->setSingleShot(true);
+    m_backgroundTimer->setInterval(BACKGROUND_COMPRESS_DELAY_MS);
+    connect(m_backgroundTimer, &QTimer::timeout, this, [this]() { m_background = true; });
+    
+    // Damage/encoding overlay, a separate layer that is hidden until enabled from the menu
+    m_debugOverlay = new DebugOverlay([this]() { return getViewportMapping(); }, this);
+    
     // Note: Window position, size, and read-only state are restored per-server in connectToServer()
 }
 
@@ -77,10 +216,9 @@ MainWindow::~MainWindow()
     uninstallKeyboardHook();
 #endif
     // Ensure clean shutdown
-    m_connected = false;
-    if (m_vncThread && m_vncThread->joinable()) {
-        m_vncThread->join();
-        delete m_vncThread;
+    disconnectFromServer();
+    for (MainWindow *window : m_monitorWindows) {
+        delete window;
     }
     delete ui;
 }
@@ -110,12 +248,441 @@ void MainWindow::gotXCutTextCallback(rfbClient *client, const char *text, int te
     }
 }
 
+void MainWindow::gotFrameBufferUpdateCallback(rfbClient *client, int x, int y, int w, int h)
+{
+    MainWindow *viewer = static_cast<MainWindow*>(rfbClientGetClientData(client, nullptr));
+    if (viewer) {
+        viewer->handleRectDecoded(x, y, w, h);
+    }
+}
+
+// libvncclient requires all three drawing hooks to be set together; these
+// replace its defaults and note which calls each rectangle was decoded with
+void MainWindow::gotFillRectCallback(rfbClient *client, int x, int y, int w, int h, uint32_t colour)
+{
+    if (!fbops::rectInside(client->width, client->height, x, y, w, h)) {
+        return;
+    }
+    MainWindow *viewer = static_cast<MainWindow*>(rfbClientGetClientData(client, nullptr));
+    if (viewer && viewer->m_compressedFramebuffer.isActive()) {
+        viewer->m_compressedFramebuffer.prepareWrite(viewer->framebufferView(), QRect(x, y, w, h));
+    }
+    int bytesPerPixel = client->format.bitsPerPixel / 8;
+    fbops::fillRect(client->frameBuffer, client->width * bytesPerPixel, bytesPerPixel, x, y, w, h, colour);
+    
+    if (viewer) {
+        viewer->m_rectDrawFlags |= DrawFill;
+        viewer->m_rectFills++;
+    }
+}
+
+void MainWindow::gotBitmapCallback(rfbClient *client, const uint8_t *buffer, int x, int y, int w, int h)
+{
+    if (!fbops::rectInside(client->width, client->height, x, y, w, h)) {
+        return;
+    }
+    MainWindow *viewer = static_cast<MainWindow*>(rfbClientGetClientData(client, nullptr));
+    if (viewer && viewer->m_compressedFramebuffer.isActive()) {
+        viewer->m_compressedFramebuffer.prepareWrite(viewer->framebufferView(), QRect(x, y, w, h));
+    }
+    int bytesPerPixel = client->format.bitsPerPixel / 8;
+    fbops::putBitmap(client->frameBuffer, client->width * bytesPerPixel, bytesPerPixel, buffer, x, y, w, h);
+    
+    if (viewer) {
+        viewer->m_rectDrawFlags |= DrawBitmap;
+        viewer->m_rectNarrowestBitmap = std::min(viewer->m_rectNarrowestBitmap, w);
+        viewer->m_rectBitmapBytes += static_cast<int64_t>(w) * h * bytesPerPixel;
+    }
+}
+
+void MainWindow::gotCopyRectCallback(rfbClient *client, int srcX, int srcY, int w, int h, int destX, int destY)
+{
+    if (!fbops::rectInside(client->width, client->height, srcX, srcY, w, h) ||
+        !fbops::rectInside(client->width, client->height, destX, destY, w, h)) {
+        return;
+    }
+    MainWindow *viewer = static_cast<MainWindow*>(rfbClientGetClientData(client, nullptr));
+    if (viewer && viewer->m_compressedFramebuffer.isActive()) {
+        // The move reads the source, so it has to be decompressed too
+        viewer->m_compressedFramebuffer.prepareWrite(viewer->framebufferView(), QRect(srcX, srcY, w, h));
+        viewer->m_compressedFramebuffer.prepareWrite(viewer->framebufferView(), QRect(destX, destY, w, h));
+    }
+    int bytesPerPixel = client->format.bitsPerPixel / 8;
+    fbops::copyRect(client->frameBuffer, client->width * bytesPerPixel, bytesPerPixel, srcX, srcY, w, h, destX, destY);
+    
+    if (viewer) {
+        viewer->m_rectDrawFlags |= DrawCopy;
+        viewer->presentCopy(QRect(srcX, srcY, w, h), destX - srcX, destY - srcY);
+        viewer->m_scrollPredictor.copyReceived(QRect(srcX, srcY, w, h), destX - srcX, destY - srcY);
+    }
+}
+
+// The server moving its cursor also answers a pointer event's latency probe
+int8_t MainWindow::handleCursorPosCallback(rfbClient *client, int x, int y)
+{
+    MainWindow *viewer = static_cast<MainWindow*>(rfbClientGetClientData(client, nullptr));
+    if (viewer) {
+        viewer->m_latencyProbe.rectUpdated(QRect(x, y, 1, 1));
+    }
+    return TRUE;
+}
+
+int8_t MainWindow::mallocFrameBufferCallback(rfbClient *client)
+{
+    MainWindow *viewer = static_cast<MainWindow*>(rfbClientGetClientData(client, nullptr));
+    if (!viewer) {
+        return FALSE;
+    }
+    return viewer->allocateFramebuffer(client) ? TRUE : FALSE;
+}
+
+void MainWindow::releaseSpareFramebuffer(int generation)
+{
+    // Any thread, once nothing paints from the generation before this one; a newer resize keeps it
+    std::lock_guard<std::mutex> lock(m_localFramebufferMutex);
+    if (generation == m_localFramebufferGeneration) {
+        std::vector<uint8_t>().swap(m_localFramebuffers[(m_localFramebufferGeneration + 1) & 1]);
+    }
+}
+
+bool MainWindow::allocateFramebuffer(rfbClient *client)
+{
+    uint64_t pixelBytes = static_cast<uint64_t>(client->width) * client->height * client->format.bitsPerPixel / 8;
+    if (pixelBytes > SIZE_MAX / 2) {
+        std::cerr << "[ERROR] Framebuffer of " << client->width << "x" << client->height << " is too large" << std::endl;
+        return false;
+    }
+    
+    if (!m_shareFramebuffer) {
+        // Replaces libvncclient's default, which frees the old buffer while the UI may still paint from it
+        std::lock_guard<std::mutex> lock(m_localFramebufferMutex);
+        std::vector<uint8_t> &next = m_localFramebuffers[(m_localFramebufferGeneration + 1) & 1];
+        try {
+            std::vector<uint8_t>(static_cast<size_t>(pixelBytes)).swap(next);
+        } catch (const std::bad_alloc &) {
+            std::cerr << "[ERROR] Out of memory for a " << client->width << "x" << client->height << " framebuffer" << std::endl;
+            return false;
+        }
+        m_localFramebufferGeneration++;
+        client->frameBuffer = next.data();
+        return true;
+    }
+    
+    std::lock_guard<std::mutex> lock(m_sharedFramebufferMutex);
+    
+    // The previous segment stays mapped for one more generation, the UI may still be painting from it
+    SharedFramebuffer &previous = m_sharedFramebuffers[m_sharedFramebufferGeneration & 1];
+    SharedFramebuffer &next = m_sharedFramebuffers[(m_sharedFramebufferGeneration + 1) & 1];
+    std::string name = m_sharedFramebufferPrefix + "-" + std::to_string(m_sharedFramebufferGeneration + 1);
+    if (!next.create(name, static_cast<size_t>(pixelBytes))) {
+        return false;
+    }
+    if (previous.isValid()) {
+        previous.header()->state = SharedFramebufferHeader::Replaced;
+    }
+    m_sharedFramebufferGeneration++;
+    
+    SharedFramebufferHeader *header = next.header();
+    header->generation = static_cast<uint32_t>(m_sharedFramebufferGeneration);
+    header->width = static_cast<uint32_t>(client->width);
+    header->height = static_cast<uint32_t>(client->height);
+    header->stride = static_cast<uint32_t>(client->width * client->format.bitsPerPixel / 8);
+    header->bitsPerPixel = client->format.bitsPerPixel;
+    header->redShift = client->format.redShift;
+    header->greenShift = client->format.greenShift;
+    header->blueShift = client->format.blueShift;
+    
+    client->frameBuffer = next.pixels();
+    m_dirtyRects.clear();
+    if (m_fanout) {
+        m_fanout->framebufferReallocated(client);
+    }
+    std::cout << "[INFO] Shared framebuffer " << name << " (" << client->width << "x" << client->height << ")" << std::endl;
+    return true;
+}
+
+void MainWindow::handleRectDecoded(int x, int y, int w, int h)
+{
+    // Raw arrives as full-width rows, hextile as tiles and subrect fills. With other decoders
+    // offered a bitmap or fill could come from any of them.
+    int encoding = SessionMetrics::Other;
+    if (m_rectDrawFlags & DrawCopy) {
+        encoding = SessionMetrics::CopyRect;
+    } else if (!m_drawCallsIdentifyEncoding) {
+        encoding = SessionMetrics::Other;
+    } else if (m_rectDrawFlags == DrawBitmap && m_rectNarrowestBitmap == w) {
+        encoding = SessionMetrics::Raw;
+    } else if (m_rectDrawFlags != 0) {
+        encoding = SessionMetrics::Hextile;
+    }
+    SessionMetrics::add(m_metrics.rects[encoding]);
+    if (encoding != SessionMetrics::CopyRect) {
+        SessionMetrics::add(m_metrics.decodedPixels, static_cast<uint64_t>(w) * h);
+        // The server answered over this area, whether or not the pixels differ
+        m_scrollPredictor.rectReceived(QRect(x, y, w, h));
+    }
+    
+    // Pixels identical to what was there go no further than the framebuffer. Compressed bands
+    // cannot be hashed; the grid was reset when they were compressed.
+    bool changed = true;
+    if (!m_compressedFramebuffer.isActive()) {
+        changed = m_tileHashes.update(framebufferView(), QRect(x, y, w, h)) || (m_rectDrawFlags & DrawCopy);
+    }
+    if (!changed) {
+        SessionMetrics::add(m_metrics.unchangedRects);
+        reportUnchangedRects();
+    }
+    m_updateChanged = m_updateChanged || changed;
+    
+    if (changed) {
+        if (m_shareFramebuffer && m_dirtyRects.size() <= SharedFramebufferHeader::DIRTY_RING_SIZE) {
+            m_dirtyRects.push_back({0, static_cast<uint32_t>(x), static_cast<uint32_t>(y),
+                                    static_cast<uint32_t>(w), static_cast<uint32_t>(h)});
+        }
+        m_latencyProbe.rectUpdated(QRect(x, y, w, h));
+        // A CopyRect was already presented as a move
+        if (m_rectDrawFlags != DrawCopy) {
+            presentRect(QRect(x, y, w, h));
+        }
+        if (m_regionWatcher) {
+            m_regionWatcher->rectDecoded(QRect(x, y, w, h));
+        }
+        m_rewindBuffer.rectDecoded(QRect(x, y, w, h));
+        if (m_fanout) {
+            m_fanout->markModified(x, y, w, h);
+        }
+    }
+    // Decoders that bypass the drawing hooks wrote into a compressed band
+    if (m_compressedFramebuffer.isActive()) {
+        m_compressedFramebuffer.rectWritten(framebufferView(), QRect(x, y, w, h));
+    }
+    
+    if (m_debugOverlay->isActive()) {
+        m_debugOverlay->record(x - m_screenRect.x(), y - m_screenRect.y(), w, h, encoding, estimateRectBytes(encoding, w, h));
+    }
+    
+    // A rectangle's span runs from the end of the previous one (or the message start)
+    if (trace::enabled()) {
+        int64_t end = trace::now();
+        trace::complete("decodeRect", m_rectStartNs, end, SessionMetrics::encodingName(encoding));
+        m_rectStartNs = end;
+    }
+    
+    m_rectDrawFlags = 0;
+    m_rectNarrowestBitmap = INT_MAX;
+    m_rectFills = 0;
+    m_rectBitmapBytes = 0;
+}
+
+int MainWindow::estimateRectBytes(int encoding, int w, int h) const
+{
+    // Wire size rebuilt from the decoder's drawing calls, after the 12-byte rectangle header
+    const int64_t header = 12;
+    int64_t bytes = 0;
+    switch (encoding) {
+        case SessionMetrics::Raw:
+            bytes = header + m_rectBitmapBytes;
+            break;
+        case SessionMetrics::CopyRect:
+            bytes = header + 4;
+            break;
+        case SessionMetrics::Hextile: {
+            // One subencoding byte per tile, raw tiles in full, two bytes per subrect
+            // (colours of coloured subrects are not visible to the hooks, so this is a lower bound)
+            int64_t tiles = static_cast<int64_t>((w + 15) / 16) * ((h + 15) / 16);
+            bytes = header + tiles + m_rectBitmapBytes + std::max<int64_t>(0, m_rectFills - tiles) * 2;
+            break;
+        }
+        default:
+            return 0;
+    }
+    return static_cast<int>(std::min<int64_t>(bytes, INT_MAX));
+}
+
 void MainWindow::handleFramebufferUpdate(rfbClient *client)
 {
-    // Create QImage from framebuffer (RGB32 format)
-    m_framebuffer = QImage(client->frameBuffer, client->width, client->height, 
-                           QImage::Format_RGB32);
-    update();
+    SessionMetrics::add(m_metrics.updates);
+    
+    bool sizeChanged = m_desktopSize != QSize(client->width, client->height);
+    m_desktopSize = QSize(client->width, client->height);
+    
+    wrapFramebuffer(client);
+    for (MainWindow *window : m_monitorWindows) {
+        window->wrapFramebuffer(client);
+    }
+    if (sizeChanged) {
+        m_presentation.invalidate();
+        for (MainWindow *window : m_monitorWindows) {
+            window->m_presentation.invalidate();
+        }
+        // Every window now wraps the new buffer; the old one goes once the UI has caught up
+        if (!m_shareFramebuffer) {
+            m_spareFramebufferRelease.store(m_localFramebufferGeneration);
+        }
+    }
+    
+    // A new desktop size resets the requested region, recompute it on the UI thread
+    if (sizeChanged) {
+        QMetaObject::invokeMethod(this, &MainWindow::updateRequestedRegion, Qt::QueuedConnection);
+    }
+    m_latencyProbe.updateFinished();
+    // libvncclient has just sent the next update request; the socket reader paces it itself
+    if (!m_socketPump.isRunning()) {
+        m_updateScheduler.requestSent();
+    }
+    if (m_scrollPredictor.updateFinished()) {
+        predictionChanged();
+    }
+    if (m_shareFramebuffer) {
+        publishSharedFramebuffer(client);
+    }
+    if (m_regionWatcher) {
+        m_regionWatcher->updateFinished(framebufferView());
+    }
+    // Compressed bands cannot be recorded; the rewind history was dropped when they were compressed
+    if (m_compressedFramebuffer.isActive()) {
+        m_compressedFramebuffer.updateFinished(framebufferView());
+    } else {
+        m_rewindBuffer.updateFinished(framebufferView(), steadyNanos());
+    }
+    if (m_controlServer) {
+        QMetaObject::invokeMethod(m_controlServer, &ControlServer::framebufferUpdated, Qt::QueuedConnection);
+    }
+    
+    // Repaint only what changed, worked out against the window's current mapping on the UI thread
+    if (m_updateChanged || sizeChanged) {
+        QMetaObject::invokeMethod(this, &MainWindow::repaintDamage, Qt::QueuedConnection);
+        for (MainWindow *window : m_monitorWindows) {
+            QMetaObject::invokeMethod(window, &MainWindow::repaintDamage, Qt::QueuedConnection);
+        }
+    }
+    m_updateChanged = false;
+}
+
+void MainWindow::reportUnchangedRects()
+{
+    // Once per session: a server resending most of what it already sent wastes the link
+    if (m_unchangedRectsReported) {
+        return;
+    }
+    uint64_t total = 0;
+    for (const std::atomic<uint64_t> &count : m_metrics.rects) {
+        total += count.load(std::memory_order_relaxed);
+    }
+    uint64_t unchanged = m_metrics.unchangedRects.load(std::memory_order_relaxed);
+    if (total >= UNCHANGED_RECTS_SAMPLE && unchanged * 2 > total) {
+        std::cout << "[INFO] Server resends unchanged pixels: " << unchanged << " of " << total
+                  << " rectangles changed nothing" << std::endl;
+        m_unchangedRectsReported = true;
+    }
+}
+
+void MainWindow::presentRect(const QRect &rect)
+{
+    // VNC thread: every window showing a part of the desktop, in its own coordinates
+    m_presentation.markDirty(rect.translated(-screenArea(m_client->width, m_client->height).topLeft()));
+    for (MainWindow *window : m_monitorWindows) {
+        window->m_presentation.markDirty(rect.translated(-window->screenArea(m_client->width, m_client->height).topLeft()));
+    }
+}
+
+void MainWindow::presentCopy(const QRect &source, int dx, int dy)
+{
+    m_presentation.scroll(source.translated(-screenArea(m_client->width, m_client->height).topLeft()), dx, dy);
+    for (MainWindow *window : m_monitorWindows) {
+        window->m_presentation.scroll(source.translated(-window->screenArea(m_client->width, m_client->height).topLeft()), dx, dy);
+    }
+}
+
+void MainWindow::repaintDamage()
+{
+    // Queued after the rewrap, so no paint can still be reading the previous generation
+    int generation = m_spareFramebufferRelease.exchange(-1);
+    if (generation >= 0) {
+        releaseSpareFramebuffer(generation);
+    }
+    update(m_presentation.damage(getViewportMapping()));
+}
+
+void MainWindow::predictionChanged()
+{
+    // Any thread, on the primary: every window may show a part of the predicted area
+    QMetaObject::invokeMethod(this, &MainWindow::repaintPrediction, Qt::QueuedConnection);
+    for (MainWindow *window : m_monitorWindows) {
+        QMetaObject::invokeMethod(window, &MainWindow::repaintPrediction, Qt::QueuedConnection);
+    }
+}
+
+void MainWindow::repaintPrediction()
+{
+    // Where the prediction was drawn and where it goes now
+    QRect area = scrollPredictor().prediction().area.translated(-m_screenRect.topLeft());
+    QRect repaint = m_predictionPainted;
+    if (!area.isEmpty()) {
+        repaint |= getViewportMapping().toWindow(QRectF(area)).toAlignedRect();
+    }
+    if (!repaint.isEmpty()) {
+        update(repaint);
+    }
+}
+
+void MainWindow::paintPrediction(QPainter &painter, const ViewportMapping &mapping)
+{
+    // The server's own pixels, shifted by the scroll it has not answered yet
+    ScrollPredictor::Prediction prediction = scrollPredictor().prediction();
+    QRect area = prediction.area.translated(-m_screenRect.topLeft()) & m_framebuffer.rect();
+    if (prediction.dy == 0 || area.isEmpty()) {
+        m_predictionPainted = QRect();
+        return;
+    }
+    QRect source = area & area.translated(0, -prediction.dy);
+    QRect dest = source.translated(0, prediction.dy);
+    
+    painter.save();
+    painter.setClipRect(mapping.target);
+    // Rows scrolled in are not known yet
+    m_predictionPainted = mapping.toWindow(QRectF(area)).toAlignedRect() & mapping.target;
+    painter.fillRect(m_predictionPainted, QColor(128, 128, 128));
+    if (!source.isEmpty()) {
+        painter.drawImage(mapping.toWindow(QRectF(dest)), m_framebuffer, QRectF(source));
+    }
+    painter.restore();
+}
+
+void MainWindow::wrapFramebuffer(rfbClient *client)
+{
+    // Wrap this window's part of the framebuffer in a QImage (RGB32, or RGB16 for 16-bit profiles)
+    int bytesPerPixel = client->format.bitsPerPixel / 8;
+    int stride = client->width * bytesPerPixel;
+    QRect area = screenArea(client->width, client->height);
+    uint8_t *pixels = client->frameBuffer + static_cast<size_t>(area.y()) * stride + area.x() * bytesPerPixel;
+    m_framebuffer = QImage(pixels, area.width(), area.height(), stride,
+                           bytesPerPixel == 2 ? QImage::Format_RGB16 : QImage::Format_RGB32);
+}
+
+QRect MainWindow::screenArea(int desktopWidth, int desktopHeight) const
+{
+    // A monitor that no longer fits a resized desktop falls back to the whole desktop
+    QRect desktop(0, 0, desktopWidth, desktopHeight);
+    QRect area = m_screenRect & desktop;
+    return area.isEmpty() ? desktop : area;
+}
+
+void MainWindow::publishSharedFramebuffer(rfbClient *client)
+{
+    SharedFramebuffer &segment = currentSharedFramebuffer();
+    if (!segment.isValid()) {
+        m_dirtyRects.clear();
+        return;
+    }
+    
+    // More rectangles than the ring holds would overwrite themselves; report the whole frame instead
+    if (m_dirtyRects.size() > SharedFramebufferHeader::DIRTY_RING_SIZE) {
+        m_dirtyRects.clear();
+        m_dirtyRects.push_back({0, 0, 0, static_cast<uint32_t>(client->width), static_cast<uint32_t>(client->height)});
+    }
+    segment.publish(m_dirtyRects.data(), m_dirtyRects.size());
+    m_dirtyRects.clear();
 }
 
 void MainWindow::handleServerClipboard(const char *text, int textlen)
@@ -123,6 +690,9 @@ void MainWindow::handleServerClipboard(const char *text, int textlen)
     if (text && textlen > 0) {
         QString clipboardText = QString::fromUtf8(text, textlen);
         emit clipboardReceived(clipboardText);
+        if (m_fanout) {
+            m_fanout->sendClipboard(QByteArray(text, textlen));
+        }
     }
 }
 
@@ -133,7 +703,8 @@ void MainWindow::updateClipboardFromServer(const QString &text)
     m_updatingClipboard = false;
 }
 
-void MainWindow::connectToServer(const std::string& serverIp, int serverPort, const std::string& password)
+void MainWindow::connectToServer(const std::string& serverIp, int serverPort, const std::string& password,
+                                 const SessionProfile& overrides)
 {
     // Store password for callback
     m_password = password;
@@ -148,27 +719,88 @@ void MainWindow::connectToServer(const std::string& serverIp, int serverPort, co
         return;
     }
     
-    // Configure client for RGB32 format (8-8-8 with padding)
-    // This provides true color (16 million colors) for better image quality
-    m_client->format.depth = 24;
-    m_client->format.bitsPerPixel = 32;
-    m_client->format.redShift = 16;
-    m_client->format.greenShift = 8;
-    m_client->format.blueShift = 0;
-    m_client->format.redMax = 0xff;
-    m_client->format.greenMax = 0xff;
-    m_client->format.blueMax = 0xff;
-    
-    // Set compression and quality
-    m_client->appData.compressLevel = 0;
-    m_client->appData.qualityLevel = 9;
-    m_client->appData.encodingsString = "hextile raw";
+    // Per-server profile, then what earlier sessions learned about the link, then command
+    // line overrides. Overrides pin the profile for later sessions too, until --profile auto.
+    QSettings settings("wvncc", "wvncc");
+    QString serverKey = QString::fromStdString(m_serverKey);
+    bool pinned = settings.value(serverKey + "/profilePinned", false).toBool();
+    if (m_useLearnedProfile) {
+        pinned = false;
+    } else if (!overrides.name.isEmpty() || !overrides.encodings.isEmpty() || overrides.compressLevel >= 0
+               || overrides.qualityLevel >= 0 || overrides.bitsPerPixel > 0 || overrides.pollIntervalUs > 0
+               || overrides.maxFps >= 0) {
+        pinned = true;
+    }
+    settings.setValue(serverKey + "/profilePinned", pinned);
+    m_profile = SessionProfile::load(settings, serverKey);
+    LinkProfile link = LinkProfile::load(settings, serverKey);
+    if (!pinned && link.isKnown()) {
+        std::cout << "[INFO] Link learned over " << link.sessions << " sessions: RTT " << link.rttMs << " ms"
+                  << (link.capacityKBps >= 0 ? ", " + std::to_string(static_cast<int>(link.capacityKBps)) + " KB/s" : "")
+                  << std::endl;
+        m_profile.merge(link.recommend());
+    }
+    m_profile.merge(overrides);
+    std::cout << "[INFO] Profile " << m_profile.name.toStdString() << ": encodings \"" << m_profile.encodings.toStdString()
+              << "\", compression " << m_profile.compressLevel << ", quality " << m_profile.qualityLevel
+              << ", " << m_profile.bitsPerPixel << " bpp, poll " << m_profile.pollIntervalUs << " us, max fps "
+              << (m_profile.maxFps > 0 ? std::to_string(m_profile.maxFps) : "unlimited") << std::endl;
+    
+    if (m_profile.bitsPerPixel == 16) {
+        // RGB565 halves the bytes per pixel for bandwidth-bound sessions
+        m_client->format.depth = 16;
+        m_client->format.bitsPerPixel = 16;
+        m_client->format.redShift = 11;
+        m_client->format.greenShift = 5;
+        m_client->format.blueShift = 0;
+        m_client->format.redMax = 0x1f;
+        m_client->format.greenMax = 0x3f;
+        m_client->format.blueMax = 0x1f;
+    } else {
+        // Configure client for RGB32 format (8-8-8 with padding)
+        // This provides true color (16 million colors) for better image quality
+        m_client->format.depth = 24;
+        m_client->format.bitsPerPixel = 32;
+        m_client->format.redShift = 16;
+        m_client->format.greenShift = 8;
+        m_client->format.blueShift = 0;
+        m_client->format.redMax = 0xff;
+        m_client->format.greenMax = 0xff;
+        m_client->format.blueMax = 0xff;
+    }
+    
+    // Set compression and quality (libvncclient keeps the encodings pointer)
+    m_encodingsString = m_profile.encodings.toLatin1();
+    m_drawCallsIdentifyEncoding = drawCallsIdentifyEncoding(m_profile.encodings);
+    m_client->appData.compressLevel = m_profile.compressLevel;
+    m_client->appData.qualityLevel = m_profile.qualityLevel;
+    m_client->appData.encodingsString = m_encodingsString.constData();
     m_client->appData.useRemoteCursor = TRUE;
     
     // Set callbacks
     m_client->FinishedFrameBufferUpdate = framebufferUpdateCallback;
     m_client->GetPassword = getPasswordCallback;
     m_client->GotXCutText = gotXCutTextCallback;
+    m_client->GotFrameBufferUpdate = gotFrameBufferUpdateCallback;
+    m_client->GotFillRect = gotFillRectCallback;
+    m_client->GotBitmap = gotBitmapCallback;
+    m_client->GotCopyRect = gotCopyRectCallback;
+    m_client->HandleCursorPos = handleCursorPosCallback;
+    m_rectDrawFlags = 0;
+    m_rectNarrowestBitmap = INT_MAX;
+    
+    // Local consumers read pixels straight from the decoders' buffer in shared memory
+    QString controlSocket = qEnvironmentVariable("WVNCC_CONTROL_SOCKET");
+    QString sharedFramebuffer = qEnvironmentVariable("WVNCC_SHARED_FRAMEBUFFER");
+    // Sharing the session also needs the framebuffer to outlive a resize by one generation
+    m_shareFramebuffer = !controlSocket.isEmpty() || !sharedFramebuffer.isEmpty() || m_sharePort > 0;
+    if (m_shareFramebuffer) {
+        m_sharedFramebufferPrefix = sharedFramebuffer.isEmpty()
+            ? "wvncc-" + std::to_string(QCoreApplication::applicationPid())
+            : sharedFramebuffer.toStdString();
+    }
+    // rfbClientCleanup never frees the framebuffer, so it is always allocated (and freed) here
+    m_client->MallocFrameBuffer = mallocFrameBufferCallback;
     
     // Set server connection info
     m_client->serverHost = strdup(serverIp.c_str());
@@ -179,12 +811,37 @@ void MainWindow::connectToServer(const std::string& serverIp, int serverPort, co
     
     // Initialize connection
     if (!rfbInitClient(m_client, 0, nullptr)) {
+        // libvncclient has already cleaned the client up, only the framebuffer is left
         std::cerr << "[ERROR] Failed to connect to VNC server" << std::endl;
         m_client = nullptr;
+        for (std::vector<uint8_t> &framebuffer : m_localFramebuffers) {
+            std::vector<uint8_t>().swap(framebuffer);
+        }
         return;
     }
     
+    // Read the socket on its own thread so the next message arrives while this one decodes.
+    // TLS sessions are bound to the original socket and keep reading it directly.
+    // Request pacing is switched on below, once the bandwidth budget is attached
+    m_socketPump.setRequestPacing(nullptr);
+    if (!m_client->tlsSession && m_socketPump.start(m_client->sock, SOCKET_PUMP_BUFFER_BYTES)) {
+        m_client->sock = m_socketPump.clientSocket();
+    }
+    
     m_connected = true;
+    SessionMetrics::add(m_metrics.connects);
+    m_linkSampler.reset(LinkProfile::preferredEncoding(m_profile.encodings));
+    m_linkTimer->start();
+    m_remoteResizeFailures = 0;
+    m_remoteResizeRequested = QSize();
+    
+    // The shared framebuffer alone needs no control socket; readers find it by name
+    if (!controlSocket.isEmpty() && !m_controlServer) {
+        startControlServer(controlSocket);
+    }
+    if (m_sharePort > 0 && !m_fanout) {
+        startFanout();
+    }
     std::cout << "[INFO] Connected to " << serverIp << ":" << serverPort << std::endl;
     std::cout << "[INFO] Screen size: " << m_client->width << "x" << m_client->height << std::endl;
     
@@ -193,17 +850,40 @@ void MainWindow::connectToServer(const std::string& serverIp, int serverPort, co
         setWindowTitle(QString::fromUtf8(m_client->desktopName));
     }
     
+    // One window per remote monitor, this one showing the first
+    if (m_monitorLayout.spec.isEmpty()) {
+        m_monitorLayout.spec = settings.value(serverKey + "/monitorLayout").toString();
+    }
+    QList<QRect> monitors = m_monitorLayout.screens(QSize(m_client->width, m_client->height));
+    if (monitors.size() >= 2) {
+        m_screenRect = monitors.first();
+        std::cout << "[INFO] Remote monitors: " << formatMonitorLayout(monitors).toStdString() << std::endl;
+    }
+    
     // Calculate window size to fit available display while respecting VNC aspect ratio
     QScreen* screen = QApplication::primaryScreen();
+    if (monitors.size() >= 2) {
+        screen = localMonitorsLeftToRight().value(0, screen);
+    }
     QRect availableGeometry = screen->availableGeometry();
     
-    int vncWidth = m_client->width;
-    int vncHeight = m_client->height;
+    QRect area = screenArea(m_client->width, m_client->height);
+    int vncWidth = area.width();
+    int vncHeight = area.height();
     int targetWidth = vncWidth;
     int targetHeight = vncHeight + TITLE_BAR_HEIGHT;
     
-    QSettings settings("wvncc", "wvncc");
-    QString serverKey = QString::fromStdString(m_serverKey);
+    // Metrics export is opt-in through the environment
+    if (!m_metricsExporter) {
+        m_metricsExporter = new MetricsExporter(m_metrics, this);
+        if (m_metricsExporter->configureFromEnvironment()) {
+            m_metricsExporter->setServer(serverKey);
+            m_metricsExporter->setRefreshHook([this]() { refreshMetrics(); });
+        } else {
+            delete m_metricsExporter;
+            m_metricsExporter = nullptr;
+        }
+    }
     
     // Restore per-server read-only mode
     if (settings.contains(serverKey + "/readOnlyMode")) {
@@ -212,6 +892,16 @@ void MainWindow::connectToServer(const std::string& serverIp, int serverPort, co
         update();
     }
     
+    // Restore per-server remote resize setting
+    m_remoteResize = settings.value(serverKey + "/remoteResize", false).toBool();
+    
+    // Restore per-server speculative scrolling
+    m_scrollPredictor.setEnabled(settings.value(serverKey + "/predictScroll", false).toBool());
+    
+    // Per-server rewind history budget (0 = not recorded, the default)
+    m_rewindBudgetMB = std::max(0, settings.value(serverKey + "/rewindBudgetMB", 0).toInt());
+    m_rewindBuffer.setBudget(static_cast<size_t>(m_rewindBudgetMB) * 1024 * 1024);
+    
     // Restore per-server always on top setting
     if (settings.contains(serverKey + "/alwaysOnTop")) {
         m_alwaysOnTop = settings.value(serverKey + "/alwaysOnTop").toBool();
@@ -267,49 +957,178 @@ void MainWindow::connectToServer(const std::string& serverIp, int serverPort, co
 
     // Send multiple button release events to ensure server clears any stale button state
     for (int i = 0; i < 3; i++) {
-        SendPointerEvent(m_client, m_client->width / 2, m_client->height / 2, 0);
+        sendPointerEvent(m_client->width / 2, m_client->height / 2, 0);
     }
 
     // Initialize server pointer to current cursor location (if inside window)
     syncPointerToCurrentCursor();
     
+    // Ask the server to match the restored window size
+    if (m_remoteResize) {
+        m_remoteResizeTimer->start();
+    }
+    
+    // Pace update requests; the bandwidth budget is shared with the other sessions on this machine
+    m_updateScheduler.setMaxFps(m_profile.maxFps);
+    bool budgetCreated = m_bandwidthBudget.attach();
+    if (m_bandwidthBudgetOverride >= 0) {
+        setBandwidthBudgetLive(m_bandwidthBudgetOverride);
+    } else if (budgetCreated && settings.contains("bandwidthBudget")) {
+        m_bandwidthBudget.setBytesPerSecond(settings.value("bandwidthBudget").toLongLong());
+    }
+    m_updateScheduler.setBudget(&m_bandwidthBudget);
+    if (m_socketPump.isRunning()) {
+        m_socketPump.setRequestPacing(&m_updateScheduler);
+    }
+    if (m_bandwidthBudget.bytesPerSecond() > 0) {
+        std::cout << "[INFO] Bandwidth budget " << m_bandwidthBudget.bytesPerSecond() / 1024 << " KB/s"
+                  << (m_bandwidthBudget.isShared() ? " shared by all sessions" : "") << std::endl;
+    }
+    
+    // The VNC thread presents every update to these windows, so they exist before it starts
+    if (monitors.size() >= 2) {
+        openMonitorWindows(monitors);
+    }
+    
     // Start VNC message processing thread
     m_vncThread = new std::thread([this]() {
+        trace::setThreadName("VNC");
         while (m_connected && m_client) {
-            int result = WaitForMessage(m_client, 500);
+            applyRequestedRegion();
+            // Region waits start between messages, against a framebuffer no decoder is writing
+            if (m_regionWatcher) {
+                m_regionWatcher->poll(framebufferView());
+            }
+            applyBackgroundState();
+            
+            int result;
+            {
+                TRACE_SPAN("WaitForMessage");
+                result = WaitForMessage(m_client, m_profile.pollIntervalUs);
+            }
             if (result < 0) {
                 std::cout << "[INFO] Connection lost" << std::endl;
-                rfbClientCleanup(m_client);
-                m_connected = false;
+                SessionMetrics::add(m_metrics.disconnects);
                 break;
             }
             
-            if (result > 0 && !HandleRFBServerMessage(m_client)) {
+            if (result == 0) {
+                continue;
+            }
+            
+            // Without the socket reader the update requests cannot be held back; not reading the
+            // next message paces the server through TCP instead
+            std::chrono::nanoseconds pacing(0);
+            if (!m_socketPump.isRunning()) {
+                pacing = m_updateScheduler.delay(receivedBytes());
+            }
+            if (pacing.count() > 0) {
+                TRACE_SPAN("Paced");
+                auto wait = std::min<std::chrono::nanoseconds>(pacing, MAX_PACING_WAIT);
+                std::this_thread::sleep_for(wait);
+                SessionMetrics::add(m_metrics.pacedNanos, wait.count());
+                continue;
+            }
+            
+            auto decodeStart = std::chrono::steady_clock::now();
+            bool handled;
+            {
+                TRACE_SPAN("HandleRFBServerMessage");
+                m_rectStartNs = trace::enabled() ? trace::now() : 0;
+                if (m_shareFramebuffer) {
+                    currentSharedFramebuffer().beginWrite();
+                }
+                handled = HandleRFBServerMessage(m_client);
+                if (m_shareFramebuffer) {
+                    currentSharedFramebuffer().endWrite();
+                }
+            }
+            auto decodeTime = std::chrono::steady_clock::now() - decodeStart;
+            SessionMetrics::add(m_metrics.messages);
+            SessionMetrics::add(m_metrics.decodeNanos, std::chrono::duration_cast<std::chrono::nanoseconds>(decodeTime).count());
+            
+            if (!handled) {
                 std::cout << "[INFO] Disconnected from server" << std::endl;
-                rfbClientCleanup(m_client);
-                m_connected = false;
+                SessionMetrics::add(m_metrics.disconnects);
                 break;
             }
         }
+        // The UI thread may still be using the client; it cleans up once this thread has ended
+        if (m_connected.exchange(false)) {
+            QMetaObject::invokeMethod(this, &MainWindow::disconnectFromServer, Qt::QueuedConnection);
+        }
     });
 }
 
-void MainWindow::paintEvent(QPaintEvent *event)
+void MainWindow::disconnectFromServer()
 {
-    event->accept();
-    
-    QPainter painter(this);
-    
-    // Draw title bar
-    titleBarRect = QRect(0, 0, width(), TITLE_BAR_HEIGHT);
-    painter.fillRect(titleBarRect, QColor(31, 78, 121));
-    
-    // Draw window title
-    painter.setPen(Qt::white);
-    painter.setFont(QFont("Segoe UI", 10));
-    painter.drawText(10, 0, 200, TITLE_BAR_HEIGHT, Qt::AlignVCenter, windowTitle());
-    
-    // Draw window control buttons (minimize, maximize, close)
+    // UI thread: the only place the connection is torn down, after the VNC thread has ended,
+    // so nothing can be using the client any more. Safe to call more than once.
+    m_connected = false;
+    if (m_primary) {
+        m_client = nullptr;
+        return;
+    }
+    // A VNC thread stuck in the middle of a message from a stalled server has to see EOF
+    // first: stopping the socket reader closes the decoder's end of the pair, and without
+    // the reader (TLS) the server socket itself is shut down
+    if (m_socketPump.isRunning()) {
+        m_socketPump.stop();
+    } else if (m_vncThread && m_client && m_client->sock != RFB_INVALID_SOCKET) {
+#ifdef _WIN32
+        shutdown(m_client->sock, SD_BOTH);
+#else
+        shutdown(m_client->sock, SHUT_RDWR);
+#endif
+    }
+    if (m_vncThread) {
+        m_vncThread->join();
+        delete m_vncThread;
+        m_vncThread = nullptr;
+    }
+    if (!m_client) {
+        return;
+    }
+    
+    // The windows keep showing the last picture after the decoders' buffer is gone
+    m_compressedFramebuffer.restore(framebufferView());
+    m_framebuffer = m_framebuffer.copy();
+    for (MainWindow *window : m_monitorWindows) {
+        window->m_connected = false;
+        window->m_client = nullptr;
+        window->m_framebuffer = window->m_framebuffer.copy();
+    }
+    rfbClientCleanup(m_client);
+    m_client = nullptr;
+    for (std::vector<uint8_t> &framebuffer : m_localFramebuffers) {
+        std::vector<uint8_t>().swap(framebuffer);
+    }
+}
+
+void MainWindow::paintEvent(QPaintEvent *event)
+{
+    TRACE_SPAN("paintEvent");
+    event->accept();
+    
+    QElapsedTimer paintTimer;
+    paintTimer.start();
+    
+    QPainter painter(this);
+    
+    // Draw title bar
+    titleBarRect = QRect(0, 0, width(), TITLE_BAR_HEIGHT);
+    painter.fillRect(titleBarRect, QColor(31, 78, 121));
+    
+    // Draw window title
+    painter.setPen(Qt::white);
+    painter.setFont(QFont("Segoe UI", 10));
+    painter.drawText(10, 0, 200, TITLE_BAR_HEIGHT, Qt::AlignVCenter, windowTitle());
+    if (!m_rewindFrame.isNull()) {
+        painter.setPen(QColor(255, 200, 80));
+        painter.drawText(210, 0, 200, TITLE_BAR_HEIGHT, Qt::AlignVCenter, "Rewind: " + m_rewindFrameTime);
+    }
+    
+    // Draw window control buttons (minimize, maximize, close)
     int buttonSize = TITLE_BAR_HEIGHT - 8;
     int rightOffset = width() - buttonSize - 4;
     
@@ -351,88 +1170,63 @@ void MainWindow::paintEvent(QPaintEvent *event)
     painter.setPen(QColor(150, 150, 150));
     painter.drawLine(0, TITLE_BAR_HEIGHT, width(), TITLE_BAR_HEIGHT);
     
-    // Draw VNC framebuffer content scaled to fit window while maintaining aspect ratio
-    if (!m_framebuffer.isNull()) {
+    // Draw VNC framebuffer content: whole desktop fitted to the window, or the zoomed viewport
+    // A compressed framebuffer is painted once the VNC thread has restored it
+    ViewportMapping mapping = getViewportMapping();
+    if (mapping.isValid() && !m_compressedFramebuffer.isActive()) {
         // Enable high-quality rendering
         painter.setRenderHint(QPainter::SmoothPixmapTransform, true);
         painter.setRenderHint(QPainter::Antialiasing, true);
         
-        QRect targetRect(0, TITLE_BAR_HEIGHT, width(), height() - TITLE_BAR_HEIGHT);
-        QSize scaledSize = m_framebuffer.size().scaled(targetRect.size(), Qt::KeepAspectRatio);
-        
-        // Center the scaled image
-        int x = (targetRect.width() - scaledSize.width()) / 2;
-        int y = targetRect.y() + (targetRect.height() - scaledSize.height()) / 2;
+        // Only the visible source area is sampled and scaled, and only where it changed
+        QRect destRect = mapping.target;
+        if (!m_rewindFrame.isNull()) {
+            // A past frame from the rewind slider; live changes wait in the presentation cache
+            QRect area = screenArea(m_rewindFrame.width(), m_rewindFrame.height());
+            if (area.size() == m_framebuffer.size()) {
+                painter.drawImage(QRectF(destRect), m_rewindFrame, mapping.source.translated(area.topLeft()));
+            } else {
+                painter.drawImage(QRectF(destRect), m_rewindFrame, QRectF(area));  // Desktop resized since
+            }
+        } else {
+            const QImage *presented = m_presentation.render(m_framebuffer, mapping);
+            if (presented) {
+                painter.drawImage(destRect.topLeft(), *presented);
+            } else {
+                painter.drawImage(QRectF(destRect), m_framebuffer, mapping.source);
+            }
+            paintPrediction(painter, mapping);
+            
+            // Changes outside this paint's region (e.g. a title bar repaint) still need showing
+            QRegion unshown = m_presentation.shown(event->region());
+            if (!unshown.isEmpty()) {
+                update(unshown);
+            }
+        }
         
-        QRect destRect(x, y, scaledSize.width(), scaledSize.height());
-        painter.drawImage(destRect, m_framebuffer);
+        int x = destRect.x();
+        int y = destRect.y();
         
         // Fill letterbox/pillarbox areas
         if (x > 0) {
             painter.fillRect(0, TITLE_BAR_HEIGHT, x, height() - TITLE_BAR_HEIGHT, Qt::black);
-            painter.fillRect(x + scaledSize.width(), TITLE_BAR_HEIGHT, width() - (x + scaledSize.width()), height() - TITLE_BAR_HEIGHT, Qt::black);
+            painter.fillRect(x + destRect.width(), TITLE_BAR_HEIGHT, width() - (x + destRect.width()), height() - TITLE_BAR_HEIGHT, Qt::black);
         }
         if (y > TITLE_BAR_HEIGHT) {
             painter.fillRect(0, TITLE_BAR_HEIGHT, width(), y - TITLE_BAR_HEIGHT, Qt::black);
-            painter.fillRect(0, y + scaledSize.height(), width(), height() - (y + scaledSize.height()), Qt::black);
+            painter.fillRect(0, y + destRect.height(), width(), height() - (y + destRect.height()), Qt::black);
         }
     } else {
         painter.fillRect(0, TITLE_BAR_HEIGHT, width(), height() - TITLE_BAR_HEIGHT, Qt::white);
     }
-}
-
-uint32_t MainWindow::qtKeyToX11Keysym(int qtKey, Qt::KeyboardModifiers modifiers, const QString& text)
-{
-    // Handle printable characters from text when available
-    if (!text.isEmpty() && text[0].isPrint()) {
-        return text[0].unicode();
-    }
-    
-    // Map Qt special keys to X11 keysyms
-    switch (qtKey) {
-        case Qt::Key_Backspace: return XK_BackSpace;
-        case Qt::Key_Tab: return XK_Tab;
-        case Qt::Key_Return:
-        case Qt::Key_Enter: return XK_Return;
-        case Qt::Key_Escape: return XK_Escape;
-        case Qt::Key_Delete: return XK_Delete;
-        case Qt::Key_Home: return XK_Home;
-        case Qt::Key_End: return XK_End;
-        case Qt::Key_PageUp: return XK_Page_Up;
-        case Qt::Key_PageDown: return XK_Page_Down;
-        case Qt::Key_Left: return XK_Left;
-        case Qt::Key_Up: return XK_Up;
-        case Qt::Key_Right: return XK_Right;
-        case Qt::Key_Down: return XK_Down;
-        case Qt::Key_Insert: return XK_Insert;
-        case Qt::Key_Shift: return XK_Shift_L;
-        case Qt::Key_Control: return XK_Control_L;
-        case Qt::Key_Alt: return XK_Alt_L;
-        case Qt::Key_Meta: return XK_Super_L;
-        case Qt::Key_AltGr: return XK_ISO_Level3_Shift;
-        case Qt::Key_CapsLock: return XK_Caps_Lock;
-        case Qt::Key_NumLock: return XK_Num_Lock;
-        case Qt::Key_ScrollLock: return XK_Scroll_Lock;
-        case Qt::Key_F1: return XK_F1;
-        case Qt::Key_F2: return XK_F2;
-        case Qt::Key_F3: return XK_F3;
-        case Qt::Key_F4: return XK_F4;
-        case Qt::Key_F5: return XK_F5;
-        case Qt::Key_F6: return XK_F6;
-        case Qt::Key_F7: return XK_F7;
-        case Qt::Key_F8: return XK_F8;
-        case Qt::Key_F9: return XK_F9;
-        case Qt::Key_F10: return XK_F10;
-        case Qt::Key_F11: return XK_F11;
-        case Qt::Key_F12: return XK_F12;
-        default:
-            // For unhandled keys, try to return the Qt key value directly
-            return qtKey;
-    }
+    
+    SessionMetrics::add(m_metrics.paints);
+    SessionMetrics::add(m_metrics.paintNanos, paintTimer.nsecsElapsed());
 }
 
 void MainWindow::keyPressEvent(QKeyEvent *event)
 {
+    TRACE_SPAN("keyPressEvent");
 #ifdef _WIN32
     // Check for F12 to show popup menu
     if (event->key() == Qt::Key_F12) {
@@ -442,18 +1236,30 @@ void MainWindow::keyPressEvent(QKeyEvent *event)
     }
 #endif
     
+    if (isViewportKey(event)) {
+        handleViewportKey(event);
+        event->accept();
+        return;
+    }
+    
     if (m_connected && m_client && !m_readOnly) {
         uint32_t keysym = qtKeyToX11Keysym(event->key(), event->modifiers(), event->text());
-        SendKeyEvent(m_client, keysym, TRUE);
+        sendKeyEvent(keysym, true);
     }
     QMainWindow::keyPressEvent(event);
 }
 
 void MainWindow::keyReleaseEvent(QKeyEvent *event)
 {
+    TRACE_SPAN("keyReleaseEvent");
+    if (isViewportKey(event)) {
+        event->accept();
+        return;
+    }
+    
     if (m_connected && m_client && !m_readOnly) {
         uint32_t keysym = qtKeyToX11Keysym(event->key(), event->modifiers(), event->text());
-        SendKeyEvent(m_client, keysym, FALSE);
+        sendKeyEvent(keysym, false);
     }
     QMainWindow::keyReleaseEvent(event);
 }
@@ -479,6 +1285,7 @@ void MainWindow::focusOutEvent(QFocusEvent *event)
 
 void MainWindow::mouseMoveEvent(QMouseEvent *event)
 {
+    TRACE_SPAN("mouseMoveEvent");
     // Handle window resizing
     if (isResizing && event->buttons() & Qt::LeftButton) {
         QPoint delta = event->globalPosition().toPoint() - resizeStartPos;
@@ -552,15 +1359,9 @@ void MainWindow::mouseMoveEvent(QMouseEvent *event)
     } else if (m_connected && m_client && !m_readOnly && event->pos().y() >= TITLE_BAR_HEIGHT && !onLeft && !onRight && !onTop && !onBottom) {
         setCursor(Qt::ArrowCursor);
         
-        QRect scaledRect = getScaledFramebufferRect();
-        if (scaledRect.contains(event->pos())) {
-            int x = std::round((event->position().x() - scaledRect.x()) / static_cast<double>(scaledRect.width()) * m_client->width);
-            int y = std::round((event->position().y() - scaledRect.y()) / static_cast<double>(scaledRect.height()) * m_client->height);
-            
-            x = std::clamp(x, 0, m_client->width - 1);
-            y = std::clamp(y, 0, m_client->height - 1);
-            
-            SendPointerEvent(m_client, x, y, m_buttonMask);
+        int x, y;
+        if (mapToRemote(event->position(), x, y)) {
+            sendPointerEvent(x, y, m_buttonMask);
             m_pointerSyncedSinceToggle = true;
         }
     }
@@ -568,6 +1369,7 @@ void MainWindow::mouseMoveEvent(QMouseEvent *event)
 
 void MainWindow::mousePressEvent(QMouseEvent *event)
 {
+    TRACE_SPAN("mousePressEvent");
     if (buttonRect.contains(event->pos())) {
         m_readOnly = !m_readOnly;
         isToggled = m_readOnly;
@@ -638,21 +1440,21 @@ void MainWindow::mousePressEvent(QMouseEvent *event)
         return;
     }
     
+    // A click on a past frame goes back to the live desktop rather than acting on what is not shown
+    if (!m_rewindFrame.isNull() && event->pos().y() >= TITLE_BAR_HEIGHT) {
+        showLive();
+        return;
+    }
+    
     if (m_connected && m_client && !m_readOnly && event->pos().y() >= TITLE_BAR_HEIGHT) {
-        QRect scaledRect = getScaledFramebufferRect();
-        if (!scaledRect.contains(event->pos())) {
+        int x, y;
+        if (!mapToRemote(event->position(), x, y)) {
             return;
         }
-        
-        int x = std::round((event->position().x() - scaledRect.x()) / static_cast<double>(scaledRect.width()) * m_client->width);
-        int y = std::round((event->position().y() - scaledRect.y()) / static_cast<double>(scaledRect.height()) * m_client->height);
-
-        x = std::clamp(x, 0, m_client->width - 1);
-        y = std::clamp(y, 0, m_client->height - 1);
 
         // If pointer hasn't been synced since toggling to active, force a move first
         if (!m_pointerSyncedSinceToggle) {
-            SendPointerEvent(m_client, x, y, 0);
+            sendPointerEvent(x, y, 0);
             m_pointerSyncedSinceToggle = true;
         }
 
@@ -667,12 +1469,13 @@ void MainWindow::mousePressEvent(QMouseEvent *event)
         }
         
         m_buttonMask |= buttonMask;
-        SendPointerEvent(m_client, x, y, m_buttonMask);
+        sendPointerEvent(x, y, m_buttonMask);
     }
 }
 
 void MainWindow::mouseReleaseEvent(QMouseEvent *event)
 {
+    TRACE_SPAN("mouseReleaseEvent");
     isDragging = false;
     isResizing = false;
     
@@ -689,15 +1492,367 @@ void MainWindow::mouseReleaseEvent(QMouseEvent *event)
         
         m_buttonMask &= ~buttonMask;
         
-        QRect scaledRect = getScaledFramebufferRect();
-        int x = std::round((event->position().x() - scaledRect.x()) / static_cast<double>(scaledRect.width()) * m_client->width);
-        int y = std::round((event->position().y() - scaledRect.y()) / static_cast<double>(scaledRect.height()) * m_client->height);
-        
-        x = std::clamp(x, 0, m_client->width - 1);
-        y = std::clamp(y, 0, m_client->height - 1);
+        // Release is sent even outside the framebuffer area (clamped to the nearest edge)
+        int x, y;
+        mapToRemote(event->position(), x, y);
         
-        SendPointerEvent(m_client, x, y, m_buttonMask);
+        sendPointerEvent(x, y, m_buttonMask);
+    }
+}
+
+void MainWindow::sendPointerEvent(int x, int y, int buttonMask)
+{
+    if (m_primary) {
+        if (m_primary->m_connected) {
+            m_primary->sendPointerEvent(x, y, buttonMask);
+        }
+        return;
+    }
+    m_latencyProbe.inputSent(QRect(x - LATENCY_PROBE_RADIUS, y - LATENCY_PROBE_RADIUS,
+                                   2 * LATENCY_PROBE_RADIUS, 2 * LATENCY_PROBE_RADIUS));
+    SendPointerEvent(m_client, x, y, buttonMask);
+    SessionMetrics::add(m_metrics.pointerEvents);
+}
+
+void MainWindow::sendKeyEvent(uint32_t keysym, bool down)
+{
+    if (m_primary) {
+        if (m_primary->m_connected) {
+            m_primary->sendKeyEvent(keysym, down);
+        }
+        return;
+    }
+    if (down) {
+        m_latencyProbe.inputSent(QRect());
+    }
+    SendKeyEvent(m_client, keysym, down ? TRUE : FALSE);
+    SessionMetrics::add(m_metrics.keyEvents);
+}
+
+void MainWindow::refreshMetrics()
+{
+    // The socket reader counts exact bytes; without it the kernel's TCP statistics are used
+    if (m_socketPump.isRunning()) {
+        m_metrics.bytesIn.store(m_socketPump.bytesIn(), std::memory_order_relaxed);
+        m_metrics.bytesOut.store(m_socketPump.bytesOut(), std::memory_order_relaxed);
+        m_metrics.pacedNanos.store(m_socketPump.pacedNanos(), std::memory_order_relaxed);
+        return;
+    }
+    SocketTraffic traffic;
+    if (m_connected && m_client && querySocketTraffic(m_client->sock, traffic)) {
+        m_metrics.bytesIn.store(traffic.bytesIn, std::memory_order_relaxed);
+        m_metrics.bytesOut.store(traffic.bytesOut, std::memory_order_relaxed);
+    }
+}
+
+void MainWindow::sampleLink()
+{
+    if (!m_connected) {
+        m_linkTimer->stop();
+        return;
+    }
+    refreshMetrics();
+    uint64_t rttUs = m_socketPump.rttUs();
+    SocketTraffic traffic;
+    if (!m_socketPump.isRunning() && m_client && querySocketTraffic(m_client->sock, traffic)) {
+        rttUs = traffic.rttUs;
     }
+    m_linkSampler.sample(m_metrics.bytesIn.load(std::memory_order_relaxed),
+                         m_metrics.decodeNanos.load(std::memory_order_relaxed),
+                         m_metrics.pacedNanos.load(std::memory_order_relaxed),
+                         m_metrics.decodedPixels.load(std::memory_order_relaxed), rttUs, steadyNanos());
+}
+
+void MainWindow::saveLinkProfile()
+{
+    LinkSession session = m_linkSampler.result();
+    if (!session.isValid()) {
+        return;
+    }
+    QSettings settings("wvncc", "wvncc");
+    QString serverKey = QString::fromStdString(m_serverKey);
+    LinkProfile link = LinkProfile::load(settings, serverKey);
+    link.learn(session);
+    link.save(settings, serverKey);
+    m_linkSampler.reset(LinkProfile::preferredEncoding(m_profile.encodings));
+}
+
+uint64_t MainWindow::receivedBytes()
+{
+    // VNC thread: same sources as refreshMetrics
+    if (m_socketPump.isRunning()) {
+        return m_socketPump.bytesIn();
+    }
+    SocketTraffic traffic;
+    if (m_client && querySocketTraffic(m_client->sock, traffic)) {
+        return traffic.bytesIn;
+    }
+    return 0;
+}
+
+void MainWindow::setBandwidthBudgetLive(qint64 bytesPerSecond)
+{
+    // Applies to every session at once and is what sessions starting later pick up
+    m_bandwidthBudget.setBytesPerSecond(bytesPerSecond);
+    QSettings settings("wvncc", "wvncc");
+    settings.setValue("bandwidthBudget", bytesPerSecond);
+}
+
+void MainWindow::startControlServer(const QString &name)
+{
+    // Scripted input is sent even in read-only mode; read-only only guards local input
+    m_inputQueue = new InputQueue([this](const InputEvent &event) {
+        if (!(m_connected && m_client)) {
+            return;
+        }
+        if (event.type == InputEvent::Key) {
+            sendKeyEvent(event.keysym, event.down);
+        } else {
+            sendPointerEvent(event.x, event.y, event.buttonMask);
+        }
+    }, this);
+    
+    m_regionWatcher = new RegionWatcher(this);
+    m_controlServer = new ControlServer(m_inputQueue, m_regionWatcher, [this]() { return controlInfo(); }, this);
+    if (!m_controlServer->listen(name)) {
+        delete m_controlServer;
+        m_controlServer = nullptr;
+    }
+}
+
+FramebufferView MainWindow::framebufferView() const
+{
+    FramebufferView view;
+    view.pixels = m_client->frameBuffer;
+    view.width = m_client->width;
+    view.height = m_client->height;
+    view.bytesPerPixel = m_client->format.bitsPerPixel / 8;
+    view.stride = view.width * view.bytesPerPixel;
+    return view;
+}
+
+void MainWindow::showRewindFrame(int64_t timeNs)
+{
+    int64_t frameNs = 0;
+    QImage frame = m_rewindBuffer.frameAt(timeNs, &frameNs);
+    if (frame.isNull()) {
+        showLive();
+        return;
+    }
+    m_rewindFrame = frame;
+    m_rewindFrameNs = frameNs;
+    m_rewindFrameTime = QTime::currentTime().addMSecs(static_cast<int>(-(steadyNanos() - frameNs) / 1000000)).toString("HH:mm:ss");
+    update();
+}
+
+void MainWindow::showLive()
+{
+    if (m_rewindFrame.isNull()) {
+        return;
+    }
+    // The image points into the rebuild buffer, let go of it first
+    m_rewindFrame = QImage();
+    m_rewindBuffer.releaseFrame();
+    update();
+}
+
+void MainWindow::updateBackgroundState()
+{
+    // Only a framebuffer nothing else reads can be compressed: not shared, not split across windows
+    bool background = (isMinimized() || !isVisible()) && m_connected && !m_shareFramebuffer &&
+                      !m_primary && m_monitorWindows.empty();
+    if (!background) {
+        m_backgroundTimer->stop();
+        m_background = false;
+    } else if (!m_background && !m_backgroundTimer->isActive()) {
+        m_backgroundTimer->start();
+    }
+}
+
+void MainWindow::applyBackgroundState()
+{
+    // VNC thread, between messages
+    bool background = m_background.load();
+    if (background == m_backgroundApplied) {
+        return;
+    }
+    m_backgroundApplied = background;
+    FramebufferView view = framebufferView();
+    size_t bytes = static_cast<size_t>(view.stride) * view.height;
+    if (background) {
+        if (m_compressedFramebuffer.compress(view)) {
+            std::cout << "[INFO] Background framebuffer compressed from " << bytes / 1024 << " KB to "
+                      << m_compressedFramebuffer.compressedBytes() / 1024 << " KB" << std::endl;
+            // Rectangles decoded meanwhile are not hashed, so the grid starts over on restore
+            m_tileHashes.reset();
+            // A hidden session keeps no history; recording starts over with a keyframe
+            m_rewindBuffer.suspend();
+            // Nor anything else sized by the desktop or the window: a hidden window does not paint
+            releaseSpareFramebuffer(m_localFramebufferGeneration);
+            QMetaObject::invokeMethod(this, [this]() {
+                if (m_background) {
+                    m_presentation.release();
+                }
+            }, Qt::QueuedConnection);
+        }
+    } else if (m_compressedFramebuffer.isActive()) {
+        m_compressedFramebuffer.restore(view);
+        QMetaObject::invokeMethod(this, [this]() { update(); }, Qt::QueuedConnection);
+    }
+}
+
+void MainWindow::changeEvent(QEvent *event)
+{
+    if (event->type() == QEvent::WindowStateChange && m_backgroundTimer) {
+        updateBackgroundState();
+    }
+    QMainWindow::changeEvent(event);
+}
+
+void MainWindow::showEvent(QShowEvent *event)
+{
+    if (m_backgroundTimer) {
+        updateBackgroundState();
+    }
+    QMainWindow::showEvent(event);
+}
+
+void MainWindow::hideEvent(QHideEvent *event)
+{
+    if (m_backgroundTimer) {
+        updateBackgroundState();
+    }
+    QMainWindow::hideEvent(event);
+}
+
+void MainWindow::typeClipboard()
+{
+    QString text = QApplication::clipboard()->text();
+    if (text.isEmpty() || !(m_connected && m_client) || m_readOnly) {
+        return;
+    }
+    QSettings settings("wvncc", "wvncc");
+    int interval = settings.value(QString::fromStdString(m_serverKey) + "/typingIntervalMs", DEFAULT_TYPING_INTERVAL_MS).toInt();
+    std::vector<InputEvent> events = typingEvents(text, std::max(0, interval));
+    m_typingTotal = static_cast<int>(events.size());
+    std::cout << "[INFO] Typing " << text.size() << " characters (" << events.size() << " key events)" << std::endl;
+    m_typingQueue->enqueue(events, [this](int sent) {
+        if (sent < m_typingTotal) {
+            std::cout << "[INFO] Typing stopped after " << sent << " of " << m_typingTotal << " key events" << std::endl;
+        }
+        m_typingTotal = 0;
+    });
+}
+
+void MainWindow::cancelTyping()
+{
+    m_typingQueue->clear();
+    // Nothing may stay pressed on the server (auto-repeat, a stuck Shift)
+    std::vector<uint32_t> held;
+    held.swap(m_typingHeldKeys);
+    for (auto it = held.rbegin(); it != held.rend(); ++it) {
+        if (m_connected && m_client) {
+            sendKeyEvent(*it, false);
+        }
+    }
+}
+
+QJsonObject MainWindow::controlInfo()
+{
+    QJsonObject info;
+    info["connected"] = m_connected.load();
+    
+    std::lock_guard<std::mutex> lock(m_sharedFramebufferMutex);
+    const SharedFramebuffer &current = m_sharedFramebuffers[m_sharedFramebufferGeneration & 1];
+    if (!current.isValid()) {
+        return info;
+    }
+    
+    const SharedFramebufferHeader *header = current.header();
+    info["width"] = static_cast<int>(header->width);
+    info["height"] = static_cast<int>(header->height);
+    info["bitsPerPixel"] = static_cast<int>(header->bitsPerPixel);
+    
+    QJsonObject shm;
+    shm["name"] = QString::fromStdString(current.name());
+    shm["pixelOffset"] = static_cast<qint64>(header->pixelOffset);
+    shm["stride"] = static_cast<qint64>(header->stride);
+    shm["size"] = static_cast<qint64>(current.pixelBytes());
+    info["shm"] = shm;
+    return info;
+}
+
+void MainWindow::openMonitorWindows(const QList<QRect> &screens)
+{
+    for (int i = 1; i < screens.size(); i++) {
+        MainWindow *window = new MainWindow();
+        window->attachToMonitor(this, i, screens[i]);
+        m_monitorWindows.push_back(window);
+    }
+}
+
+void MainWindow::attachToMonitor(MainWindow *primary, int index, const QRect &screen)
+{
+    m_primary = primary;
+    m_client = primary->m_client;
+    m_connected = true;
+    m_screenRect = screen;
+    m_readOnly = primary->m_readOnly;
+    isToggled = m_readOnly;
+    m_serverKey = primary->m_serverKey + "/screen" + std::to_string(index);
+    setWindowTitle(QString("%1 [%2]").arg(primary->windowTitle()).arg(index + 1));
+    
+    QSettings settings("wvncc", "wvncc");
+    QString serverKey = QString::fromStdString(m_serverKey);
+    if (settings.contains(serverKey + "/windowSize")) {
+        move(settings.value(serverKey + "/windowPosition").toPoint());
+        resize(settings.value(serverKey + "/windowSize").toSize());
+    } else {
+        // The matching local monitor when there are enough, otherwise cascade from the primary window
+        QList<QScreen *> monitors = localMonitorsLeftToRight();
+        QRect available = index < monitors.size()
+            ? monitors[index]->availableGeometry()
+            : primary->geometry().translated(MONITOR_WINDOW_CASCADE * index, MONITOR_WINDOW_CASCADE * index);
+        QSize target = QSize(screen.width(), screen.height() + TITLE_BAR_HEIGHT).boundedTo(available.size());
+        resize(target);
+        move(available.center() - QPoint(target.width() / 2, target.height() / 2));
+    }
+    
+    if (primary->m_alwaysOnTop) {
+        m_alwaysOnTop = true;
+        setWindowFlags(windowFlags() | Qt::WindowStaysOnTopHint);
+    }
+    show();
+}
+
+void MainWindow::startFanout()
+{
+    // Created before the VNC thread starts, which reads m_fanout without a lock
+    FanoutServer *fanout = new FanoutServer(this);
+    if (!fanout->start(m_client, m_sharePort)) {
+        delete fanout;
+        return;
+    }
+    
+    // Follower input arrives on LibVNCServer's threads; send it upstream from this one.
+    // It does not go through the read-only toggle, which only guards this window's own input.
+    connect(fanout, &FanoutServer::pointerEvent, this, [this](int x, int y, int buttonMask) {
+        if (m_connected && m_client) {
+            sendPointerEvent(x, y, buttonMask);
+        }
+    }, Qt::QueuedConnection);
+    connect(fanout, &FanoutServer::keyEvent, this, [this](uint32_t keysym, bool down) {
+        if (m_connected && m_client) {
+            sendKeyEvent(keysym, down);
+        }
+    }, Qt::QueuedConnection);
+    connect(fanout, &FanoutServer::clipboardText, this, [this](const QByteArray &text) {
+        if (m_connected && m_client) {
+            SendClientCutText(m_client, const_cast<char *>(text.constData()), text.size());
+            SessionMetrics::add(m_metrics.clipboardEvents);
+        }
+    }, Qt::QueuedConnection);
+    m_fanout = fanout;
 }
 
 void MainWindow::syncPointerToCurrentCursor()
@@ -709,32 +1864,272 @@ void MainWindow::syncPointerToCurrentCursor()
     QPoint globalPos = QCursor::pos();
     QPoint localPos = mapFromGlobal(globalPos);
 
-    QRect scaledRect = getScaledFramebufferRect();
-    if (!scaledRect.contains(localPos)) {
+    int x, y;
+    if (!mapToRemote(localPos, x, y)) {
         return;
     }
 
-    int x = std::round((localPos.x() - scaledRect.x()) / static_cast<double>(scaledRect.width()) * m_client->width);
-    int y = std::round((localPos.y() - scaledRect.y()) / static_cast<double>(scaledRect.height()) * m_client->height);
+    sendPointerEvent(x, y, m_buttonMask);
+}
 
-    x = std::clamp(x, 0, m_client->width - 1);
-    y = std::clamp(y, 0, m_client->height - 1);
+QRect MainWindow::getScaledFramebufferRect() const
+{
+    return getViewportMapping().target;
+}
 
-    SendPointerEvent(m_client, x, y, m_buttonMask);
+ViewportMapping MainWindow::getViewportMapping() const
+{
+    if (m_framebuffer.isNull()) {
+        return ViewportMapping();
+    }
+    QRect targetRect(0, TITLE_BAR_HEIGHT, width(), height() - TITLE_BAR_HEIGHT);
+    return computeViewportMapping(m_framebuffer.size(), targetRect, m_zoom, m_viewCenter);
 }
 
-QRect MainWindow::getScaledFramebufferRect() const
+bool MainWindow::mapToRemote(const QPointF &pos, int &x, int &y) const
 {
-    if (!m_framebuffer.isNull()) {
-        QRect targetRect(0, TITLE_BAR_HEIGHT, width(), height() - TITLE_BAR_HEIGHT);
-        QSize scaledSize = m_framebuffer.size().scaled(targetRect.size(), Qt::KeepAspectRatio);
-        
-        int x = (targetRect.width() - scaledSize.width()) / 2;
-        int y = targetRect.y() + (targetRect.height() - scaledSize.height()) / 2;
-        
-        return QRect(x, y, scaledSize.width(), scaledSize.height());
+    x = 0;
+    y = 0;
+    if (!m_client) {
+        return false;
+    }
+    
+    ViewportMapping mapping = getViewportMapping();
+    if (!mapping.isValid()) {
+        return false;
+    }
+    
+    // The mapping is relative to this window's monitor
+    QRect area = screenArea(m_client->width, m_client->height);
+    QPointF remote = mapping.toRemote(pos);
+    x = area.x() + std::clamp(static_cast<int>(std::round(remote.x())), 0, area.width() - 1);
+    y = area.y() + std::clamp(static_cast<int>(std::round(remote.y())), 0, area.height() - 1);
+    return mapping.target.contains(pos.toPoint());
+}
+
+void MainWindow::setZoom(double zoom, const QPointF &anchor)
+{
+    if (m_framebuffer.isNull()) {
+        return;
+    }
+    
+    QRect targetRect(0, TITLE_BAR_HEIGHT, width(), height() - TITLE_BAR_HEIGHT);
+    ViewportMapping before = getViewportMapping();
+    
+    // Zooming out past the fit scale returns to fit mode
+    if (zoom > 0.0 && zoom <= fitScale(m_framebuffer.size(), targetRect)) {
+        zoom = 0.0;
+    }
+    zoom = std::min(zoom, MAX_ZOOM);
+    
+    // Keep the remote point under the anchor fixed on screen
+    if (zoom > 0.0 && before.isValid()) {
+        QPointF remote = before.toRemote(anchor);
+        QPointF offset = anchor - QRectF(targetRect).center();
+        m_viewCenter = remote - offset / zoom;
+    }
+    
+    m_zoom = zoom;
+    updateRequestedRegion();
+    update();
+}
+
+void MainWindow::zoomBy(double factor, const QPointF &anchor)
+{
+    QRect targetRect(0, TITLE_BAR_HEIGHT, width(), height() - TITLE_BAR_HEIGHT);
+    double current = (m_zoom > 0.0) ? m_zoom : fitScale(m_framebuffer.size(), targetRect);
+    setZoom(current * factor, anchor);
+}
+
+void MainWindow::panBy(double dx, double dy)
+{
+    if (m_zoom <= 0.0) {
+        return;
+    }
+    
+    // Re-center from the clamped mapping so panning past an edge doesn't accumulate
+    ViewportMapping mapping = getViewportMapping();
+    if (!mapping.isValid()) {
+        return;
+    }
+    m_viewCenter = mapping.source.center() + QPointF(dx, dy) / m_zoom;
+    updateRequestedRegion();
+    update();
+}
+
+bool MainWindow::isViewportKey(const QKeyEvent *event) const
+{
+    Qt::KeyboardModifiers modifiers = event->modifiers() & (Qt::ControlModifier | Qt::ShiftModifier | Qt::AltModifier | Qt::MetaModifier);
+    
+    // In active mode plain keys belong to the remote desktop, so zoom/pan needs Ctrl+Shift
+    if (!m_readOnly && modifiers != (Qt::ControlModifier | Qt::ShiftModifier)) {
+        return false;
+    }
+    
+    switch (event->key()) {
+        case Qt::Key_Plus:
+        case Qt::Key_Equal:
+        case Qt::Key_Minus:
+        case Qt::Key_Underscore:
+        case Qt::Key_0:
+        case Qt::Key_ParenRight:
+            return true;
+        case Qt::Key_Left:
+        case Qt::Key_Right:
+        case Qt::Key_Up:
+        case Qt::Key_Down:
+            return m_zoom > 0.0;
+        default:
+            return false;
+    }
+}
+
+void MainWindow::handleViewportKey(QKeyEvent *event)
+{
+    QPointF center = QRectF(0, TITLE_BAR_HEIGHT, width(), height() - TITLE_BAR_HEIGHT).center();
+    
+    switch (event->key()) {
+        case Qt::Key_Plus:
+        case Qt::Key_Equal:
+            zoomBy(ZOOM_STEP, center);
+            break;
+        case Qt::Key_Minus:
+        case Qt::Key_Underscore:
+            zoomBy(1.0 / ZOOM_STEP, center);
+            break;
+        case Qt::Key_0:
+        case Qt::Key_ParenRight:
+            setZoom(0.0, center);
+            break;
+        case Qt::Key_Left:
+            panBy(-PAN_STEP, 0);
+            break;
+        case Qt::Key_Right:
+            panBy(PAN_STEP, 0);
+            break;
+        case Qt::Key_Up:
+            panBy(0, -PAN_STEP);
+            break;
+        case Qt::Key_Down:
+            panBy(0, PAN_STEP);
+            break;
+    }
+}
+
+void MainWindow::updateRequestedRegion()
+{
+    if (m_framebuffer.isNull()) {
+        return;
+    }
+    m_debugOverlay->setFramebufferSize(m_framebuffer.size());
+    if (m_primary || !m_client) {
+        return;
+    }
+    
+    // Fit mode needs the whole desktop; zoomed mode only the viewport plus a prefetch margin.
+    // Local viewers of a shared session and the other monitors' windows may be looking anywhere,
+    // so those keep the whole desktop.
+    QRect rect;
+    if (m_zoom > 0.0 && !m_fanout && m_monitorWindows.empty()) {
+        rect = getViewportMapping().requestRect(m_framebuffer.size(), PREFETCH_MARGIN);
+    } else {
+        rect = QRect(0, 0, m_client->width, m_client->height);
+    }
+    
+    std::lock_guard<std::mutex> lock(m_requestMutex);
+    if (rect != m_requestRect) {
+        m_requestRect = rect;
+        m_requestRectChanged = true;
+    }
+}
+
+void MainWindow::applyRequestedRegion()
+{
+    // Runs on the VNC thread, between messages
+    if (!m_requestRectChanged.exchange(false)) {
+        return;
+    }
+    
+    QRect rect;
+    {
+        std::lock_guard<std::mutex> lock(m_requestMutex);
+        rect = m_requestRect;
+    }
+    rect &= QRect(0, 0, m_client->width, m_client->height);
+    if (rect.isEmpty()) {
+        return;
+    }
+    
+    QRect previous(m_client->updateRect.x, m_client->updateRect.y, m_client->updateRect.w, m_client->updateRect.h);
+    
+    // libvncclient uses updateRect for every following incremental request
+    m_client->updateRect.x = rect.x();
+    m_client->updateRect.y = rect.y();
+    m_client->updateRect.w = rect.width();
+    m_client->updateRect.h = rect.height();
+    
+    // Pixels outside the previous region are stale, fetch the new region in full once
+    if (!previous.contains(rect)) {
+        SendFramebufferUpdateRequest(m_client, rect.x(), rect.y(), rect.width(), rect.height(), FALSE);
+    }
+}
+
+void MainWindow::resizeEvent(QResizeEvent *event)
+{
+    QMainWindow::resizeEvent(event);
+    if (m_debugOverlay) {
+        m_debugOverlay->setGeometry(rect());
+    }
+    updateRequestedRegion();
+    
+    if (m_remoteResize && m_remoteResizeFailures < REMOTE_RESIZE_MAX_FAILURES) {
+        m_remoteResizeTimer->start();
     }
-    return QRect();
+}
+
+void MainWindow::requestRemoteResize()
+{
+    if (!m_connected || !m_client || !m_remoteResize || m_remoteResizeFailures >= REMOTE_RESIZE_MAX_FAILURES) {
+        return;
+    }
+    // A window per monitor shows the remote layout as it is
+    if (m_primary || !m_monitorWindows.empty()) {
+        return;
+    }
+    
+    // Request device pixels so the framebuffer is drawn 1:1 without scaling
+    qreal ratio = devicePixelRatioF();
+    QSize desired(qRound(width() * ratio), qRound((height() - TITLE_BAR_HEIGHT) * ratio));
+    desired = desired.boundedTo(QSize(16384, 16384)).expandedTo(QSize(64, 64));
+    
+    QSize current(m_client->width, m_client->height);
+    if (desired == current || desired == m_remoteResizeRequested) {
+        return;
+    }
+    
+    std::cout << "[INFO] Requesting remote desktop size " << desired.width() << "x" << desired.height() << std::endl;
+    m_remoteSizeBeforeRequest = current;
+    m_remoteResizeRequested = desired;
+    SendExtDesktopSize(m_client, desired.width(), desired.height());
+    m_remoteResizeCheckTimer->start();
+}
+
+void MainWindow::checkRemoteResize()
+{
+    if (!m_connected || !m_client) {
+        return;
+    }
+    
+    // Servers may round the size, so any change counts as accepted. The next window resize
+    // asks again until the server has ignored several requests in a row.
+    QSize current(m_client->width, m_client->height);
+    if (current != m_remoteSizeBeforeRequest) {
+        m_remoteResizeFailures = 0;
+    } else if (++m_remoteResizeFailures >= REMOTE_RESIZE_MAX_FAILURES) {
+        std::cout << "[INFO] Server did not resize the desktop after " << m_remoteResizeFailures
+                  << " requests, falling back to scaling" << std::endl;
+    }
+    m_remoteResizeRequested = QSize();
 }
 
 void MainWindow::mouseDoubleClickEvent(QMouseEvent *event)
@@ -752,21 +2147,49 @@ void MainWindow::mouseDoubleClickEvent(QMouseEvent *event)
 
 void MainWindow::wheelEvent(QWheelEvent *event)
 {
+    TRACE_SPAN("wheelEvent");
+    // Ctrl+wheel zooms around the pointer (Ctrl+Shift+wheel in active mode);
+    // in read-only mode the plain wheel pans the zoomed view (Shift for horizontal)
+    Qt::KeyboardModifiers modifiers = event->modifiers();
+    bool zoomModifier = m_readOnly ? (modifiers & Qt::ControlModifier)
+                                   : (modifiers & Qt::ControlModifier) && (modifiers & Qt::ShiftModifier);
+    if (zoomModifier && event->position().y() >= TITLE_BAR_HEIGHT) {
+        int delta = event->angleDelta().y() != 0 ? event->angleDelta().y() : event->angleDelta().x();
+        if (delta != 0) {
+            zoomBy(delta > 0 ? ZOOM_STEP : 1.0 / ZOOM_STEP, event->position());
+        }
+        event->accept();
+        return;
+    }
+    if (m_readOnly && m_zoom > 0.0) {
+        double notchesX = event->angleDelta().x() / 120.0;
+        double notchesY = event->angleDelta().y() / 120.0;
+        if (modifiers & Qt::ShiftModifier) {
+            panBy(-notchesY * PAN_STEP, 0);
+        } else {
+            panBy(-notchesX * PAN_STEP, -notchesY * PAN_STEP);
+        }
+        event->accept();
+        return;
+    }
+    
     if (m_connected && m_client && !m_readOnly && event->position().y() >= TITLE_BAR_HEIGHT) {
-        QRect scaledRect = getScaledFramebufferRect();
-        if (scaledRect.contains(event->position().toPoint())) {
-            int x = std::round((event->position().x() - scaledRect.x()) / static_cast<double>(scaledRect.width()) * m_client->width);
-            int y = std::round((event->position().y() - scaledRect.y()) / static_cast<double>(scaledRect.height()) * m_client->height);
-            
-            x = std::clamp(x, 0, m_client->width - 1);
-            y = std::clamp(y, 0, m_client->height - 1);
-            
+        int x, y;
+        if (mapToRemote(event->position(), x, y)) {
             // VNC uses buttons 4 (scroll up) and 5 (scroll down)
             int scrollButton = (event->angleDelta().y() > 0) ? 8 : 16;  // Button 4 = 0x08, Button 5 = 0x10
             
             // Send scroll down, then up (simulating a button click)
-            SendPointerEvent(m_client, x, y, m_buttonMask | scrollButton);
-            SendPointerEvent(m_client, x, y, m_buttonMask);
+            sendPointerEvent(x, y, m_buttonMask | scrollButton);
+            sendPointerEvent(x, y, m_buttonMask);
+            
+            // Show the scroll the server will most likely answer with right away
+            MainWindow *owner = m_primary ? m_primary : this;
+            if (scrollPredictor().wheelSent(QPoint(x, y), scrollButton == 8)) {
+                owner->predictionChanged();
+                // Unanswered predictions are dropped after a few round trips
+                QTimer::singleShot(scrollPredictor().timeout() + std::chrono::milliseconds(10), owner, &MainWindow::predictionChanged);
+            }
         }
     }
     QMainWindow::wheelEvent(event);
@@ -795,8 +2218,11 @@ bool MainWindow::event(QEvent *event)
 
 void MainWindow::onClipboardChanged()
 {
+    TRACE_SPAN("onClipboardChanged");
+    
     // Don't send clipboard updates if we're updating it from the server
-    if (m_updatingClipboard || !m_connected || !m_client || m_readOnly) {
+    // Only the primary window sends the clipboard, once for all monitors
+    if (m_updatingClipboard || !m_connected || !m_client || m_readOnly || m_primary) {
         return;
     }
     
@@ -804,6 +2230,7 @@ void MainWindow::onClipboardChanged()
     if (!clipboardText.isEmpty()) {
         QByteArray utf8Text = clipboardText.toUtf8();
         SendClientCutText(m_client, utf8Text.data(), utf8Text.length());
+        SessionMetrics::add(m_metrics.clipboardEvents);
     }
 }
 
@@ -849,6 +2276,170 @@ void MainWindow::showPopupMenu()
     QAction* resetAction = menu.addAction("Reset to &1:1 Scale");
     connect(resetAction, &QAction::triggered, this, &MainWindow::resetWindowTo1To1);
     
+    // Zoom/pan submenu; shortcuts need Ctrl+Shift in active mode
+    QMenu* zoomMenu = menu.addMenu("&Zoom");
+    QPointF viewCenter = QRectF(0, TITLE_BAR_HEIGHT, width(), height() - TITLE_BAR_HEIGHT).center();
+    QAction* zoomInAction = zoomMenu->addAction("Zoom &In\tCtrl+Shift++");
+    connect(zoomInAction, &QAction::triggered, this, [this, viewCenter]() {
+        zoomBy(ZOOM_STEP, viewCenter);
+    });
+    QAction* zoomOutAction = zoomMenu->addAction("Zoom &Out\tCtrl+Shift+-");
+    zoomOutAction->setEnabled(m_zoom > 0.0);
+    connect(zoomOutAction, &QAction::triggered, this, [this, viewCenter]() {
+        zoomBy(1.0 / ZOOM_STEP, viewCenter);
+    });
+    QAction* actualPixelsAction = zoomMenu->addAction("&Actual Pixels");
+    connect(actualPixelsAction, &QAction::triggered, this, [this, viewCenter]() {
+        setZoom(1.0, viewCenter);
+    });
+    QAction* fitAction = zoomMenu->addAction("&Fit to Window\tCtrl+Shift+0");
+    fitAction->setCheckable(true);
+    fitAction->setChecked(m_zoom <= 0.0);
+    connect(fitAction, &QAction::triggered, this, [this, viewCenter]() {
+        setZoom(0.0, viewCenter);
+    });
+    
+    // Resize remote desktop to window action
+    QAction* remoteResizeAction = menu.addAction("Resize &Remote to Window");
+    remoteResizeAction->setCheckable(true);
+    remoteResizeAction->setChecked(m_remoteResize && m_remoteResizeFailures < REMOTE_RESIZE_MAX_FAILURES);
+    remoteResizeAction->setEnabled(m_connected && !m_primary && m_monitorWindows.empty());
+    connect(remoteResizeAction, &QAction::triggered, this, [this](bool checked) {
+        // Checking it again after the fallback gives the server another chance
+        m_remoteResize = checked;
+        m_remoteResizeFailures = 0;
+        m_remoteResizeRequested = QSize();
+        if (m_remoteResize) {
+            requestRemoteResize();
+        }
+    });
+    
+    // Damage heat map and encoding overlay
+    QAction* debugOverlayAction = menu.addAction("&Debug Overlay");
+    debugOverlayAction->setCheckable(true);
+    debugOverlayAction->setChecked(m_debugOverlay->isActive());
+    debugOverlayAction->setEnabled(!m_primary);
+    connect(debugOverlayAction, &QAction::triggered, this, [this]() {
+        m_debugOverlay->setGeometry(rect());
+        if (!m_framebuffer.isNull()) {
+            m_debugOverlay->setFramebufferSize(m_framebuffer.size());
+        }
+        m_debugOverlay->setActive(!m_debugOverlay->isActive());
+    });
+    
+    // Input-to-display latency measurement
+    QAction* latencyAction = menu.addAction("Measure &Latency");
+    latencyAction->setCheckable(true);
+    latencyAction->setChecked(m_latencyProbe.isActive());
+    latencyAction->setEnabled(m_connected && !m_primary);
+    connect(latencyAction, &QAction::triggered, this, [this]() {
+        bool active = !m_latencyProbe.isActive();
+        if (!active) {
+            std::cout << "[INFO] Input latency: " << m_latencyProbe.summaryText().toStdString() << std::endl;
+        }
+        m_latencyProbe.setActive(active);
+    });
+    if (m_latencyProbe.isActive()) {
+        QAction* latencySummary = menu.addAction("    " + m_latencyProbe.summaryText());
+        latencySummary->setEnabled(false);
+    }
+    
+    // Scrubbing back through the recent history; the live stream goes on underneath
+    RewindBuffer::Span rewindSpan = m_rewindBuffer.span();
+    int64_t rewindOpenNs = steadyNanos();
+    int rewindSteps = rewindSpan.frames > 0 ? static_cast<int>((rewindOpenNs - rewindSpan.oldestNs) / REWIND_STEP_NS) : 0;
+    QWidget* rewindWidget = new QWidget(&menu);
+    QHBoxLayout* rewindLayout = new QHBoxLayout(rewindWidget);
+    rewindLayout->setContentsMargins(28, 2, 8, 2);
+    QLabel* rewindLabel = new QLabel(rewindWidget);
+    rewindLabel->setMinimumWidth(110);
+    QSlider* rewindSlider = new QSlider(Qt::Horizontal, rewindWidget);
+    rewindSlider->setMinimumWidth(200);
+    rewindSlider->setRange(0, rewindSteps);
+    rewindSlider->setEnabled(!m_primary && rewindSteps > 0);
+    if (!m_rewindFrame.isNull()) {
+        rewindSlider->setValue(static_cast<int>(std::max<int64_t>(0, (m_rewindFrameNs - rewindSpan.oldestNs) / REWIND_STEP_NS)));
+    } else {
+        rewindSlider->setValue(rewindSteps);
+    }
+    auto rewindText = [rewindLabel, rewindSteps](int value) {
+        rewindLabel->setText(value == rewindSteps ? QString("Rewind: live")
+                                                  : QString("Rewind: -%1 s").arg((rewindSteps - value) * REWIND_STEP_NS / 1e9, 0, 'f', 1));
+    };
+    rewindText(rewindSlider->value());
+    if (m_rewindBuffer.budget() == 0) {
+        rewindLabel->setText("Rewind: off");
+    }
+    connect(rewindSlider, &QSlider::valueChanged, this, [this, rewindText, rewindSteps, rewindOpenNs](int value) {
+        rewindText(value);
+        if (value == rewindSteps) {
+            showLive();
+        } else {
+            showRewindFrame(rewindOpenNs - (rewindSteps - value) * REWIND_STEP_NS);
+        }
+    });
+    rewindLayout->addWidget(rewindLabel);
+    rewindLayout->addWidget(rewindSlider);
+    QWidgetAction* rewindAction = new QWidgetAction(&menu);
+    rewindAction->setDefaultWidget(rewindWidget);
+    menu.addAction(rewindAction);
+    if (!m_rewindFrame.isNull()) {
+        QAction* liveAction = menu.addAction("Back to &Live");
+        connect(liveAction, &QAction::triggered, this, &MainWindow::showLive);
+    }
+    QAction* recordRewindAction = menu.addAction("Record Re&wind History");
+    recordRewindAction->setCheckable(true);
+    recordRewindAction->setChecked(m_rewindBudgetMB > 0);
+    recordRewindAction->setEnabled(!m_primary);
+    connect(recordRewindAction, &QAction::triggered, this, [this](bool checked) {
+        m_rewindBudgetMB = checked ? DEFAULT_REWIND_BUDGET_MB : 0;
+        if (!checked) {
+            showLive();
+        }
+        m_rewindBuffer.setBudget(static_cast<size_t>(m_rewindBudgetMB) * 1024 * 1024);
+    });
+    
+    // Speculative wheel scrolling
+    QAction* predictAction = menu.addAction("Predict &Scrolling");
+    predictAction->setCheckable(true);
+    predictAction->setChecked(m_scrollPredictor.isEnabled());
+    predictAction->setEnabled(m_connected && !m_primary);
+    connect(predictAction, &QAction::triggered, this, [this](bool checked) {
+        m_scrollPredictor.setEnabled(checked);
+        predictionChanged();
+    });
+    
+    if (m_fanout) {
+        QAction* sharingInfo = menu.addAction(QString("Sharing on 127.0.0.1:%1 (%2 viewers)")
+                                              .arg(m_sharePort).arg(m_fanout->viewerCount()));
+        sharingInfo->setEnabled(false);
+    }
+    
+    // Update pacing, applied from the next message on
+    QMenu* fpsMenu = menu.addMenu("Frame &Rate");
+    fpsMenu->setEnabled(m_connected && !m_primary);
+    for (int fps : {0, 60, 30, 15, 5, 1}) {
+        QAction* fpsAction = fpsMenu->addAction(fps == 0 ? QString("&Unlimited") : QString("%1 fps").arg(fps));
+        fpsAction->setCheckable(true);
+        fpsAction->setChecked(m_updateScheduler.maxFps() == fps);
+        connect(fpsAction, &QAction::triggered, this, [this, fps]() {
+            m_profile.maxFps = fps;
+            m_updateScheduler.setMaxFps(fps);
+        });
+    }
+    QMenu* budgetMenu = menu.addMenu("&Bandwidth Budget (All Sessions)");
+    budgetMenu->setEnabled(m_connected && !m_primary);
+    for (qint64 kbps : {0, 10240, 5120, 2048, 1024, 512, 256}) {
+        QString label = kbps == 0 ? QString("&Unlimited")
+                      : kbps >= 1024 ? QString("%1 MB/s").arg(kbps / 1024) : QString("%1 KB/s").arg(kbps);
+        QAction* budgetAction = budgetMenu->addAction(label);
+        budgetAction->setCheckable(true);
+        budgetAction->setChecked(m_bandwidthBudget.bytesPerSecond() == kbps * 1024);
+        connect(budgetAction, &QAction::triggered, this, [this, kbps]() {
+            setBandwidthBudgetLive(kbps * 1024);
+        });
+    }
+    
     // Always on top toggle action
     QAction* alwaysOnTopAction = menu.addAction("Always On &Top");
     alwaysOnTopAction->setCheckable(true);
@@ -875,6 +2466,7 @@ void MainWindow::showPopupMenu()
         } else {
             m_buttonMask = 0;
             syncPointerToCurrentCursor();
+            cancelTyping();
         }
         update();
     });
@@ -885,15 +2477,25 @@ void MainWindow::showPopupMenu()
     connect(cadAction, &QAction::triggered, this, [this]() {
         if (m_connected && m_client && !m_readOnly) {
             // Send Ctrl+Alt+Del sequence
-            SendKeyEvent(m_client, XK_Control_L, TRUE);
-            SendKeyEvent(m_client, XK_Alt_L, TRUE);
-            SendKeyEvent(m_client, XK_Delete, TRUE);
-            SendKeyEvent(m_client, XK_Delete, FALSE);
-            SendKeyEvent(m_client, XK_Alt_L, FALSE);
-            SendKeyEvent(m_client, XK_Control_L, FALSE);
+            sendKeyEvent(XK_Control_L, true);
+            sendKeyEvent(XK_Alt_L, true);
+            sendKeyEvent(XK_Delete, true);
+            sendKeyEvent(XK_Delete, false);
+            sendKeyEvent(XK_Alt_L, false);
+            sendKeyEvent(XK_Control_L, false);
         }
     });
     
+    // Clipboard typed as key presses, for servers that ignore clipboard transfers
+    if (m_typingQueue->pending() > 0) {
+        QAction* stopTypingAction = menu.addAction(QString("Stop &Typing (%1 keys left)").arg((m_typingQueue->pending() + 1) / 2));
+        connect(stopTypingAction, &QAction::triggered, this, &MainWindow::cancelTyping);
+    } else {
+        QAction* typeAction = menu.addAction("&Type Clipboard");
+        typeAction->setEnabled(m_connected && !m_readOnly && !QApplication::clipboard()->text().isEmpty());
+        connect(typeAction, &QAction::triggered, this, &MainWindow::typeClipboard);
+    }
+    
     // Show menu at cursor position
     menu.exec(QCursor::pos());
 }
@@ -907,6 +2509,22 @@ void MainWindow::closeEvent(QCloseEvent *event)
     settings.setValue(serverKey + "/windowSize", size());
     settings.setValue(serverKey + "/readOnlyMode", m_readOnly);
     settings.setValue(serverKey + "/alwaysOnTop", m_alwaysOnTop);
+    settings.setValue(serverKey + "/remoteResize", m_remoteResize);
+    if (!m_primary) {
+        settings.setValue(serverKey + "/predictScroll", m_scrollPredictor.isEnabled());
+        settings.setValue(serverKey + "/rewindBudgetMB", m_rewindBudgetMB);
+    }
+    if (m_profile.isValid()) {
+        m_profile.save(settings, serverKey);
+    }
+    if (!m_primary) {
+        sampleLink();
+        m_linkTimer->stop();
+        saveLinkProfile();
+    }
+    if (!m_primary && !m_monitorLayout.spec.isEmpty()) {
+        settings.setValue(serverKey + "/monitorLayout", m_monitorLayout.spec);
+    }
     
 #ifdef _WIN32
     // Reset Win key state and uninstall hook before closing
@@ -915,9 +2533,18 @@ void MainWindow::closeEvent(QCloseEvent *event)
     uninstallKeyboardHook();
 #endif
     
-    m_connected = false;
-    if (m_vncThread && m_vncThread->joinable()) {
-        m_vncThread->join();
+    if (m_latencyProbe.isActive()) {
+        std::cout << "[INFO] Input latency: " << m_latencyProbe.summaryText().toStdString() << std::endl;
+    }
+    
+    for (MainWindow *window : m_monitorWindows) {
+        window->close();
+    }
+    
+    cancelTyping();
+    disconnectFromServer();
+    if (m_fanout) {
+        m_fanout->stop();
     }
     QMainWindow::closeEvent(event);
 }
@@ -928,8 +2555,8 @@ void MainWindow::resetWindowTo1To1()
         return;
     }
     
-    int targetWidth = m_client->width;
-    int targetHeight = m_client->height + TITLE_BAR_HEIGHT;
+    int targetWidth = m_framebuffer.width();
+    int targetHeight = m_framebuffer.height() + TITLE_BAR_HEIGHT;
     
     // Get available screen geometry
     QScreen* screen = QApplication::primaryScreen();
@@ -1031,7 +2658,7 @@ LRESULT CALLBACK MainWindow::LowLevelKeyboardProc(int nCode, WPARAM wParam, LPAR
             // Only send to VNC server if in active mode
             if (!s_instance->m_readOnly && s_instance->m_client) {
                 uint32_t keysym = (pKeyboard->vkCode == VK_LWIN) ? XK_Super_L : XK_Super_R;
-                SendKeyEvent(s_instance->m_client, keysym, isKeyDown ? TRUE : FALSE);
+                s_instance->sendKeyEvent(keysym, isKeyDown);
                 if (isKeyDown) {
                     s_instance->m_winKeySentToVNC = true;
                 }
@@ -1049,7 +2676,7 @@ LRESULT CALLBACK MainWindow::LowLevelKeyboardProc(int nCode, WPARAM wParam, LPAR
             // Only block and send Alt if in active mode
             if (!s_instance->m_readOnly && s_instance->m_client) {
                 uint32_t keysym = (pKeyboard->vkCode == VK_LMENU) ? XK_Alt_L : XK_Alt_R;
-                SendKeyEvent(s_instance->m_client, keysym, isKeyDown ? TRUE : FALSE);
+                s_instance->sendKeyEvent(keysym, isKeyDown);
                 // Block Alt from reaching the OS so subsequent Alt+Tab remains remote
                 return 1;
             }
@@ -1069,7 +2696,7 @@ LRESULT CALLBACK MainWindow::LowLevelKeyboardProc(int nCode, WPARAM wParam, LPAR
             // Only block Alt+Tab if in active mode
             if (!s_instance->m_readOnly && s_instance->m_client) {
                 // Send Tab to VNC server
-                SendKeyEvent(s_instance->m_client, XK_Tab, isKeyDown ? TRUE : FALSE);
+                s_instance->sendKeyEvent(XK_Tab, isKeyDown);
                 // Block Tab from reaching the OS
                 return 1;
             }
@@ -5,14 +5,42 @@
 #include <QImage>
 #include <QRect>
 #include <QPixmap>
+#include <QTimer>
+#include <QJsonObject>
 #include <thread>
 #include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include "viewport.h"
+#include "framebufferops.h"
+#include "metrics.h"
+#include "sharedframebuffer.h"
+#include "sessionprofile.h"
+#include "linkprofile.h"
+#include "socketpump.h"
+#include "latencyprobe.h"
+#include "monitorlayout.h"
+#include "bandwidthbudget.h"
+#include "updatescheduler.h"
+#include "presentationcache.h"
+#include "scrollpredictor.h"
+#include "compressedframebuffer.h"
+#include "tilehashgrid.h"
+#include "rewindbuffer.h"
 
 #ifdef _WIN32
 #include <winsock2.h>
 #include <windows.h>
 #endif
 
+class InputQueue;
+class ControlServer;
+class DebugOverlay;
+class FanoutServer;
+class RegionWatcher;
+class QPainter;
+
 // Forward declare rfbClient to avoid exposing C header in header file
 struct _rfbClient;
 typedef struct _rfbClient rfbClient;
@@ -34,7 +62,16 @@ public:
     MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
 
-    void connectToServer(const std::string& serverIp, int serverPort, const std::string& password = "");
+    void connectToServer(const std::string& serverIp, int serverPort, const std::string& password = "",
+                         const SessionProfile& overrides = SessionProfile());
+    // Re-serve the session to local viewers on 127.0.0.1:port once connected (0 = off)
+    void setSharePort(int port) { m_sharePort = port; }
+    // Monitor layout spec (see monitorlayout.h) instead of the one saved for the server
+    void setMonitorLayout(const QString &spec) { m_monitorLayout.spec = spec; }
+    // Machine-wide bytes per second (0 = unlimited) instead of the saved budget
+    void setBandwidthBudget(qint64 bytesPerSecond) { m_bandwidthBudgetOverride = bytesPerSecond; }
+    // Start from the settings learned for the link even if the profile was pinned before
+    void useLearnedProfile() { m_useLearnedProfile = true; }
 
 protected:
     void paintEvent(QPaintEvent *event) override;
@@ -45,9 +82,13 @@ protected:
     void wheelEvent(QWheelEvent *event) override;
     void keyPressEvent(QKeyEvent *event) override;
     void keyReleaseEvent(QKeyEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
     void focusInEvent(QFocusEvent *event) override;
     void focusOutEvent(QFocusEvent *event) override;
     void closeEvent(QCloseEvent *event) override;
+    void changeEvent(QEvent *event) override;
+    void showEvent(QShowEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
     bool event(QEvent *event) override;
     bool nativeEvent(const QByteArray &eventType, void *message, qintptr *result) override;
 
@@ -55,28 +96,176 @@ private:
     Ui::MainWindow *ui;
     
     // VNC client state
-    bool m_connected = false;
+    std::atomic<bool> m_connected{false};  // Cleared by the VNC thread when the server goes away
     bool m_readOnly = true;
     bool m_pointerSyncedSinceToggle = false;
     bool m_alwaysOnTop = false;
     QImage m_framebuffer;
+    PresentationCache m_presentation;  // m_framebuffer scaled to the window, updated piecewise
     rfbClient *m_client = nullptr;
     std::thread *m_vncThread = nullptr;
     std::string m_password;
     std::string m_serverKey;  // serverIp:port for per-server settings
+    SessionProfile m_profile;  // Encodings, pixel format and poll interval of this session
+    QByteArray m_encodingsString;
+    bool m_useLearnedProfile = false;
+    
+    // Link measurements of this session, folded into the server's LinkProfile on close
+    LinkSampler m_linkSampler;
+    QTimer *m_linkTimer = nullptr;
     bool m_updatingClipboard = false;  // Flag to prevent clipboard feedback loop
     
+    // Multi-monitor sessions: every remote monitor gets a window over the one connection.
+    // The primary window owns the connection and shows the first monitor.
+    MonitorLayout m_monitorLayout;
+    QRect m_screenRect;                          // Part of the remote desktop shown here (null = all of it)
+    MainWindow *m_primary = nullptr;             // Set on the windows of the other monitors
+    std::vector<MainWindow *> m_monitorWindows;  // Owned by the primary, created before the VNC thread starts
+    QSize m_desktopSize;                         // VNC thread: desktop size at the last update
+    
+    // Zoom/pan state (zoom 0 = fit to window)
+    double m_zoom = 0.0;
+    QPointF m_viewCenter;
+    
+    // Region requested from the server, handed from the UI thread to the VNC thread
+    std::mutex m_requestMutex;
+    QRect m_requestRect;
+    std::atomic<bool> m_requestRectChanged{false};
+    
+    // Remote desktop resizing (ExtendedDesktopSize) to match the window
+    bool m_remoteResize = false;
+    int m_remoteResizeFailures = 0;   // Requests in a row that left the size as it was
+    QSize m_remoteResizeRequested;
+    QSize m_remoteSizeBeforeRequest;
+    QTimer *m_remoteResizeTimer = nullptr;
+    QTimer *m_remoteResizeCheckTimer = nullptr;
+    
+    // Socket reader stage feeding libvncclient through a local socket pair
+    SocketPump m_socketPump;
+    
+    // Update pacing: per-session frame rate cap and the machine-wide bandwidth budget
+    UpdateScheduler m_updateScheduler;
+    BandwidthBudget m_bandwidthBudget;
+    qint64 m_bandwidthBudgetOverride = -1;
+    
+    // Wheel scrolling shown before the server answers (the primary's predictor serves all windows)
+    ScrollPredictor m_scrollPredictor;
+    QRect m_predictionPainted;  // Window area the last paint drew a prediction into
+    
+    // Minimized/hidden sessions keep their framebuffer compressed (set by the UI, applied by the VNC thread)
+    CompressedFramebuffer m_compressedFramebuffer;
+    QTimer *m_backgroundTimer = nullptr;
+    std::atomic<bool> m_background{false};
+    bool m_backgroundApplied = false;  // VNC thread
+    
+    // Recent history of the desktop, recorded by the VNC thread and scrubbed from the popup menu
+    RewindBuffer m_rewindBuffer;
+    int m_rewindBudgetMB = 0;    // 0 = not recorded
+    QImage m_rewindFrame;        // Past frame shown instead of the live desktop (null = live)
+    int64_t m_rewindFrameNs = 0;
+    QString m_rewindFrameTime;   // Wall clock time the frame was recorded, for the title bar
+    
+    // Session metrics
+    SessionMetrics m_metrics;
+    MetricsExporter *m_metricsExporter = nullptr;
+    DebugOverlay *m_debugOverlay = nullptr;
+    int m_sharePort = 0;
+    FanoutServer *m_fanout = nullptr;
+    LatencyProbe m_latencyProbe;
+    bool m_drawCallsIdentifyEncoding = true;   // Only CopyRect, hextile and raw are offered
+    int m_rectDrawFlags = 0;         // Drawing calls seen for the rectangle being decoded
+    int m_rectNarrowestBitmap = 0;
+    int m_rectFills = 0;
+    int64_t m_rectBitmapBytes = 0;
+    int64_t m_rectStartNs = 0;       // Trace timestamp where the current rectangle began
+    TileHashGrid m_tileHashes;       // Rectangles that changed nothing are not presented
+    bool m_updateChanged = false;    // Some rectangle of the update being decoded changed pixels
+    bool m_unchangedRectsReported = false;
+    
+    // Local consumers (WVNCC_SHARED_FRAMEBUFFER, WVNCC_CONTROL_SOCKET): decoders write into a shared segment
+    bool m_shareFramebuffer = false;
+    std::string m_sharedFramebufferPrefix;
+    std::vector<SharedFramebufferDirtyRect> m_dirtyRects;  // Rectangles of the update being decoded
+    std::mutex m_sharedFramebufferMutex;  // Guards the segments against resizes on the VNC thread
+    SharedFramebuffer m_sharedFramebuffers[2];  // Current and previous generation, still shown until the next paint
+    int m_sharedFramebufferGeneration = 0;
+    // Otherwise the decoders' buffer is allocated here, with the same one-generation grace
+    std::vector<uint8_t> m_localFramebuffers[2];
+    int m_localFramebufferGeneration = 0;
+    std::mutex m_localFramebufferMutex;   // Guards the previous generation against releaseSpareFramebuffer()
+    std::atomic<int> m_spareFramebufferRelease{-1};   // Generation whose predecessor goes at the next repaint
+    InputQueue *m_inputQueue = nullptr;
+    
+    // "Type Clipboard": clipboard text sent as paced key presses
+    InputQueue *m_typingQueue = nullptr;
+    std::vector<uint32_t> m_typingHeldKeys;  // Pressed and not yet released, released on cancel
+    int m_typingTotal = 0;
+    ControlServer *m_controlServer = nullptr;
+    RegionWatcher *m_regionWatcher = nullptr;  // waitChange/waitMatch of the control socket
+    
     // Static callbacks for rfbClient
     static void framebufferUpdateCallback(rfbClient *client);
     static char* getPasswordCallback(rfbClient *client);
     static void gotXCutTextCallback(rfbClient *client, const char *text, int textlen);
+    static void gotFrameBufferUpdateCallback(rfbClient *client, int x, int y, int w, int h);
+    static void gotFillRectCallback(rfbClient *client, int x, int y, int w, int h, uint32_t colour);
+    static void gotBitmapCallback(rfbClient *client, const uint8_t *buffer, int x, int y, int w, int h);
+    static void gotCopyRectCallback(rfbClient *client, int srcX, int srcY, int w, int h, int destX, int destY);
+    static int8_t mallocFrameBufferCallback(rfbClient *client);  // Returns rfbBool
+    static int8_t handleCursorPosCallback(rfbClient *client, int x, int y);  // Returns rfbBool
     
     // Instance method for framebuffer updates
     void handleFramebufferUpdate(rfbClient *client);
+    void wrapFramebuffer(rfbClient *client);
+    void presentRect(const QRect &rect);
+    void presentCopy(const QRect &source, int dx, int dy);
+    void repaintDamage();
+    ScrollPredictor &scrollPredictor() { return m_primary ? m_primary->m_scrollPredictor : m_scrollPredictor; }
+    void predictionChanged();
+    void repaintPrediction();
+    void paintPrediction(QPainter &painter, const ViewportMapping &mapping);
+    QRect screenArea(int desktopWidth, int desktopHeight) const;
+    void openMonitorWindows(const QList<QRect> &screens);
+    void attachToMonitor(MainWindow *primary, int index, const QRect &screen);
     void handleServerClipboard(const char *text, int textlen);
+    void handleRectDecoded(int x, int y, int w, int h);
+    void reportUnchangedRects();
+    int estimateRectBytes(int encoding, int w, int h) const;
+    void publishSharedFramebuffer(rfbClient *client);
+    FramebufferView framebufferView() const;
+    void updateBackgroundState();
+    void applyBackgroundState();
+    void showRewindFrame(int64_t timeNs);
+    void showLive();
+    void sendPointerEvent(int x, int y, int buttonMask);
+    void sendKeyEvent(uint32_t keysym, bool down);
+    void refreshMetrics();
+    void sampleLink();
+    void saveLinkProfile();
+    uint64_t receivedBytes();
+    void setBandwidthBudgetLive(qint64 bytesPerSecond);
+    bool allocateFramebuffer(rfbClient *client);
+    void releaseSpareFramebuffer(int generation);
+    void disconnectFromServer();
+    SharedFramebuffer &currentSharedFramebuffer() { return m_sharedFramebuffers[m_sharedFramebufferGeneration & 1]; }
+    void startControlServer(const QString &name);
+    void startFanout();
+    QJsonObject controlInfo();
     void syncPointerToCurrentCursor();
-    uint32_t qtKeyToX11Keysym(int qtKey, Qt::KeyboardModifiers modifiers, const QString& text);
+    void typeClipboard();
+    void cancelTyping();
     QRect getScaledFramebufferRect() const;
+    ViewportMapping getViewportMapping() const;
+    bool mapToRemote(const QPointF &pos, int &x, int &y) const;
+    void setZoom(double zoom, const QPointF &anchor);
+    void zoomBy(double factor, const QPointF &anchor);
+    void panBy(double dx, double dy);
+    bool isViewportKey(const QKeyEvent *event) const;
+    void handleViewportKey(QKeyEvent *event);
+    void updateRequestedRegion();
+    void applyRequestedRegion();
+    void requestRemoteResize();
+    void checkRemoteResize();
     void showPopupMenu();
     void resetWindowTo1To1();
 
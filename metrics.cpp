@@ -0,0 +1,176 @@
+#include "metrics.h"
+
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QSaveFile>
+#include <QTimer>
+#include <iostream>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <mstcpip.h>
+#elif defined(__linux__)
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/tcp.h>
+#endif
+
+const char *SessionMetrics::encodingName(int encoding)
+{
+    switch (encoding) {
+        case Raw: return "raw";
+        case CopyRect: return "copyrect";
+        case Hextile: return "hextile";
+        default: return "other";
+    }
+}
+
+namespace {
+
+void appendMetric(QByteArray &out, const char *name, const char *type, const char *help,
+                  const QByteArray &labels, double value)
+{
+    out += QByteArray("# HELP ") + name + ' ' + help + '\n';
+    out += QByteArray("# TYPE ") + name + ' ' + type + '\n';
+    out += QByteArray(name) + '{' + labels + "} " + QByteArray::number(value, 'g', 15) + '\n';
+}
+
+double load(const std::atomic<uint64_t> &counter)
+{
+    return static_cast<double>(counter.load(std::memory_order_relaxed));
+}
+
+} // namespace
+
+QByteArray SessionMetrics::toPrometheus(const QString &server) const
+{
+    QString escaped = server;
+    escaped.replace('\\', "\\\\").replace('"', "\\\"");
+    QByteArray labels = "server=\"" + escaped.toUtf8() + "\"";
+
+    QByteArray out;
+    appendMetric(out, "wvncc_bytes_received_total", "counter", "Bytes received from the server.", labels, load(bytesIn));
+    appendMetric(out, "wvncc_bytes_sent_total", "counter", "Bytes sent to the server.", labels, load(bytesOut));
+    appendMetric(out, "wvncc_updates_total", "counter", "Framebuffer updates completed.", labels, load(updates));
+
+    out += "# HELP wvncc_rects_total Rectangles received, by encoding.\n";
+    out += "# TYPE wvncc_rects_total counter\n";
+    for (int i = 0; i < EncodingCount; i++) {
+        out += "wvncc_rects_total{" + labels + ",encoding=\"" + encodingName(i) + "\"} "
+             + QByteArray::number(load(rects[i]), 'g', 15) + '\n';
+    }
+
+    appendMetric(out, "wvncc_unchanged_rects_total", "counter", "Rectangles that left the framebuffer as it was (also in wvncc_rects_total).", labels, load(unchangedRects));
+    appendMetric(out, "wvncc_decoded_pixels_total", "counter", "Pixels of decoded rectangles, CopyRect excluded.", labels, load(decodedPixels));
+    appendMetric(out, "wvncc_messages_total", "counter", "Server messages handled.", labels, load(messages));
+    appendMetric(out, "wvncc_decode_seconds_total", "counter", "Time spent handling and decoding server messages.", labels, load(decodeNanos) / 1e9);
+    appendMetric(out, "wvncc_paced_seconds_total", "counter", "Time update requests were held back to keep to the frame rate cap and bandwidth budget.", labels, load(pacedNanos) / 1e9);
+    appendMetric(out, "wvncc_paints_total", "counter", "Window repaints.", labels, load(paints));
+    appendMetric(out, "wvncc_paint_seconds_total", "counter", "Time spent in paintEvent.", labels, load(paintNanos) / 1e9);
+    appendMetric(out, "wvncc_connects_total", "counter", "Successful connections to the server.", labels, load(connects));
+    appendMetric(out, "wvncc_disconnects_total", "counter", "Connections lost or closed by the server.", labels, load(disconnects));
+    appendMetric(out, "wvncc_pointer_events_total", "counter", "Pointer events sent.", labels, load(pointerEvents));
+    appendMetric(out, "wvncc_key_events_total", "counter", "Key events sent.", labels, load(keyEvents));
+    appendMetric(out, "wvncc_clipboard_events_total", "counter", "Clipboard updates sent.", labels, load(clipboardEvents));
+    return out;
+}
+
+bool querySocketTraffic(qintptr socket, SocketTraffic &traffic)
+{
+#if defined(_WIN32) && defined(SIO_TCP_INFO)
+    DWORD version = 0;
+    TCP_INFO_v0 info;
+    DWORD returned = 0;
+    if (WSAIoctl(static_cast<SOCKET>(socket), SIO_TCP_INFO, &version, sizeof(version),
+                 &info, sizeof(info), &returned, nullptr, nullptr) != 0) {
+        return false;
+    }
+    traffic.bytesIn = info.BytesIn;
+    traffic.bytesOut = info.BytesOut;
+    traffic.rttUs = info.RttUs;
+    return true;
+#elif defined(__linux__)
+    struct tcp_info info;
+    socklen_t length = sizeof(info);
+    if (getsockopt(static_cast<int>(socket), IPPROTO_TCP, TCP_INFO, &info, &length) != 0) {
+        return false;
+    }
+    traffic.bytesIn = info.tcpi_bytes_received;
+    traffic.bytesOut = info.tcpi_bytes_acked;
+    traffic.rttUs = info.tcpi_rtt;
+    return true;
+#else
+    (void)socket;
+    (void)traffic;
+    return false;
+#endif
+}
+
+MetricsExporter::MetricsExporter(SessionMetrics &metrics, QObject *parent)
+    : QObject(parent)
+    , m_metrics(metrics)
+{
+}
+
+bool MetricsExporter::configureFromEnvironment()
+{
+    m_filePath = qEnvironmentVariable("WVNCC_METRICS_FILE");
+    QString socketName = qEnvironmentVariable("WVNCC_METRICS_SOCKET");
+
+    if (!m_filePath.isEmpty()) {
+        bool ok = false;
+        int interval = qEnvironmentVariableIntValue("WVNCC_METRICS_INTERVAL", &ok);
+        if (!ok || interval <= 0) {
+            interval = 15;
+        }
+        m_fileTimer = new QTimer(this);
+        connect(m_fileTimer, &QTimer::timeout, this, &MetricsExporter::writeFile);
+        m_fileTimer->start(interval * 1000);
+        std::cout << "[INFO] Writing metrics to " << m_filePath.toStdString() << " every " << interval << "s" << std::endl;
+    }
+
+    if (!socketName.isEmpty()) {
+        m_localServer = new QLocalServer(this);
+        QLocalServer::removeServer(socketName);
+        if (m_localServer->listen(socketName)) {
+            connect(m_localServer, &QLocalServer::newConnection, this, &MetricsExporter::serveConnection);
+            std::cout << "[INFO] Serving metrics on " << m_localServer->fullServerName().toStdString() << std::endl;
+        } else {
+            std::cerr << "[ERROR] Failed to listen for metrics on " << socketName.toStdString()
+                      << ": " << m_localServer->errorString().toStdString() << std::endl;
+            delete m_localServer;
+            m_localServer = nullptr;
+        }
+    }
+
+    return m_fileTimer || m_localServer;
+}
+
+QByteArray MetricsExporter::snapshot()
+{
+    if (m_refreshHook) {
+        m_refreshHook();
+    }
+    return m_metrics.toPrometheus(m_server);
+}
+
+void MetricsExporter::writeFile()
+{
+    // Write-and-rename so scrapers never see a partial file
+    QSaveFile file(m_filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return;
+    }
+    file.write(snapshot());
+    file.commit();
+}
+
+void MetricsExporter::serveConnection()
+{
+    while (QLocalSocket *socket = m_localServer->nextPendingConnection()) {
+        connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+        socket->write(snapshot());
+        socket->disconnectFromServer();
+    }
+}
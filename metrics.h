@@ -0,0 +1,88 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+class QLocalServer;
+class QTimer;
+
+// Per-session counters, bumped with relaxed atomics from the VNC and UI threads.
+// Nothing is formatted until an exporter asks for a snapshot.
+struct SessionMetrics
+{
+    // Encoding family of a rectangle, inferred from the decoder's drawing calls
+    enum Encoding { Raw, CopyRect, Hextile, Other, EncodingCount };
+    static const char *encodingName(int encoding);
+
+    std::atomic<uint64_t> bytesIn{0};
+    std::atomic<uint64_t> bytesOut{0};
+    std::atomic<uint64_t> updates{0};
+    std::atomic<uint64_t> rects[EncodingCount] = {};
+    std::atomic<uint64_t> unchangedRects{0};
+    std::atomic<uint64_t> decodedPixels{0};
+    std::atomic<uint64_t> messages{0};
+    std::atomic<uint64_t> decodeNanos{0};
+    std::atomic<uint64_t> pacedNanos{0};
+    std::atomic<uint64_t> paints{0};
+    std::atomic<uint64_t> paintNanos{0};
+    std::atomic<uint64_t> connects{0};
+    std::atomic<uint64_t> disconnects{0};
+    std::atomic<uint64_t> pointerEvents{0};
+    std::atomic<uint64_t> keyEvents{0};
+    std::atomic<uint64_t> clipboardEvents{0};
+
+    static void add(std::atomic<uint64_t> &counter, uint64_t value = 1)
+    {
+        counter.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    QByteArray toPrometheus(const QString &server) const;
+};
+
+// Kernel TCP statistics for a connected socket; only queried when metrics are exported
+struct SocketTraffic
+{
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+    uint64_t rttUs = 0;
+};
+bool querySocketTraffic(qintptr socket, SocketTraffic &traffic);
+
+// Publishes SessionMetrics as Prometheus text, configured from the environment:
+//   WVNCC_METRICS_FILE      file rewritten every WVNCC_METRICS_INTERVAL seconds (default 15)
+//   WVNCC_METRICS_SOCKET    local socket name/path; every connection receives one snapshot
+class MetricsExporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit MetricsExporter(SessionMetrics &metrics, QObject *parent = nullptr);
+
+    // Returns false if no export target is configured
+    bool configureFromEnvironment();
+    void setServer(const QString &server) { m_server = server; }
+
+    // Called right before a snapshot is taken, to sample lazily collected values
+    void setRefreshHook(std::function<void()> hook) { m_refreshHook = std::move(hook); }
+
+private slots:
+    void writeFile();
+    void serveConnection();
+
+private:
+    QByteArray snapshot();
+
+    SessionMetrics &m_metrics;
+    QString m_server;
+    QString m_filePath;
+    QLocalServer *m_localServer = nullptr;
+    QTimer *m_fileTimer = nullptr;
+    std::function<void()> m_refreshHook;
+};
+
+#endif // METRICS_H
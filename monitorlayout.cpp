@@ -0,0 +1,163 @@
+#include "monitorlayout.h"
+
+#include <QRegularExpression>
+#include <QStringList>
+#include <algorithm>
+#include <cmath>
+
+// Width:height of the monitors the guess looks for
+const double MONITOR_ASPECTS[] = {16.0 / 9.0, 16.0 / 10.0, 4.0 / 3.0, 5.0 / 4.0, 21.0 / 9.0};
+// How far a tile may be from one of those shapes
+const double ASPECT_TOLERANCE = 0.03;
+const int MAX_MONITORS = 16;
+
+namespace {
+
+QList<QRect> equalColumns(const QSize &desktop, int count)
+{
+    QList<QRect> screens;
+    for (int i = 0; i < count; i++) {
+        int left = desktop.width() * i / count;
+        int right = desktop.width() * (i + 1) / count;
+        screens.append(QRect(left, 0, right - left, desktop.height()));
+    }
+    return screens;
+}
+
+QList<QRect> equalRows(const QSize &desktop, int count)
+{
+    QList<QRect> screens;
+    for (int i = 0; i < count; i++) {
+        int top = desktop.height() * i / count;
+        int bottom = desktop.height() * (i + 1) / count;
+        screens.append(QRect(0, top, desktop.width(), bottom - top));
+    }
+    return screens;
+}
+
+// Relative distance of width:height from the nearest monitor shape, landscape or portrait
+double shapeError(double aspect)
+{
+    double best = 1.0;
+    for (double monitor : MONITOR_ASPECTS) {
+        for (double shape : {monitor, 1.0 / monitor}) {
+            best = std::min(best, std::abs(aspect - shape) / shape);
+        }
+    }
+    return best;
+}
+
+// Number of equal tiles along length that each come closest to a monitor shape, or 1
+int guessTileCount(int length, int across)
+{
+    // A desktop that already has a monitor's shape is one monitor
+    if (shapeError(static_cast<double>(length) / across) < ASPECT_TOLERANCE) {
+        return 1;
+    }
+    int best = 1;
+    double bestError = ASPECT_TOLERANCE;
+    for (int count = 2; count <= MAX_MONITORS; count++) {
+        if (length % count != 0) {
+            continue;
+        }
+        double error = shapeError(static_cast<double>(length / count) / across);
+        if (error < bestError) {
+            bestError = error;
+            best = count;
+        }
+    }
+    return best;
+}
+
+bool parseRect(const QString &text, QRect &rect)
+{
+    static const QRegularExpression pattern("^(\\d+)x(\\d+)\\+(\\d+)\\+(\\d+)$");
+    QRegularExpressionMatch match = pattern.match(text.trimmed());
+    if (!match.hasMatch()) {
+        return false;
+    }
+    rect = QRect(match.captured(3).toInt(), match.captured(4).toInt(), match.captured(1).toInt(), match.captured(2).toInt());
+    return !rect.isEmpty();
+}
+
+}
+
+bool MonitorLayout::isValidSpec(const QString &spec, QString *error)
+{
+    QString text = spec.trimmed();
+    if (text.isEmpty() || text == "auto" || text == "off") {
+        return true;
+    }
+    bool isNumber = false;
+    int count = text.toInt(&isNumber);
+    if (isNumber) {
+        if (count >= 1 && count <= MAX_MONITORS) {
+            return true;
+        }
+        if (error) {
+            *error = QString("monitor count must be 1-%1").arg(MAX_MONITORS);
+        }
+        return false;
+    }
+    const QStringList parts = text.split(',');
+    for (const QString &part : parts) {
+        QRect rect;
+        if (!parseRect(part, rect)) {
+            if (error) {
+                *error = QString("bad monitor rectangle \"%1\", expected WxH+X+Y").arg(part.trimmed());
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+QList<QRect> MonitorLayout::screens(const QSize &desktop) const
+{
+    QString text = spec.trimmed();
+    if (desktop.isEmpty() || text.isEmpty() || text == "off") {
+        return {};
+    }
+    if (text == "auto") {
+        return guessMonitorLayout(desktop);
+    }
+
+    bool isNumber = false;
+    int count = text.toInt(&isNumber);
+    if (isNumber) {
+        return count >= 2 && count <= MAX_MONITORS ? equalColumns(desktop, count) : QList<QRect>();
+    }
+
+    QList<QRect> result;
+    QRect bounds(QPoint(0, 0), desktop);
+    const QStringList parts = text.split(',');
+    for (const QString &part : parts) {
+        QRect rect;
+        if (parseRect(part, rect) && !(rect & bounds).isEmpty()) {
+            result.append(rect & bounds);
+        }
+    }
+    return result;
+}
+
+QList<QRect> guessMonitorLayout(const QSize &desktop)
+{
+    if (desktop.isEmpty()) {
+        return {};
+    }
+    if (desktop.width() >= desktop.height()) {
+        int columns = guessTileCount(desktop.width(), desktop.height());
+        return columns > 1 ? equalColumns(desktop, columns) : QList<QRect>();
+    }
+    int rows = guessTileCount(desktop.height(), desktop.width());
+    return rows > 1 ? equalRows(desktop, rows) : QList<QRect>();
+}
+
+QString formatMonitorLayout(const QList<QRect> &screens)
+{
+    QStringList parts;
+    for (const QRect &rect : screens) {
+        parts.append(QString("%1x%2+%3+%4").arg(rect.width()).arg(rect.height()).arg(rect.x()).arg(rect.y()));
+    }
+    return parts.join(',');
+}
@@ -0,0 +1,32 @@
+#ifndef MONITORLAYOUT_H
+#define MONITORLAYOUT_H
+
+#include <QList>
+#include <QRect>
+#include <QSize>
+#include <QString>
+
+// Remote monitor layout: one rectangle of the remote desktop per monitor.
+//   "auto"                           guess from the desktop size (see guessMonitorLayout)
+//   "off" or "1"                     whole desktop in one window
+//   "3"                              three equal columns
+//   "1920x1080+0+0,1920x1080+1920+0" explicit rectangles
+struct MonitorLayout
+{
+    QString spec;
+
+    // Empty spec means off; false with error set if spec is malformed
+    static bool isValidSpec(const QString &spec, QString *error = nullptr);
+
+    // Rectangles for a desktop of the given size; fewer than two means one window.
+    // Rectangles are clipped to the desktop, ones left empty are dropped.
+    QList<QRect> screens(const QSize &desktop) const;
+};
+
+// Splits desktops that are a row (or column) of two or more common monitor shapes into
+// equal tiles, e.g. 5760x1080 into three 1920x1080 screens. Other sizes stay one screen.
+QList<QRect> guessMonitorLayout(const QSize &desktop);
+
+QString formatMonitorLayout(const QList<QRect> &screens);
+
+#endif // MONITORLAYOUT_H
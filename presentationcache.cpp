@@ -0,0 +1,227 @@
+#include "presentationcache.h"
+#include "framebufferops.h"
+
+#include <QPainter>
+#include <algorithm>
+#include <cmath>
+
+// Moves queued beyond this are folded into the dirty region
+const size_t MAX_PENDING_SCROLLS = 64;
+// Rescaling more rectangles than this draws their bounding rectangle instead
+const int MAX_RENDER_RECTS = 32;
+// Window pixels next to a moved area's edge depend on pixels outside it when filtered
+const int FILTER_EDGE = 2;
+
+namespace {
+
+bool isWhole(double value)
+{
+    return std::abs(value - std::round(value)) < 1e-6;
+}
+
+// Window area showing the given framebuffer rectangles, one pixel wider for filtering
+QRegion toWindow(const QRegion &rects, const ViewportMapping &mapping)
+{
+    double sx = mapping.target.width() / mapping.source.width();
+    double sy = mapping.target.height() / mapping.source.height();
+    QRegion region;
+    for (const QRect &rect : rects) {
+        QRectF mapped((rect.x() - mapping.source.x()) * sx + mapping.target.x(),
+                      (rect.y() - mapping.source.y()) * sy + mapping.target.y(),
+                      rect.width() * sx, rect.height() * sy);
+        region += mapped.toAlignedRect().adjusted(-1, -1, 1, 1) & mapping.target;
+    }
+    return region;
+}
+
+}
+
+void PresentationCache::markDirty(const QRect &rect)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_dirty += rect;
+}
+
+void PresentationCache::scroll(const QRect &source, int dx, int dy)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    QRect dest = source.translated(dx, dy);
+
+    // Pending changes inside the moved area move with it
+    m_dirty += (m_dirty & source).translated(dx, dy);
+    if (m_scrolls.size() >= MAX_PENDING_SCROLLS) {
+        m_dirty += dest;
+        return;
+    }
+    m_scrolls.push_back({source, dx, dy});
+}
+
+void PresentationCache::invalidate()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_invalid = true;
+}
+
+void PresentationCache::release()
+{
+    m_image = QImage();
+}
+
+bool PresentationCache::mappingMatches(const QImage &framebuffer, const ViewportMapping &mapping) const
+{
+    return !m_image.isNull() && mapping.target == m_mapping.target && mapping.source == m_mapping.source
+        && framebuffer.size() == m_framebufferSize && framebuffer.format() == m_framebufferFormat;
+}
+
+QRectF PresentationCache::toCache(const QRectF &rect) const
+{
+    double sx = m_mapping.target.width() / m_mapping.source.width();
+    double sy = m_mapping.target.height() / m_mapping.source.height();
+    return QRectF((rect.x() - m_mapping.source.x()) * sx, (rect.y() - m_mapping.source.y()) * sy,
+                  rect.width() * sx, rect.height() * sy);
+}
+
+QRect PresentationCache::toCacheAligned(const QRect &rect) const
+{
+    // Filtering reaches one window pixel beyond the rectangle
+    return toCache(QRectF(rect)).toAlignedRect().adjusted(-1, -1, 1, 1) & QRect(QPoint(0, 0), m_image.size());
+}
+
+QRegion PresentationCache::damage(const ViewportMapping &mapping)
+{
+    if (!mapping.isValid()) {
+        return QRegion();
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_invalid || mapping.target != m_mapping.target || mapping.source != m_mapping.source) {
+        return QRegion(mapping.target);
+    }
+
+    QRegion changed = m_dirty;
+    for (const Scroll &scroll : m_scrolls) {
+        changed += scroll.source.translated(scroll.dx, scroll.dy);
+    }
+    return m_unshown + toWindow(changed, mapping);
+}
+
+const QImage *PresentationCache::render(const QImage &framebuffer, const ViewportMapping &mapping)
+{
+    std::vector<Scroll> scrolls;
+    QRegion dirty;
+    bool invalid;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        scrolls.swap(m_scrolls);
+        dirty.swap(m_dirty);
+        invalid = m_invalid;
+        m_invalid = false;
+    }
+
+    // Unscaled: drawing the framebuffer is already a plain copy
+    bool unscaled = mapping.source.size() == QSizeF(mapping.target.size())
+        && isWhole(mapping.source.x()) && isWhole(mapping.source.y());
+    if (unscaled) {
+        // Nothing to rescale, but the changes still have to reach the window
+        for (const Scroll &scroll : scrolls) {
+            dirty += scroll.source.translated(scroll.dx, scroll.dy);
+        }
+        m_unshown += toWindow(dirty, mapping);
+        m_image = QImage();
+        m_mapping = mapping;
+        return nullptr;
+    }
+
+    if (invalid || !mappingMatches(framebuffer, mapping)) {
+        m_mapping = mapping;
+        m_framebufferSize = framebuffer.size();
+        m_framebufferFormat = framebuffer.format();
+        if (m_image.size() != mapping.target.size()) {
+            m_image = QImage(mapping.target.size(), QImage::Format_RGB32);
+        }
+        renderRegion(framebuffer, QRegion(m_image.rect()));
+        m_unshown += mapping.target;
+        return &m_image;
+    }
+
+    QRegion cacheDirty;
+    for (const Scroll &scroll : scrolls) {
+        applyScroll(scroll, cacheDirty);
+    }
+    for (const QRect &rect : dirty) {
+        cacheDirty += toCacheAligned(rect);
+    }
+    if (cacheDirty.rectCount() > MAX_RENDER_RECTS) {
+        cacheDirty = cacheDirty.boundingRect();
+    }
+    renderRegion(framebuffer, cacheDirty);
+    m_unshown += cacheDirty.translated(mapping.target.topLeft());
+    return &m_image;
+}
+
+void PresentationCache::applyScroll(const Scroll &scroll, QRegion &cacheDirty)
+{
+    QRect dest = toCacheAligned(scroll.source.translated(scroll.dx, scroll.dy));
+    double tx = scroll.dx * m_mapping.target.width() / m_mapping.source.width();
+    double ty = scroll.dy * m_mapping.target.height() / m_mapping.source.height();
+    if (!isWhole(tx) || !isWhole(ty)) {
+        // The scaled pixels would land between window pixels, rescale the destination
+        cacheDirty += dest;
+        return;
+    }
+
+    // Only the interior of the moved area is the same after scaling
+    int shiftX = static_cast<int>(std::round(tx));
+    int shiftY = static_cast<int>(std::round(ty));
+    QRectF mapped = toCache(QRectF(scroll.source));
+    QRect inner(QPoint(static_cast<int>(std::ceil(mapped.left())) + FILTER_EDGE,
+                       static_cast<int>(std::ceil(mapped.top())) + FILTER_EDGE),
+                QPoint(static_cast<int>(std::floor(mapped.right())) - 1 - FILTER_EDGE,
+                       static_cast<int>(std::floor(mapped.bottom())) - 1 - FILTER_EDGE));
+    QRect bounds = m_image.rect();
+    QRect moved = (inner & bounds).translated(shiftX, shiftY) & bounds;
+    if (!moved.isEmpty()) {
+        QRect from = moved.translated(-shiftX, -shiftY);
+        fbops::copyRect(m_image.bits(), m_image.bytesPerLine(), 4, from.x(), from.y(), moved.width(), moved.height(),
+                        moved.x(), moved.y());
+        // Areas still waiting to be rescaled move along
+        cacheDirty += (cacheDirty & from).translated(shiftX, shiftY);
+    }
+    cacheDirty += QRegion(dest) - QRegion(moved);
+    m_unshown += dest.translated(m_mapping.target.topLeft());
+}
+
+void PresentationCache::renderRegion(const QImage &framebuffer, const QRegion &cacheDirty)
+{
+    if (cacheDirty.isEmpty()) {
+        return;
+    }
+
+    QPainter painter(&m_image);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, true);
+    painter.setRenderHint(QPainter::Antialiasing, true);
+
+    double sx = m_mapping.target.width() / m_mapping.source.width();
+    double sy = m_mapping.target.height() / m_mapping.source.height();
+    // Source pixels around each rectangle, so the filter sees the same neighbours as a full rescale
+    int marginX = 2 + static_cast<int>(std::ceil(1.0 / sx));
+    int marginY = 2 + static_cast<int>(std::ceil(1.0 / sy));
+    QRect framebufferRect(QPoint(0, 0), framebuffer.size());
+
+    for (const QRect &rect : cacheDirty) {
+        QRectF source(m_mapping.source.x() + rect.x() / sx, m_mapping.source.y() + rect.y() / sy,
+                      rect.width() / sx, rect.height() / sy);
+        QRect sampled = source.toAlignedRect().adjusted(-marginX, -marginY, marginX, marginY) & framebufferRect;
+        if (sampled.isEmpty()) {
+            continue;
+        }
+        painter.setClipRect(rect);
+        painter.drawImage(toCache(QRectF(sampled)), framebuffer, QRectF(sampled));
+    }
+}
+
+QRegion PresentationCache::shown(const QRegion &region)
+{
+    m_unshown -= region;
+    return m_unshown;
+}
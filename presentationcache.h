@@ -0,0 +1,63 @@
+#ifndef PRESENTATIONCACHE_H
+#define PRESENTATIONCACHE_H
+
+#include <QImage>
+#include <QRect>
+#include <QRegion>
+#include <mutex>
+#include <vector>
+#include "viewport.h"
+
+// The framebuffer as it is shown: scaled to the window once and then kept up to date
+// piecewise. The VNC thread reports which rectangles changed and which were moved
+// (CopyRect); at paint time only the changed parts are rescaled, and moves whose offset
+// is a whole number of window pixels are applied by moving the scaled pixels.
+// At 1:1 there is nothing to cache and only the repaint region is tracked.
+class PresentationCache
+{
+public:
+    // VNC thread, in framebuffer coordinates
+    void markDirty(const QRect &rect);
+    void scroll(const QRect &source, int dx, int dy);
+    // Any thread: rebuild everything on the next paint (new framebuffer)
+    void invalidate();
+
+    // GUI thread: window area that needs repainting for the changes so far
+    QRegion damage(const ViewportMapping &mapping);
+    // GUI thread, in paintEvent: applies the pending changes and returns the image to draw at
+    // mapping.target, or nullptr if the framebuffer can be drawn directly (unscaled)
+    const QImage *render(const QImage &framebuffer, const ViewportMapping &mapping);
+    // GUI thread, after painting region: the part of the changes not repainted yet
+    QRegion shown(const QRegion &region);
+    // GUI thread: frees the scaled image while the window is hidden; the next render rebuilds it
+    void release();
+
+private:
+    struct Scroll
+    {
+        QRect source;
+        int dx;
+        int dy;
+    };
+
+    bool mappingMatches(const QImage &framebuffer, const ViewportMapping &mapping) const;
+    QRectF toCache(const QRectF &rect) const;
+    QRect toCacheAligned(const QRect &rect) const;
+    void applyScroll(const Scroll &scroll, QRegion &cacheDirty);
+    void renderRegion(const QImage &framebuffer, const QRegion &cacheDirty);
+
+    // Written by the VNC thread
+    std::mutex m_mutex;
+    QRegion m_dirty;                 // Changed since the last render, after all pending scrolls
+    std::vector<Scroll> m_scrolls;   // Moves since the last render, in order
+    bool m_invalid = true;
+
+    // GUI thread only
+    QImage m_image;                  // Scaled copy of mapping.source, mapping.target sized
+    ViewportMapping m_mapping;
+    QSize m_framebufferSize;
+    QImage::Format m_framebufferFormat = QImage::Format_Invalid;
+    QRegion m_unshown;               // Window area rendered but not yet repainted
+};
+
+#endif // PRESENTATIONCACHE_H
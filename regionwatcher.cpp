@@ -0,0 +1,145 @@
+#include "regionwatcher.h"
+#include "framebufferops.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Beyond this many rectangles in one update every watched row is compared again
+const size_t MAX_DIRTY_RECTS = 256;
+
+RegionWatcher::RegionWatcher(QObject *parent)
+    : QObject(parent)
+{
+}
+
+uint64_t RegionWatcher::add(const Watch &watch)
+{
+    uint64_t id = m_nextId++;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pending[id] = watch;
+    m_requests = true;
+    return id;
+}
+
+void RegionWatcher::cancel(uint64_t id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_pending.erase(id) == 0) {
+        m_cancelled.push_back(id);
+    }
+    m_requests = true;
+}
+
+void RegionWatcher::poll(const FramebufferView &fb)
+{
+    if (!m_requests.load(std::memory_order_acquire)) {
+        return;
+    }
+    std::map<uint64_t, Watch> started;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        started.swap(m_pending);
+        for (uint64_t id : m_cancelled) {
+            m_active.erase(id);
+        }
+        m_cancelled.clear();
+        m_requests = false;
+    }
+
+    for (auto &entry : started) {
+        Active active;
+        active.watch = std::move(entry.second);
+        const QRect &rect = active.watch.rect;
+        if (!fb.pixels || !fbops::rectInside(fb.width, fb.height, rect.x(), rect.y(), rect.width(), rect.height())) {
+            emit finished(entry.first, 0, 0, "Region outside the framebuffer");
+            continue;
+        }
+
+        int rowBytes = rect.width() * fb.bytesPerPixel;
+        if (active.watch.reference.isEmpty()) {
+            // Waiting for a change: the region as it is now is the reference
+            active.watch.reference.resize(rowBytes * rect.height());
+            for (int row = 0; row < rect.height(); row++) {
+                memcpy(active.watch.reference.data() + row * rowBytes,
+                       fb.pixels + (rect.y() + row) * fb.stride + rect.x() * fb.bytesPerPixel, rowBytes);
+            }
+        } else if (active.watch.reference.size() != rowBytes * rect.height()) {
+            emit finished(entry.first, 0, 0, "Reference image does not match the framebuffer format");
+            continue;
+        }
+
+        active.rowCounts.assign(rect.height(), 0);
+        recount(active, fb, 0, rect.height());
+        if (!settle(entry.first, active)) {
+            m_active.emplace(entry.first, std::move(active));
+        }
+    }
+}
+
+void RegionWatcher::rectDecoded(const QRect &rect)
+{
+    if (m_active.empty() || m_allDirty) {
+        return;
+    }
+    if (m_dirty.size() >= MAX_DIRTY_RECTS) {
+        m_allDirty = true;
+        m_dirty.clear();
+        return;
+    }
+    m_dirty.push_back(rect);
+}
+
+void RegionWatcher::updateFinished(const FramebufferView &fb)
+{
+    for (auto it = m_active.begin(); it != m_active.end();) {
+        Active &active = it->second;
+        const QRect &rect = active.watch.rect;
+        active.updates++;
+        if (!fbops::rectInside(fb.width, fb.height, rect.x(), rect.y(), rect.width(), rect.height())) {
+            emit finished(it->first, active.total, active.updates, "Region outside the resized framebuffer");
+            it = m_active.erase(it);
+            continue;
+        }
+
+        // Compare again only the rows an update rectangle touched
+        if (m_allDirty) {
+            recount(active, fb, 0, rect.height());
+        } else {
+            for (const QRect &dirty : m_dirty) {
+                QRect touched = dirty & rect;
+                if (!touched.isEmpty()) {
+                    recount(active, fb, touched.y() - rect.y(), touched.bottom() + 1 - rect.y());
+                }
+            }
+        }
+        if (settle(it->first, active)) {
+            it = m_active.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    m_dirty.clear();
+    m_allDirty = false;
+}
+
+void RegionWatcher::recount(Active &active, const FramebufferView &fb, int firstRow, int endRow)
+{
+    const QRect &rect = active.watch.rect;
+    int rowBytes = rect.width() * fb.bytesPerPixel;
+    for (int row = firstRow; row < endRow; row++) {
+        const uint8_t *current = fb.pixels + (rect.y() + row) * fb.stride + rect.x() * fb.bytesPerPixel;
+        const uint8_t *reference = reinterpret_cast<const uint8_t *>(active.watch.reference.constData()) + row * rowBytes;
+        int count = fbops::countDifferentPixels(current, reference, fb.bytesPerPixel, rect.width(), active.watch.tolerance);
+        active.total += count - active.rowCounts[row];
+        active.rowCounts[row] = count;
+    }
+}
+
+bool RegionWatcher::settle(uint64_t id, Active &active)
+{
+    bool done = active.watch.match ? active.total <= active.watch.threshold : active.total > active.watch.threshold;
+    if (done) {
+        emit finished(id, active.total, active.updates, QString());
+    }
+    return done;
+}
@@ -0,0 +1,73 @@
+#ifndef REGIONWATCHER_H
+#define REGIONWATCHER_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QRect>
+#include <QString>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+#include "framebufferops.h"
+
+// Waits on a rectangle of the decoded framebuffer for the control socket: until it differs
+// from what it showed when the wait started, or until it matches a reference image. Each
+// watch keeps the number of differing pixels per row; after an update only the rows its
+// rectangles touched are compared again, so a wait costs nothing while the rest of the
+// desktop changes.
+class RegionWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Watch
+    {
+        QRect rect;             // Desktop coordinates
+        bool match = false;     // Wait for at most threshold differing pixels (false: for more)
+        qint64 threshold = 0;
+        int tolerance = 0;      // Per channel, 0-255
+        QByteArray reference;   // Packed rows in the framebuffer format; empty = the region when the wait starts
+    };
+
+    explicit RegionWatcher(QObject *parent = nullptr);
+
+    // Any thread
+    uint64_t add(const Watch &watch);
+    void cancel(uint64_t id);
+
+    // VNC thread: between messages, per decoded rectangle and after each completed update
+    void poll(const FramebufferView &fb);
+    void rectDecoded(const QRect &rect);
+    void updateFinished(const FramebufferView &fb);
+
+signals:
+    // Emitted on the VNC thread; error is empty when the wait was satisfied
+    void finished(quint64 id, qint64 differentPixels, int updates, const QString &error);
+
+private:
+    struct Active
+    {
+        Watch watch;
+        std::vector<int> rowCounts;
+        qint64 total = 0;
+        int updates = 0;
+    };
+
+    void recount(Active &active, const FramebufferView &fb, int firstRow, int endRow);
+    bool settle(uint64_t id, Active &active);
+
+    std::mutex m_mutex;
+    std::map<uint64_t, Watch> m_pending;
+    std::vector<uint64_t> m_cancelled;
+    std::atomic<bool> m_requests{false};
+    std::atomic<uint64_t> m_nextId{1};
+
+    // VNC thread only
+    std::map<uint64_t, Active> m_active;
+    std::vector<QRect> m_dirty;
+    bool m_allDirty = false;
+};
+
+#endif // REGIONWATCHER_H
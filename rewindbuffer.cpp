@@ -0,0 +1,387 @@
+#include "rewindbuffer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include "compressedframebuffer.h"
+
+namespace {
+
+// Deltas store whole tiles of this many pixels square
+const int TILE_SIZE = 64;
+// At most this many frames per second are kept; the tiles of skipped updates are merged
+const int64_t RECORD_INTERVAL_NS = 250LL * 1000 * 1000;
+// Recording may take at most this share of the VNC thread; slower packing records less often
+const int64_t RECORD_COST_FACTOR = 10;
+// A new keyframe once the deltas since the last one outweigh it, so a rebuild never
+// decompresses more than about two keyframes, or a share of the budget, so the oldest
+// history goes in steps smaller than the whole budget
+const size_t KEYFRAME_BUDGET_SHARE = 8;
+// Keyframes are packed in bands of this many rows, as many as fit in a slice of the VNC
+// thread's time per update
+const int KEYFRAME_BAND_ROWS = 32;
+const int64_t KEYFRAME_SLICE_NS = 2LL * 1000 * 1000;
+
+int64_t steadyNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+void RewindBuffer::setBudget(size_t bytes)
+{
+    m_budget.store(bytes, std::memory_order_relaxed);
+    if (bytes == 0) {
+        clear();
+    }
+}
+
+RewindBuffer::Span RewindBuffer::span() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Span span;
+    if (!m_frames.empty()) {
+        span.frames = static_cast<int>(m_frames.size());
+        span.oldestNs = m_frames.front().timeNs;
+        span.newestNs = m_frames.back().timeNs;
+    }
+    return span;
+}
+
+size_t RewindBuffer::storedBytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_storedBytes;
+}
+
+void RewindBuffer::rectDecoded(const QRect &rect)
+{
+    if (m_columns == 0) {
+        return;
+    }
+    QRect tiles = rect & QRect(0, 0, m_width, m_height);
+    if (tiles.isEmpty()) {
+        return;
+    }
+    for (int row = tiles.y() / TILE_SIZE; row <= tiles.bottom() / TILE_SIZE; row++) {
+        for (int column = tiles.x() / TILE_SIZE; column <= tiles.right() / TILE_SIZE; column++) {
+            m_dirtyTiles[row * m_columns + column] = 1;
+            m_keyframeTiles[row * m_columns + column] = 1;
+        }
+    }
+    m_dirty = true;
+    m_keyframeDirty = true;
+}
+
+void RewindBuffer::updateFinished(const FramebufferView &fb, int64_t nowNs)
+{
+    if (budget() == 0 || !fb.pixels || fb.width <= 0 || fb.height <= 0) {
+        m_needKeyframe = true;
+        m_packing = false;
+        m_keyframe = Frame();
+        return;
+    }
+    if (fb.width != m_width || fb.height != m_height || fb.bytesPerPixel != m_bytesPerPixel) {
+        // Desktop resize or new pixel format: earlier frames keep their own size
+        m_width = fb.width;
+        m_height = fb.height;
+        m_bytesPerPixel = fb.bytesPerPixel;
+        m_columns = (fb.width + TILE_SIZE - 1) / TILE_SIZE;
+        m_dirtyTiles.assign(static_cast<size_t>(m_columns) * ((fb.height + TILE_SIZE - 1) / TILE_SIZE), 0);
+        m_keyframeTiles.assign(m_dirtyTiles.size(), 0);
+        m_needKeyframe = true;
+        m_packing = false;
+        m_keyframe = Frame();
+    }
+
+    if (!m_packing && (m_needKeyframe || m_deltaBytes >= std::min(m_keyframeBytes, budget() / KEYFRAME_BUDGET_SHARE))) {
+        startKeyframe(fb);
+    }
+    // Deltas go on against the previous keyframe while the next one is packed
+    if (!m_needKeyframe && m_dirty && nowNs >= m_nextRecordNs) {
+        int64_t start = steadyNanos();
+        // Out of memory, a codec failure or a history dropped meanwhile: start over with a keyframe
+        m_needKeyframe = !recordDelta(fb, m_dirtyTiles, nowNs);
+        m_nextRecordNs = nowNs + std::max(RECORD_INTERVAL_NS, (steadyNanos() - start) * RECORD_COST_FACTOR);
+        std::fill(m_dirtyTiles.begin(), m_dirtyTiles.end(), 0);
+        m_dirty = false;
+    }
+    if (m_packing && continueKeyframe(fb, nowNs)) {
+        // Later deltas build on the new keyframe
+        std::fill(m_dirtyTiles.begin(), m_dirtyTiles.end(), 0);
+        m_dirty = false;
+    }
+}
+
+void RewindBuffer::suspend()
+{
+    clear();
+    m_needKeyframe = true;
+    m_packing = false;
+    m_keyframe = Frame();
+    m_dirty = false;
+}
+
+void RewindBuffer::startKeyframe(const FramebufferView &fb)
+{
+    m_keyframe = Frame();
+    m_keyframe.keyframe = true;
+    m_keyframe.width = fb.width;
+    m_keyframe.height = fb.height;
+    m_keyframe.bytesPerPixel = fb.bytesPerPixel;
+    m_keyframeRow = 0;
+    std::fill(m_keyframeTiles.begin(), m_keyframeTiles.end(), 0);
+    m_keyframeDirty = false;
+    m_packing = true;
+}
+
+bool RewindBuffer::continueKeyframe(const FramebufferView &fb, int64_t nowNs)
+{
+    int64_t start = steadyNanos();
+    do {
+        int rows = std::min(KEYFRAME_BAND_ROWS, fb.height - m_keyframeRow);
+        QByteArray band = packRows(fb, m_keyframeRow, rows);
+        if (band.isEmpty()) {
+            // Out of memory or a codec failure: try again from the top next time
+            m_packing = false;
+            m_keyframe = Frame();
+            return false;
+        }
+        m_keyframe.bands.push_back(std::move(band));
+        m_keyframeRow += rows;
+    } while (m_keyframeRow < fb.height && steadyNanos() - start < KEYFRAME_SLICE_NS);
+    if (m_keyframeRow < fb.height) {
+        return false;
+    }
+
+    m_packing = false;
+    m_keyframe.timeNs = nowNs;
+    size_t keyframeBytes = 0;
+    for (const QByteArray &band : m_keyframe.bands) {
+        keyframeBytes += band.size();
+    }
+    bool stored = store(std::move(m_keyframe));
+    m_keyframe = Frame();
+    if (!stored) {
+        m_needKeyframe = true;
+        return false;
+    }
+    m_keyframeBytes = keyframeBytes;
+    m_deltaBytes = 0;
+    // Bands packed early miss what changed after them. The delta carrying those tiles has
+    // the keyframe's time, so frameAt() never shows the keyframe without it.
+    m_needKeyframe = m_keyframeDirty && !recordDelta(fb, m_keyframeTiles, nowNs);
+    return !m_needKeyframe;
+}
+
+bool RewindBuffer::recordDelta(const FramebufferView &fb, const std::vector<uint8_t> &dirtyTiles, int64_t nowNs)
+{
+    Frame frame;
+    frame.timeNs = nowNs;
+    frame.width = fb.width;
+    frame.height = fb.height;
+    frame.bytesPerPixel = fb.bytesPerPixel;
+    try {
+        // The dirty tiles' rows one after the other
+        m_packScratch.clear();
+        for (int tile = 0; tile < static_cast<int>(dirtyTiles.size()); tile++) {
+            if (!dirtyTiles[tile]) {
+                continue;
+            }
+            frame.tiles.push_back(tile);
+            QRect rect = tileRect(tile, fb.width, fb.height);
+            size_t rowBytes = static_cast<size_t>(rect.width()) * fb.bytesPerPixel;
+            for (int row = rect.y(); row <= rect.bottom(); row++) {
+                const uint8_t *src = fb.pixels + static_cast<size_t>(row) * fb.stride + rect.x() * fb.bytesPerPixel;
+                m_packScratch.insert(m_packScratch.end(), src, src + rowBytes);
+            }
+        }
+        if (m_packScratch.size() > INT_MAX) {
+            return false;
+        }
+        frame.data = packFramebufferBytes(m_packScratch.data(), static_cast<int>(m_packScratch.size()));
+    } catch (const std::bad_alloc &) {
+        return false;
+    }
+    if (frame.data.isEmpty()) {
+        return false;
+    }
+    m_deltaBytes += frame.data.size();
+    return store(std::move(frame));
+}
+
+QByteArray RewindBuffer::packRows(const FramebufferView &fb, int y, int rows)
+{
+    size_t rowBytes = static_cast<size_t>(fb.width) * fb.bytesPerPixel;
+    size_t bytes = rowBytes * rows;
+    const uint8_t *src = fb.pixels + static_cast<size_t>(y) * fb.stride;
+    if (bytes > INT_MAX) {
+        return QByteArray();
+    }
+    try {
+        if (static_cast<size_t>(fb.stride) == rowBytes) {
+            return packFramebufferBytes(src, static_cast<int>(bytes));
+        }
+        m_packScratch.resize(bytes);
+        for (int row = 0; row < rows; row++) {
+            memcpy(m_packScratch.data() + row * rowBytes, src + static_cast<size_t>(row) * fb.stride, rowBytes);
+        }
+        return packFramebufferBytes(m_packScratch.data(), static_cast<int>(bytes));
+    } catch (const std::bad_alloc &) {
+        return QByteArray();
+    }
+}
+
+size_t RewindBuffer::Frame::bytes() const
+{
+    size_t total = data.size() + tiles.size() * sizeof(int) + sizeof(Frame);
+    for (const QByteArray &band : bands) {
+        total += band.size() + sizeof(QByteArray);
+    }
+    return total;
+}
+
+bool RewindBuffer::store(Frame &&frame)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    frame.sequence = m_nextSequence++;
+    // A delta only makes sense right after the frame it was taken against
+    if (!frame.keyframe && (m_frames.empty() || m_frames.back().sequence + 1 != frame.sequence)) {
+        return false;
+    }
+    m_storedBytes += frame.bytes();
+    m_frames.push_back(std::move(frame));
+
+    // Drop the oldest keyframe and its deltas while over budget, keeping the newest keyframe
+    size_t budget = m_budget.load(std::memory_order_relaxed);
+    while (m_storedBytes > budget) {
+        auto next = std::find_if(m_frames.begin() + 1, m_frames.end(), [](const Frame &f) { return f.keyframe; });
+        if (next == m_frames.end()) {
+            break;
+        }
+        for (auto it = m_frames.begin(); it != next; ++it) {
+            m_storedBytes -= it->bytes();
+        }
+        m_frames.erase(m_frames.begin(), next);
+    }
+    return true;
+}
+
+void RewindBuffer::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_frames.clear();
+    m_storedBytes = 0;
+}
+
+QRect RewindBuffer::tileRect(int tile, int width, int height)
+{
+    int columns = (width + TILE_SIZE - 1) / TILE_SIZE;
+    QRect rect((tile % columns) * TILE_SIZE, (tile / columns) * TILE_SIZE, TILE_SIZE, TILE_SIZE);
+    return rect & QRect(0, 0, width, height);
+}
+
+QImage RewindBuffer::frameAt(int64_t timeNs, int64_t *frameNs)
+{
+    // Copy what the rebuild needs; the data is shared, not duplicated, and recording goes on meanwhile
+    std::vector<Frame> chain;
+    uint64_t keyframe = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_frames.empty()) {
+            return QImage();
+        }
+        // The last of the frames with that time: a keyframe is followed by the delta that completes it
+        auto after = std::upper_bound(m_frames.begin(), m_frames.end(), std::max(timeNs, m_frames.front().timeNs),
+                                      [](int64_t t, const Frame &f) { return t < f.timeNs; });
+        size_t target = (after - m_frames.begin()) - 1;
+        size_t first = target;
+        while (!m_frames[first].keyframe) {
+            first--;
+        }
+        keyframe = m_frames[first].sequence;
+        // Forward from the frame rebuilt last if it lies between the keyframe and the target
+        if (m_rebuiltKeyframe == keyframe && m_rebuiltSequence >= keyframe && m_rebuiltSequence <= m_frames[target].sequence) {
+            first += m_rebuiltSequence - keyframe + 1;
+        }
+        chain.assign(m_frames.begin() + first, m_frames.begin() + target + 1);
+        if (frameNs) {
+            *frameNs = m_frames[target].timeNs;
+        }
+    }
+
+    for (const Frame &frame : chain) {
+        if (!applyFrame(frame)) {
+            m_rebuiltSequence = 0;
+            return QImage();
+        }
+        m_rebuiltSequence = frame.sequence;
+    }
+    m_rebuiltKeyframe = keyframe;
+
+    QImage::Format format = m_rebuiltBytesPerPixel == 2 ? QImage::Format_RGB16 : QImage::Format_RGB32;
+    if (m_rebuiltBytesPerPixel != 2 && m_rebuiltBytesPerPixel != 4) {
+        return QImage();
+    }
+    return QImage(m_pixels.data(), m_rebuiltWidth, m_rebuiltHeight, m_rebuiltWidth * m_rebuiltBytesPerPixel, format);
+}
+
+void RewindBuffer::releaseFrame()
+{
+    m_pixels.clear();
+    m_pixels.shrink_to_fit();
+    m_unpackScratch.clear();
+    m_unpackScratch.shrink_to_fit();
+    m_rebuiltSequence = 0;
+    m_rebuiltKeyframe = 0;
+}
+
+bool RewindBuffer::applyFrame(const Frame &frame)
+{
+    try {
+        size_t rowBytes = static_cast<size_t>(frame.width) * frame.bytesPerPixel;
+        if (frame.keyframe) {
+            m_pixels.resize(rowBytes * frame.height);
+            m_rebuiltWidth = frame.width;
+            m_rebuiltHeight = frame.height;
+            m_rebuiltBytesPerPixel = frame.bytesPerPixel;
+            int row = 0;
+            for (const QByteArray &band : frame.bands) {
+                int rows = std::min(KEYFRAME_BAND_ROWS, frame.height - row);
+                if (rows <= 0 || !unpackFramebufferBytes(band, m_pixels.data() + row * rowBytes, static_cast<int>(rows * rowBytes))) {
+                    return false;
+                }
+                row += rows;
+            }
+            return row == frame.height;
+        }
+        if (frame.width != m_rebuiltWidth || frame.height != m_rebuiltHeight || frame.bytesPerPixel != m_rebuiltBytesPerPixel) {
+            return false;
+        }
+
+        size_t bytes = 0;
+        for (int tile : frame.tiles) {
+            QRect rect = tileRect(tile, frame.width, frame.height);
+            bytes += static_cast<size_t>(rect.width()) * frame.bytesPerPixel * rect.height();
+        }
+        m_unpackScratch.resize(bytes);
+        if (!unpackFramebufferBytes(frame.data, m_unpackScratch.data(), static_cast<int>(bytes))) {
+            return false;
+        }
+        const uint8_t *src = m_unpackScratch.data();
+        for (int tile : frame.tiles) {
+            QRect rect = tileRect(tile, frame.width, frame.height);
+            size_t tileRowBytes = static_cast<size_t>(rect.width()) * frame.bytesPerPixel;
+            for (int row = rect.y(); row <= rect.bottom(); row++) {
+                memcpy(m_pixels.data() + row * rowBytes + rect.x() * frame.bytesPerPixel, src, tileRowBytes);
+                src += tileRowBytes;
+            }
+        }
+        return true;
+    } catch (const std::bad_alloc &) {
+        return false;
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef REWINDBUFFER_H
+#define REWINDBUFFER_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QRect>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include "framebufferops.h"
+
+// Recent history of the desktop for scrubbing back in time. After an update the VNC thread
+// records a frame, at most every few hundred milliseconds and only if something changed:
+// the tiles the decoded rectangles touched since the previous frame. Now and then it also
+// packs a keyframe of the whole framebuffer, a few bands of rows per update so decoding
+// never waits for a whole frame to compress; the tiles that changed while it was packed
+// follow in a delta with the same time. When the history outgrows its budget the oldest
+// keyframe goes together with its deltas; the newest keyframe is always kept.
+//
+// The GUI thread rebuilds a stored frame from the keyframe before it. Scrubbing forward
+// continues from the frame rebuilt last, so only the deltas in between are applied.
+class RewindBuffer
+{
+public:
+    struct Span
+    {
+        int frames = 0;
+        int64_t oldestNs = 0;
+        int64_t newestNs = 0;
+    };
+
+    // Any thread; 0 stops recording and drops the history
+    void setBudget(size_t bytes);
+    size_t budget() const { return m_budget.load(std::memory_order_relaxed); }
+    Span span() const;
+    size_t storedBytes() const;
+
+    // VNC thread: per decoded rectangle that changed pixels, and after each completed update
+    void rectDecoded(const QRect &rect);
+    void updateFinished(const FramebufferView &fb, int64_t nowNs);
+    // The framebuffer cannot be read for a while (compressed): drops the history, which
+    // starts over with a keyframe
+    void suspend();
+
+    // GUI thread: the last frame recorded at or before timeNs (the oldest one if timeNs is
+    // older), null if there is none. The image uses memory of the buffer and stays valid until
+    // the next frameAt() or releaseFrame().
+    QImage frameAt(int64_t timeNs, int64_t *frameNs = nullptr);
+    void releaseFrame();
+
+private:
+    struct Frame
+    {
+        uint64_t sequence = 0;
+        int64_t timeNs = 0;
+        bool keyframe = false;
+        int width = 0;
+        int height = 0;
+        int bytesPerPixel = 0;
+        std::vector<int> tiles;           // Deltas: tile indices, row-major, in the order of data
+        QByteArray data;                  // Deltas: the tiles' rows one after the other
+        std::vector<QByteArray> bands;    // Keyframes: KEYFRAME_BAND_ROWS rows each, packed separately
+
+        size_t bytes() const;
+    };
+
+    void startKeyframe(const FramebufferView &fb);
+    // Packs bands for a slice of time; true once the keyframe is stored
+    bool continueKeyframe(const FramebufferView &fb, int64_t nowNs);
+    bool recordDelta(const FramebufferView &fb, const std::vector<uint8_t> &dirtyTiles, int64_t nowNs);
+    QByteArray packRows(const FramebufferView &fb, int y, int rows);
+    bool store(Frame &&frame);
+    void clear();
+    static QRect tileRect(int tile, int width, int height);
+    bool applyFrame(const Frame &frame);
+
+    std::atomic<size_t> m_budget{0};
+
+    // Shared with the GUI thread
+    mutable std::mutex m_mutex;
+    std::deque<Frame> m_frames;
+    size_t m_storedBytes = 0;
+
+    // VNC thread only
+    std::vector<uint8_t> m_dirtyTiles;   // One flag per tile of the framebuffer recorded last
+    std::vector<uint8_t> m_keyframeTiles;   // Tiles changed since the keyframe being packed began
+    int m_width = 0;
+    int m_height = 0;
+    int m_bytesPerPixel = 0;
+    int m_columns = 0;
+    bool m_needKeyframe = true;          // No keyframe to add deltas to
+    bool m_dirty = false;
+    bool m_packing = false;              // A keyframe is being packed into m_keyframe
+    bool m_keyframeDirty = false;
+    Frame m_keyframe;
+    int m_keyframeRow = 0;               // First row not packed yet
+    uint64_t m_nextSequence = 1;
+    int64_t m_nextRecordNs = 0;
+    size_t m_keyframeBytes = 0;          // Compressed size of the newest keyframe
+    size_t m_deltaBytes = 0;             // Deltas recorded since
+    std::vector<uint8_t> m_packScratch;
+
+    // GUI thread only: the frame rebuilt last
+    std::vector<uint8_t> m_pixels;
+    std::vector<uint8_t> m_unpackScratch;
+    uint64_t m_rebuiltSequence = 0;
+    uint64_t m_rebuiltKeyframe = 0;
+    int m_rebuiltWidth = 0;
+    int m_rebuiltHeight = 0;
+    int m_rebuiltBytesPerPixel = 0;
+};
+
+#endif // REWINDBUFFER_H
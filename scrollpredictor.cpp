@@ -0,0 +1,161 @@
+#include "scrollpredictor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+// Answers to learn from before predicting, per direction
+const int MIN_SAMPLES = 2;
+// Weight of the newest sample in the learned distance and round trip
+const double LEARN_RATE = 0.3;
+// Clicks not answered by a scroll within this long are not learned from
+const std::chrono::milliseconds LEARN_WINDOW(1500);
+// A scroll area not seen for this long is not predicted into
+const std::chrono::seconds AREA_LIFETIME(30);
+// Bounds of the time an unanswered prediction stays on screen (3 round trips)
+const std::chrono::milliseconds MIN_TIMEOUT(250);
+const std::chrono::milliseconds MAX_TIMEOUT(2000);
+
+void ScrollPredictor::setEnabled(bool enabled)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_enabled.store(enabled, std::memory_order_relaxed);
+    if (!enabled && m_offset != 0) {
+        m_offset = 0;
+        m_changed = true;
+    }
+}
+
+bool ScrollPredictor::wheelSent(const QPoint &pos, bool up)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Clock::time_point now = Clock::now();
+
+    // A change of direction starts a new measurement
+    if (m_pendingClicks > 0 && m_pendingUp != up) {
+        m_pendingClicks = 0;
+    }
+    if (m_pendingClicks == 0) {
+        m_firstPending = now;
+    }
+    m_pendingUp = up;
+    m_pendingClicks++;
+    m_lastClick = now;
+
+    int direction = up ? 0 : 1;
+    if (!isEnabled() || m_samples[direction] < MIN_SAMPLES || !m_area.contains(pos) || now - m_areaTime > AREA_LIFETIME) {
+        return false;
+    }
+    // Never run further ahead than the area is tall
+    int step = static_cast<int>(std::lround(m_pixelsPerClick[direction]));
+    int limit = m_area.height() - 1;
+    int offset = std::clamp(m_offset + step, -limit, limit);
+    if (offset == m_offset) {
+        return false;
+    }
+    m_offset = offset;
+    return true;
+}
+
+void ScrollPredictor::copyReceived(const QRect &source, int dx, int dy)
+{
+    if (dx != 0 || dy == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Windows scrolling side by side come as several CopyRects; learn from the largest
+    QRect moved = source | source.translated(0, dy);
+    int64_t pixels = static_cast<int64_t>(source.width()) * source.height();
+    if (pixels > m_updateCopyPixels) {
+        m_updateCopyPixels = pixels;
+        m_updateDy = dy;
+        m_updateArea = moved;
+    }
+
+    // The server caught up with (part of) the prediction for this area
+    if (m_offset != 0 && m_area.intersects(moved)) {
+        int offset = m_offset - dy;
+        m_offset = (offset > 0) == (m_offset > 0) ? offset : 0;
+        m_changed = true;
+    }
+}
+
+void ScrollPredictor::rectReceived(const QRect &rect)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_offset != 0) {
+        QRect redrawn = rect & m_area;
+        m_updateRedrawnPixels += static_cast<int64_t>(redrawn.width()) * redrawn.height();
+    }
+}
+
+bool ScrollPredictor::updateFinished()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Clock::time_point now = Clock::now();
+
+    if (m_updateDy != 0) {
+        if (m_pendingClicks > 0 && now - m_firstPending <= LEARN_WINDOW) {
+            int direction = m_pendingUp ? 0 : 1;
+            double sample = static_cast<double>(m_updateDy) / m_pendingClicks;
+            // Applications can reverse scrolling; a sign change relearns from scratch
+            if (m_samples[direction] == 0 || (sample > 0) != (m_pixelsPerClick[direction] > 0)) {
+                m_pixelsPerClick[direction] = sample;
+                m_samples[direction] = 1;
+            } else {
+                m_pixelsPerClick[direction] += LEARN_RATE * (sample - m_pixelsPerClick[direction]);
+                m_samples[direction]++;
+            }
+            double roundTripMs = std::chrono::duration<double, std::milli>(now - m_firstPending).count();
+            m_roundTripMs = m_roundTripMs == 0.0 ? roundTripMs : m_roundTripMs + LEARN_RATE * (roundTripMs - m_roundTripMs);
+        }
+        m_pendingClicks = 0;
+        m_area = m_updateArea;
+        m_areaTime = now;
+    } else if (m_offset != 0 && m_updateRedrawnPixels * 2 >= static_cast<int64_t>(m_area.width()) * m_area.height()) {
+        // The server redrew the area instead of moving it; its pixels replace the guess
+        m_offset = 0;
+        m_changed = true;
+    }
+    if (m_pendingClicks > 0 && now - m_firstPending > LEARN_WINDOW) {
+        m_pendingClicks = 0;
+    }
+    expireLocked(now);
+
+    m_updateDy = 0;
+    m_updateArea = QRect();
+    m_updateCopyPixels = 0;
+    m_updateRedrawnPixels = 0;
+    bool changed = m_changed;
+    m_changed = false;
+    return changed;
+}
+
+ScrollPredictor::Prediction ScrollPredictor::prediction()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    expireLocked(Clock::now());
+    Prediction result;
+    if (m_offset != 0) {
+        result.area = m_area;
+        result.dy = m_offset;
+    }
+    return result;
+}
+
+std::chrono::milliseconds ScrollPredictor::timeout() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto roundTrips = std::chrono::milliseconds(static_cast<int64_t>(3 * m_roundTripMs));
+    return std::clamp(roundTrips, MIN_TIMEOUT, MAX_TIMEOUT);
+}
+
+void ScrollPredictor::expireLocked(Clock::time_point now)
+{
+    auto roundTrips = std::chrono::milliseconds(static_cast<int64_t>(3 * m_roundTripMs));
+    if (m_offset != 0 && now - m_lastClick > std::clamp(roundTrips, MIN_TIMEOUT, MAX_TIMEOUT)) {
+        m_offset = 0;
+        m_changed = true;
+    }
+}
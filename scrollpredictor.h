@@ -0,0 +1,74 @@
+#ifndef SCROLLPREDICTOR_H
+#define SCROLLPREDICTOR_H
+
+#include <QPoint>
+#include <QRect>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+// Speculative wheel scrolling. The server answers a wheel click a round trip later, usually
+// with a CopyRect that moves the scrolling area by some rows. The predictor learns that
+// distance per click and direction, and on the next click shifts the area on screen right
+// away. The shift is only a presentation offset; the framebuffer stays what the server sent.
+// It shrinks by whatever the server's CopyRects move and is dropped once the server redraws
+// the area instead or stays silent for a few round trips.
+class ScrollPredictor
+{
+public:
+    // Speculative area shift, in desktop coordinates; dy == 0 means none
+    struct Prediction
+    {
+        QRect area;
+        int dy = 0;
+    };
+
+    bool isEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+    void setEnabled(bool enabled);
+
+    // GUI thread: a wheel click at pos was sent. True if the prediction moved.
+    bool wheelSent(const QPoint &pos, bool up);
+
+    // VNC thread, per decoded rectangle and at the end of each framebuffer update.
+    // updateFinished returns true if the prediction changed during the update.
+    void copyReceived(const QRect &source, int dx, int dy);
+    void rectReceived(const QRect &rect);
+    bool updateFinished();
+
+    // Any thread
+    Prediction prediction();
+    // How long an unanswered prediction is kept
+    std::chrono::milliseconds timeout() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void expireLocked(Clock::time_point now);
+
+    std::atomic<bool> m_enabled{false};
+    mutable std::mutex m_mutex;
+
+    // Learned scroll distance in desktop pixels per click, [0] up and [1] down
+    double m_pixelsPerClick[2] = {0.0, 0.0};
+    int m_samples[2] = {0, 0};
+    double m_roundTripMs = 0.0;
+    QRect m_area;                     // Area moved by the latest scroll
+    Clock::time_point m_areaTime;
+
+    // Clicks sent that the server has not answered yet
+    int m_pendingClicks = 0;
+    bool m_pendingUp = false;
+    Clock::time_point m_firstPending;
+    Clock::time_point m_lastClick;
+
+    // The framebuffer update being decoded
+    int m_updateDy = 0;
+    QRect m_updateArea;
+    int64_t m_updateCopyPixels = 0;
+    int64_t m_updateRedrawnPixels = 0;
+    bool m_changed = false;
+
+    int m_offset = 0;                 // Predicted rows not yet matched by the server's moves
+};
+
+#endif // SCROLLPREDICTOR_H
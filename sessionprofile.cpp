@@ -0,0 +1,154 @@
+#include "sessionprofile.h"
+
+#include <QSettings>
+
+namespace {
+
+struct BuiltinProfile
+{
+    const char *name;
+    const char *encodings;
+    int compressLevel;
+    int qualityLevel;
+    int bitsPerPixel;
+    int pollIntervalUs;
+    int maxFps;
+};
+
+// All of them offer CopyRect, which turns scrolls and window moves into a 4-byte rectangle.
+// lan:         cheap-to-decode encodings, full colour, lowest latency (the previous defaults)
+// wan:         zlib/JPEG encodings trade client CPU for far fewer bytes
+// lowcpu:      no zlib or JPEG decoding, fewer idle wakeups of the VNC thread
+// monitorwall: many view-only sessions per machine, 16-bit colour, heavy compression, 5 fps
+const BuiltinProfile BUILTIN_PROFILES[] = {
+    {"lan", "copyrect hextile raw", 0, 9, 32, 500, 0},
+    {"wan", "copyrect tight zrle zlib hextile raw", 6, 6, 32, 500, 0},
+    {"lowcpu", "copyrect hextile raw", 0, 9, 32, 20000, 30},
+    {"monitorwall", "copyrect tight zrle hextile raw", 9, 4, 16, 50000, 5},
+};
+
+const int MAX_FPS_LIMIT = 240;
+
+}
+
+bool SessionProfile::named(const QString &name, SessionProfile &profile)
+{
+    for (const BuiltinProfile &builtin : BUILTIN_PROFILES) {
+        if (name.compare(QLatin1String(builtin.name), Qt::CaseInsensitive) == 0) {
+            profile.name = QString::fromLatin1(builtin.name);
+            profile.encodings = QString::fromLatin1(builtin.encodings);
+            profile.compressLevel = builtin.compressLevel;
+            profile.qualityLevel = builtin.qualityLevel;
+            profile.bitsPerPixel = builtin.bitsPerPixel;
+            profile.pollIntervalUs = builtin.pollIntervalUs;
+            profile.maxFps = builtin.maxFps;
+            return true;
+        }
+    }
+    return false;
+}
+
+QStringList SessionProfile::names()
+{
+    QStringList result;
+    for (const BuiltinProfile &builtin : BUILTIN_PROFILES) {
+        result << QString::fromLatin1(builtin.name);
+    }
+    return result;
+}
+
+SessionProfile SessionProfile::load(QSettings &settings, const QString &serverKey)
+{
+    SessionProfile profile;
+    named("lan", profile);
+
+    // A stored profile name restores the built-in values, stored fields then win over them
+    SessionProfile stored;
+    if (settings.contains(serverKey + "/profile")) {
+        named(settings.value(serverKey + "/profile").toString(), stored);
+        stored.name = settings.value(serverKey + "/profile").toString();
+    }
+    if (settings.contains(serverKey + "/encodings")) {
+        stored.encodings = settings.value(serverKey + "/encodings").toString();
+    }
+    if (settings.contains(serverKey + "/compressLevel")) {
+        stored.compressLevel = settings.value(serverKey + "/compressLevel").toInt();
+    }
+    if (settings.contains(serverKey + "/qualityLevel")) {
+        stored.qualityLevel = settings.value(serverKey + "/qualityLevel").toInt();
+    }
+    if (settings.contains(serverKey + "/bitsPerPixel")) {
+        stored.bitsPerPixel = settings.value(serverKey + "/bitsPerPixel").toInt();
+    }
+    if (settings.contains(serverKey + "/pollIntervalUs")) {
+        stored.pollIntervalUs = settings.value(serverKey + "/pollIntervalUs").toInt();
+    }
+    if (settings.contains(serverKey + "/maxFps")) {
+        stored.maxFps = settings.value(serverKey + "/maxFps").toInt();
+    }
+    profile.merge(stored);
+
+    // Hand-edited settings must not break the connection
+    if (!profile.isValid()) {
+        named("lan", profile);
+    }
+    return profile;
+}
+
+void SessionProfile::save(QSettings &settings, const QString &serverKey) const
+{
+    settings.setValue(serverKey + "/profile", name);
+    settings.setValue(serverKey + "/encodings", encodings);
+    settings.setValue(serverKey + "/compressLevel", compressLevel);
+    settings.setValue(serverKey + "/qualityLevel", qualityLevel);
+    settings.setValue(serverKey + "/bitsPerPixel", bitsPerPixel);
+    settings.setValue(serverKey + "/pollIntervalUs", pollIntervalUs);
+    settings.setValue(serverKey + "/maxFps", maxFps);
+}
+
+void SessionProfile::merge(const SessionProfile &overrides)
+{
+    if (!overrides.name.isEmpty()) {
+        name = overrides.name;
+    }
+    if (!overrides.encodings.isEmpty()) {
+        encodings = overrides.encodings;
+    }
+    if (overrides.compressLevel >= 0) {
+        compressLevel = overrides.compressLevel;
+    }
+    if (overrides.qualityLevel >= 0) {
+        qualityLevel = overrides.qualityLevel;
+    }
+    if (overrides.bitsPerPixel > 0) {
+        bitsPerPixel = overrides.bitsPerPixel;
+    }
+    if (overrides.pollIntervalUs > 0) {
+        pollIntervalUs = overrides.pollIntervalUs;
+    }
+    if (overrides.maxFps >= 0) {
+        maxFps = overrides.maxFps;
+    }
+}
+
+bool SessionProfile::isValid(QString *error) const
+{
+    QString message;
+    if (encodings.trimmed().isEmpty()) {
+        message = "encodings must not be empty";
+    } else if (compressLevel < 0 || compressLevel > 9) {
+        message = "compression level must be 0-9";
+    } else if (qualityLevel < 0 || qualityLevel > 9) {
+        message = "quality level must be 0-9";
+    } else if (bitsPerPixel != 16 && bitsPerPixel != 32) {
+        message = "pixel depth must be 16 or 32";
+    } else if (pollIntervalUs <= 0) {
+        message = "poll interval must be positive";
+    } else if (maxFps < 0 || maxFps > MAX_FPS_LIMIT) {
+        message = QString("frame rate cap must be 0 (unlimited) to %1").arg(MAX_FPS_LIMIT);
+    }
+    if (error) {
+        *error = message;
+    }
+    return message.isEmpty();
+}
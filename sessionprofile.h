@@ -0,0 +1,33 @@
+#ifndef SESSIONPROFILE_H
+#define SESSIONPROFILE_H
+
+#include <QString>
+#include <QStringList>
+
+class QSettings;
+
+// Connection tuning applied in connectToServer. Fields left unset (empty / -1) in an
+// override keep the value they are merged into.
+struct SessionProfile
+{
+    QString name;              // Built-in profile the values started from
+    QString encodings;         // libvncclient encodingsString
+    int compressLevel = -1;    // 0-9, zlib-based encodings
+    int qualityLevel = -1;     // 0-9, JPEG in tight
+    int bitsPerPixel = -1;     // 32 (RGB888) or 16 (RGB565)
+    int pollIntervalUs = -1;   // WaitForMessage timeout of the VNC thread
+    int maxFps = -1;           // Framebuffer updates per second, 0 = as many as the server sends
+
+    // Built-in profile by name; false if the name is unknown
+    static bool named(const QString &name, SessionProfile &profile);
+    static QStringList names();
+
+    // Values stored under serverKey, or the lan profile for servers without any
+    static SessionProfile load(QSettings &settings, const QString &serverKey);
+    void save(QSettings &settings, const QString &serverKey) const;
+
+    void merge(const SessionProfile &overrides);
+    bool isValid(QString *error = nullptr) const;
+};
+
+#endif // SESSIONPROFILE_H
@@ -0,0 +1,145 @@
+#include "sharedframebuffer.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+SharedFramebuffer::~SharedFramebuffer()
+{
+    release();
+}
+
+bool SharedFramebuffer::create(const std::string &name, size_t pixelBytes)
+{
+    release();
+
+    size_t size = pixelOffset() + pixelBytes;
+
+#ifdef _WIN32
+    std::string objectName = "Local\\" + name;
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                        static_cast<DWORD>(static_cast<uint64_t>(size) >> 32),
+                                        static_cast<DWORD>(size & 0xffffffff), objectName.c_str());
+    if (!mapping) {
+        std::cerr << "[ERROR] CreateFileMapping failed for " << objectName << ": " << GetLastError() << std::endl;
+        return false;
+    }
+    void *base = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (!base) {
+        std::cerr << "[ERROR] MapViewOfFile failed for " << objectName << ": " << GetLastError() << std::endl;
+        CloseHandle(mapping);
+        return false;
+    }
+    m_mapping = mapping;
+#else
+    std::string objectName = "/" + name;
+    int fd = shm_open(objectName.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+    if (fd < 0) {
+        std::cerr << "[ERROR] shm_open failed for " << objectName << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        std::cerr << "[ERROR] ftruncate failed for " << objectName << ": " << strerror(errno) << std::endl;
+        close(fd);
+        shm_unlink(objectName.c_str());
+        return false;
+    }
+    void *base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        std::cerr << "[ERROR] mmap failed for " << objectName << ": " << strerror(errno) << std::endl;
+        close(fd);
+        shm_unlink(objectName.c_str());
+        return false;
+    }
+    m_fd = fd;
+#endif
+
+    m_name = name;
+    m_base = base;
+    m_size = size;
+    m_pixelBytes = pixelBytes;
+
+    // Fresh mappings are zeroed by the OS; only the header needs filling in. The sequence
+    // starts odd, the segment holds no complete frame until the first publish().
+    SharedFramebufferHeader *hdr = new (base) SharedFramebufferHeader();
+    hdr->magic = SharedFramebufferHeader::MAGIC;
+    hdr->version = SharedFramebufferHeader::VERSION;
+    hdr->pixelOffset = static_cast<uint32_t>(pixelOffset());
+    hdr->sequence.store(1, std::memory_order_relaxed);
+    hdr->state.store(SharedFramebufferHeader::Live, std::memory_order_release);
+    return true;
+}
+
+void SharedFramebuffer::release()
+{
+    if (!m_base) {
+        return;
+    }
+
+    // Tell readers still mapping this segment to look for its replacement
+    header()->state.store(SharedFramebufferHeader::Replaced, std::memory_order_release);
+
+#ifdef _WIN32
+    UnmapViewOfFile(m_base);
+    CloseHandle(static_cast<HANDLE>(m_mapping));
+    m_mapping = nullptr;
+#else
+    munmap(m_base, m_size);
+    close(m_fd);
+    shm_unlink(("/" + m_name).c_str());
+    m_fd = -1;
+#endif
+
+    m_base = nullptr;
+    m_size = 0;
+    m_pixelBytes = 0;
+    m_name.clear();
+}
+
+void SharedFramebuffer::beginWrite()
+{
+    SharedFramebufferHeader *hdr = header();
+    uint64_t sequence = hdr->sequence.load(std::memory_order_relaxed);
+    if (sequence & 1) {
+        return;
+    }
+    hdr->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void SharedFramebuffer::publish(const SharedFramebufferDirtyRect *rects, size_t count)
+{
+    beginWrite();
+
+    SharedFramebufferHeader *hdr = header();
+    uint64_t frame = hdr->frame.load(std::memory_order_relaxed) + 1;
+    uint64_t dirtyCount = hdr->dirtyCount.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < count; i++) {
+        SharedFramebufferDirtyRect &entry = hdr->dirty[dirtyCount % SharedFramebufferHeader::DIRTY_RING_SIZE];
+        entry = rects[i];
+        entry.frame = frame;
+        dirtyCount++;
+    }
+    hdr->dirtyCount.store(dirtyCount, std::memory_order_relaxed);
+    hdr->frame.store(frame, std::memory_order_relaxed);
+
+    endWrite();
+}
+
+void SharedFramebuffer::endWrite()
+{
+    SharedFramebufferHeader *hdr = header();
+    uint64_t sequence = hdr->sequence.load(std::memory_order_relaxed);
+    if (sequence & 1) {
+        hdr->sequence.store(sequence + 1, std::memory_order_release);
+    }
+}
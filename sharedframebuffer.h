@@ -0,0 +1,98 @@
+#ifndef SHAREDFRAMEBUFFER_H
+#define SHAREDFRAMEBUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Rectangle changed by update number frame
+struct SharedFramebufferDirtyRect
+{
+    uint64_t frame;
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+};
+
+// Layout at the start of a shared framebuffer segment. Pixels follow at pixelOffset.
+// Local consumers map the segment read-only by name (POSIX shm_open("/<name>") or
+// Windows OpenFileMapping("Local\\<name>")).
+//
+// sequence is a seqlock: odd while the decoders write pixels or the dirty ring. Readers load
+// it (acquire), skip odd values, read what they need in place, issue an acquire fence and
+// reload it; a changed value means the read raced an update and must be retried. Rectangle i
+// of all rectangles ever published is dirty[i % DIRTY_RING_SIZE]; readers that fell more than
+// DIRTY_RING_SIZE rectangles behind treat the whole frame as dirty.
+struct SharedFramebufferHeader
+{
+    static const uint32_t MAGIC = 0x42465657;  // "WVFB"
+    static const uint32_t VERSION = 2;
+    static const uint32_t DIRTY_RING_SIZE = 512;
+
+    enum State : uint32_t { Live = 1, Replaced = 2 };
+
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint32_t> state;   // Replaced once the desktop is resized and segment generation + 1 exists
+    uint32_t pixelOffset;          // Bytes from segment start to pixel (0, 0)
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;               // Bytes per row
+    uint32_t bitsPerPixel;
+    uint32_t redShift;
+    uint32_t greenShift;
+    uint32_t blueShift;
+    uint32_t generation;           // Segment names are <prefix>-<generation>
+    std::atomic<uint64_t> sequence;
+    std::atomic<uint64_t> frame;       // Completed framebuffer updates
+    std::atomic<uint64_t> dirtyCount;  // Rectangles published so far
+    SharedFramebufferDirtyRect dirty[DIRTY_RING_SIZE];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared-memory atomics must be lock-free");
+
+// Named shared-memory segment the decoders write the framebuffer into directly,
+// so local readers get pixels without a copy.
+class SharedFramebuffer
+{
+public:
+    SharedFramebuffer() = default;
+    ~SharedFramebuffer();
+
+    SharedFramebuffer(const SharedFramebuffer &) = delete;
+    SharedFramebuffer &operator=(const SharedFramebuffer &) = delete;
+
+    // Creates a segment holding a header plus pixelBytes; any previous segment is released
+    bool create(const std::string &name, size_t pixelBytes);
+    void release();
+
+    bool isValid() const { return m_base != nullptr; }
+    const std::string &name() const { return m_name; }
+    SharedFramebufferHeader *header() const { return static_cast<SharedFramebufferHeader *>(m_base); }
+    uint8_t *pixels() const { return static_cast<uint8_t *>(m_base) + pixelOffset(); }
+    size_t pixelBytes() const { return m_pixelBytes; }
+
+    // Seqlock for the VNC thread: beginWrite before decoding into pixels(), publish once a
+    // framebuffer update completed, endWrite after messages that turned out not to be updates
+    void beginWrite();
+    void publish(const SharedFramebufferDirtyRect *rects, size_t count);
+    void endWrite();
+
+    // Pixels start on a cache-line boundary after the header
+    static size_t pixelOffset() { return (sizeof(SharedFramebufferHeader) + 63) & ~static_cast<size_t>(63); }
+
+private:
+    std::string m_name;
+    void *m_base = nullptr;
+    size_t m_size = 0;
+    size_t m_pixelBytes = 0;
+#ifdef _WIN32
+    void *m_mapping = nullptr;
+#else
+    int m_fd = -1;
+#endif
+};
+
+#endif // SHAREDFRAMEBUFFER_H
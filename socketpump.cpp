@@ -0,0 +1,400 @@
+#include "socketpump.h"
+#include "metrics.h"
+#include "updatescheduler.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+typedef WSAPOLLFD PumpPollFd;
+#define pumpPoll WSAPoll
+#define closePumpSocket closesocket
+#else
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef struct pollfd PumpPollFd;
+#define pumpPoll poll
+#define closePumpSocket close
+#endif
+
+#ifdef MSG_NOSIGNAL
+const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+const int SEND_FLAGS = 0;
+#endif
+
+// Outbound traffic is input events and update requests, a small buffer is plenty
+const size_t OUTBOUND_CHUNK = 64 * 1024;
+// Kernel buffers of the local pair, so each hand-off to the decoder moves a lot at once
+const int LOCAL_BUFFER_BYTES = 1024 * 1024;
+// Upper bound on how long stop() waits for the thread to notice
+const int POLL_TIMEOUT_MS = 250;
+// The socket is only queried from this thread, which owns (and closes) it
+const std::chrono::seconds RTT_SAMPLE_INTERVAL(1);
+
+namespace {
+
+// Client-to-server message types whose length the pump has to know (RFB 3.8 and the
+// extensions libvncclient sends)
+enum ClientMessage : uint8_t {
+    SetPixelFormat = 0,
+    SetEncodings = 2,
+    FramebufferUpdateRequest = 3,
+    KeyEvent = 4,
+    PointerEvent = 5,
+    ClientCutText = 6,
+    EnableContinuousUpdates = 150,
+    ClientFence = 248,
+    Xvp = 250,
+    SetDesktopSize = 251,
+    QemuEvent = 255,
+};
+
+uint16_t readU16(const uint8_t *data)
+{
+    return static_cast<uint16_t>(data[0] << 8 | data[1]);
+}
+
+uint32_t readU32(const uint8_t *data)
+{
+    return static_cast<uint32_t>(data[0]) << 24 | data[1] << 16 | data[2] << 8 | data[3];
+}
+
+// Length of the message at data: 0 if more bytes are needed to tell, -1 for an unknown type
+int64_t messageLength(const uint8_t *data, size_t size)
+{
+    switch (data[0]) {
+        case SetPixelFormat:
+            return 20;
+        case SetEncodings:
+            return size < 4 ? 0 : 4 + 4 * static_cast<int64_t>(readU16(data + 2));
+        case FramebufferUpdateRequest:
+        case EnableContinuousUpdates:
+            return 10;
+        case KeyEvent:
+            return 8;
+        case PointerEvent:
+            return 6;
+        case ClientCutText: {
+            // Extended clipboard messages send the length negated
+            if (size < 8) {
+                return 0;
+            }
+            int32_t length = static_cast<int32_t>(readU32(data + 4));
+            return 8 + (length < 0 ? -static_cast<int64_t>(length) : length);
+        }
+        case ClientFence:
+            return size < 9 ? 0 : 9 + static_cast<int64_t>(data[8]);
+        case Xvp:
+            return 4;
+        case SetDesktopSize:
+            return size < 7 ? 0 : 8 + 16 * static_cast<int64_t>(data[6]);
+        case QemuEvent:
+            // Only the extended key event has a fixed size
+            return size < 2 ? 0 : (data[1] == 0 ? 12 : -1);
+        default:
+            return -1;
+    }
+}
+
+// Input may overtake held update requests; anything else keeps its order behind them
+bool isInput(uint8_t type)
+{
+    return type == KeyEvent || type == PointerEvent || type == ClientCutText || type == QemuEvent;
+}
+
+bool wouldBlock()
+{
+#ifdef _WIN32
+    int error = WSAGetLastError();
+    return error == WSAEWOULDBLOCK || error == WSAEINTR;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+void setNonBlocking(PumpSocket socket)
+{
+#ifdef _WIN32
+    u_long mode = 1;
+    ioctlsocket(socket, FIONBIO, &mode);
+#else
+    fcntl(socket, F_SETFL, fcntl(socket, F_GETFL, 0) | O_NONBLOCK);
+#endif
+}
+
+void setBufferSizes(PumpSocket socket)
+{
+    int size = LOCAL_BUFFER_BYTES;
+    setsockopt(socket, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char *>(&size), sizeof(size));
+    setsockopt(socket, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char *>(&size), sizeof(size));
+}
+
+// Connected pair of stream sockets; Windows has no socketpair(), so it uses loopback TCP
+bool createSocketPair(PumpSocket &first, PumpSocket &second)
+{
+#ifdef _WIN32
+    SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == INVALID_SOCKET) {
+        return false;
+    }
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    int length = sizeof(address);
+    if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        getsockname(listener, reinterpret_cast<sockaddr *>(&address), &length) != 0 ||
+        listen(listener, 1) != 0) {
+        closesocket(listener);
+        return false;
+    }
+
+    first = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (first == INVALID_SOCKET || connect(first, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        if (first != INVALID_SOCKET) {
+            closesocket(first);
+        }
+        closesocket(listener);
+        return false;
+    }
+    second = accept(listener, nullptr, nullptr);
+    closesocket(listener);
+    if (second == INVALID_SOCKET) {
+        closesocket(first);
+        return false;
+    }
+
+    // Input events must not wait for Nagle on the loopback hop either
+    BOOL noDelay = TRUE;
+    setsockopt(first, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&noDelay), sizeof(noDelay));
+    setsockopt(second, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&noDelay), sizeof(noDelay));
+    return true;
+#else
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0) {
+        return false;
+    }
+    first = sockets[0];
+    second = sockets[1];
+    return true;
+#endif
+}
+
+}
+
+SocketPump::~SocketPump()
+{
+    stop();
+}
+
+bool SocketPump::start(PumpSocket server, size_t capacity)
+{
+    stop();
+
+    if (!createSocketPair(m_pumpEnd, m_clientEnd)) {
+        std::cerr << "[ERROR] Failed to create the local socket pair for the socket reader" << std::endl;
+        return false;
+    }
+    setBufferSizes(m_pumpEnd);
+    setBufferSizes(m_clientEnd);
+    setNonBlocking(m_pumpEnd);
+    setNonBlocking(server);
+
+    m_server = server;
+    m_ring.assign(capacity, 0);
+    m_ringHead = 0;
+    m_ringSize = 0;
+    m_outbound.clear();
+    m_outboundOffset = 0;
+    m_partial.clear();
+    m_held.clear();
+    m_parsing = true;
+    m_rttUs = 0;
+    m_stopping = false;
+    m_thread = std::thread(&SocketPump::run, this);
+    return true;
+}
+
+void SocketPump::stop()
+{
+    if (!m_thread.joinable()) {
+        return;
+    }
+    m_stopping = true;
+    m_thread.join();
+}
+
+void SocketPump::run()
+{
+    bool serverOpen = true;
+    auto nextRttSample = std::chrono::steady_clock::now();
+
+    while (!m_stopping) {
+        auto now = std::chrono::steady_clock::now();
+        if (serverOpen && now >= nextRttSample) {
+            SocketTraffic traffic;
+            if (querySocketTraffic(m_server, traffic) && traffic.rttUs > 0) {
+                m_rttUs.store(traffic.rttUs, std::memory_order_relaxed);
+            }
+            nextRttSample = now + RTT_SAMPLE_INTERVAL;
+        }
+
+        // Held update requests go out once the scheduler allows them
+        UpdateScheduler *pacing = m_pacing.load(std::memory_order_acquire);
+        int timeoutMs = POLL_TIMEOUT_MS;
+        if (!m_held.empty()) {
+            std::chrono::nanoseconds wait = pacing ? pacing->delay(bytesIn()) : std::chrono::nanoseconds(0);
+            if (wait.count() <= 0) {
+                m_outbound.insert(m_outbound.end(), m_held.begin(), m_held.end());
+                m_held.clear();
+                if (pacing) {
+                    pacing->requestSent();
+                }
+                m_pacedNanos.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                           std::chrono::steady_clock::now() - m_heldSince).count(),
+                                       std::memory_order_relaxed);
+            } else {
+                auto waitMs = std::chrono::duration_cast<std::chrono::milliseconds>(wait).count() + 1;
+                timeoutMs = static_cast<int>(std::min<int64_t>(timeoutMs, waitMs));
+            }
+        }
+
+        size_t ringFree = m_ring.size() - m_ringSize;
+        bool outboundPending = m_outboundOffset < m_outbound.size();
+
+        // The server side closed and everything it sent was delivered: pass the EOF on
+        if (!serverOpen && m_ringSize == 0) {
+            break;
+        }
+
+        // Descriptors with nothing to wait for are skipped (negative fd), so a hung-up
+        // socket cannot spin the loop while the other side catches up
+        PumpPollFd fds[2] = {};
+        fds[0].events = static_cast<short>((serverOpen && ringFree > 0 ? POLLIN : 0) | (outboundPending ? POLLOUT : 0));
+        fds[0].fd = fds[0].events ? m_server : INVALID_PUMP_SOCKET;
+        fds[1].events = static_cast<short>((outboundPending ? 0 : POLLIN) | (m_ringSize > 0 ? POLLOUT : 0));
+        fds[1].fd = fds[1].events ? m_pumpEnd : INVALID_PUMP_SOCKET;
+
+        int ready = pumpPoll(fds, 2, timeoutMs);
+        if (ready < 0) {
+            if (wouldBlock()) {
+                continue;
+            }
+            break;
+        }
+        if (ready == 0) {
+            continue;
+        }
+
+        // Server -> ring, into the contiguous free span after the tail
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            if (serverOpen && ringFree > 0) {
+                size_t tail = (m_ringHead + m_ringSize) % m_ring.size();
+                size_t span = std::min(ringFree, m_ring.size() - tail);
+                auto received = recv(m_server, reinterpret_cast<char *>(m_ring.data() + tail), static_cast<int>(span), 0);
+                if (received > 0) {
+                    m_ringSize += static_cast<size_t>(received);
+                    m_bytesIn.fetch_add(static_cast<uint64_t>(received), std::memory_order_relaxed);
+                } else if (received == 0 || !wouldBlock()) {
+                    serverOpen = false;
+                }
+            }
+        }
+
+        // Ring -> decoder
+        if ((fds[1].revents & POLLOUT) && m_ringSize > 0) {
+            size_t span = std::min(m_ringSize, m_ring.size() - m_ringHead);
+            auto sent = send(m_pumpEnd, reinterpret_cast<const char *>(m_ring.data() + m_ringHead), static_cast<int>(span), SEND_FLAGS);
+            if (sent > 0) {
+                m_ringHead = (m_ringHead + static_cast<size_t>(sent)) % m_ring.size();
+                m_ringSize -= static_cast<size_t>(sent);
+            } else if (!wouldBlock()) {
+                break;
+            }
+        }
+        m_buffered.store(m_ringSize, std::memory_order_relaxed);
+
+        // Decoder -> outbound; EOF means the client closed its end (rfbClientCleanup)
+        if ((fds[1].revents & (POLLIN | POLLHUP | POLLERR)) && !outboundPending) {
+            m_outbound.clear();
+            m_outboundOffset = 0;
+            m_chunk.resize(OUTBOUND_CHUNK);
+            auto received = recv(m_pumpEnd, reinterpret_cast<char *>(m_chunk.data()), static_cast<int>(m_chunk.size()), 0);
+            if (received > 0) {
+                queueOutbound(m_chunk.data(), static_cast<size_t>(received));
+            } else if (received == 0 || !wouldBlock()) {
+                break;
+            }
+        }
+
+        // Outbound -> server, right away when the socket has room
+        if (m_outboundOffset < m_outbound.size()) {
+            auto sent = send(m_server, reinterpret_cast<const char *>(m_outbound.data() + m_outboundOffset),
+                             static_cast<int>(m_outbound.size() - m_outboundOffset), SEND_FLAGS);
+            if (sent > 0) {
+                m_outboundOffset += static_cast<size_t>(sent);
+                m_bytesOut.fetch_add(static_cast<uint64_t>(sent), std::memory_order_relaxed);
+            } else if (!wouldBlock()) {
+                break;
+            }
+        }
+    }
+
+    // The decoder sees EOF on its end and reports the disconnect
+    closePumpSocket(m_pumpEnd);
+    closePumpSocket(m_server);
+    m_pumpEnd = INVALID_PUMP_SOCKET;
+    m_server = INVALID_PUMP_SOCKET;
+    m_buffered.store(0, std::memory_order_relaxed);
+}
+
+void SocketPump::queueOutbound(const uint8_t *data, size_t size)
+{
+    if (!m_parsing || !m_pacing.load(std::memory_order_acquire)) {
+        m_outbound.insert(m_outbound.end(), m_held.begin(), m_held.end());
+        m_outbound.insert(m_outbound.end(), m_partial.begin(), m_partial.end());
+        m_outbound.insert(m_outbound.end(), data, data + size);
+        m_held.clear();
+        m_partial.clear();
+        return;
+    }
+
+    // Whole messages only: a request is recognised by its type byte at a message start
+    m_partial.insert(m_partial.end(), data, data + size);
+    size_t offset = 0;
+    while (offset < m_partial.size()) {
+        const uint8_t *message = m_partial.data() + offset;
+        int64_t length = messageLength(message, m_partial.size() - offset);
+        if (length < 0) {
+            // Cannot find the next message start any more, stop pacing this session
+            std::cout << "[INFO] Unknown client message type " << static_cast<int>(message[0])
+                      << ", update requests are no longer paced" << std::endl;
+            m_parsing = false;
+            m_outbound.insert(m_outbound.end(), m_held.begin(), m_held.end());
+            m_outbound.insert(m_outbound.end(), m_partial.begin() + offset, m_partial.end());
+            m_held.clear();
+            m_partial.clear();
+            return;
+        }
+        if (length == 0 || static_cast<size_t>(length) > m_partial.size() - offset) {
+            break;
+        }
+        bool hold = message[0] == FramebufferUpdateRequest || (!m_held.empty() && !isInput(message[0]));
+        if (hold && m_held.empty()) {
+            m_heldSince = std::chrono::steady_clock::now();
+        }
+        std::vector<uint8_t> &target = hold ? m_held : m_outbound;
+        target.insert(target.end(), message, message + length);
+        offset += static_cast<size_t>(length);
+    }
+    m_partial.erase(m_partial.begin(), m_partial.begin() + offset);
+}
@@ -0,0 +1,91 @@
+#ifndef SOCKETPUMP_H
+#define SOCKETPUMP_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+typedef SOCKET PumpSocket;
+const PumpSocket INVALID_PUMP_SOCKET = INVALID_SOCKET;
+#else
+typedef int PumpSocket;
+const PumpSocket INVALID_PUMP_SOCKET = -1;
+#endif
+
+class UpdateScheduler;
+
+// Reader stage in front of libvncclient. A thread drains the server socket into a bounded
+// ring and feeds it to the decoder through a local socket pair that replaces rfbClient::sock,
+// so the next message keeps arriving while the previous one is being decoded. A full ring
+// stops reads from the server, leaving flow control to TCP. Client-to-server traffic is
+// forwarded the other way; with request pacing on, framebuffer update requests (and any
+// non-input message behind them) wait until the scheduler lets them go, while input
+// events pass right away.
+class SocketPump
+{
+public:
+    SocketPump() = default;
+    ~SocketPump();
+
+    SocketPump(const SocketPump &) = delete;
+    SocketPump &operator=(const SocketPump &) = delete;
+
+    // Takes ownership of the connected server socket; the decoder reads clientSocket() instead
+    bool start(PumpSocket server, size_t capacity);
+    // Closes the server socket and joins the thread; clientSocket() stays with its owner
+    void stop();
+
+    // Any thread, once the scheduler is ready to be used from the pump thread; nullptr turns it off
+    void setRequestPacing(UpdateScheduler *scheduler) { m_pacing.store(scheduler, std::memory_order_release); }
+
+    bool isRunning() const { return m_thread.joinable(); }
+    PumpSocket clientSocket() const { return m_clientEnd; }
+
+    uint64_t bytesIn() const { return m_bytesIn.load(std::memory_order_relaxed); }
+    uint64_t bytesOut() const { return m_bytesOut.load(std::memory_order_relaxed); }
+    size_t buffered() const { return m_buffered.load(std::memory_order_relaxed); }
+    // Time update requests were held back by the pacing
+    uint64_t pacedNanos() const { return m_pacedNanos.load(std::memory_order_relaxed); }
+    // Kernel's smoothed round trip time of the server socket, 0 until known
+    uint64_t rttUs() const { return m_rttUs.load(std::memory_order_relaxed); }
+
+private:
+    void run();
+    void queueOutbound(const uint8_t *data, size_t size);
+
+    PumpSocket m_server = INVALID_PUMP_SOCKET;
+    PumpSocket m_pumpEnd = INVALID_PUMP_SOCKET;
+    PumpSocket m_clientEnd = INVALID_PUMP_SOCKET;
+
+    // Server-to-client ring, only touched by the pump thread
+    std::vector<uint8_t> m_ring;
+    size_t m_ringHead = 0;
+    size_t m_ringSize = 0;
+
+    // Client-to-server bytes not yet accepted by the server socket
+    std::vector<uint8_t> m_outbound;
+    size_t m_outboundOffset = 0;
+    std::vector<uint8_t> m_chunk;
+
+    // Update request pacing, only touched by the pump thread
+    std::atomic<UpdateScheduler *> m_pacing{nullptr};
+    std::vector<uint8_t> m_partial;      // Start of a client message not complete yet
+    std::vector<uint8_t> m_held;         // Update requests and the non-input messages after them
+    bool m_parsing = true;               // Off after a message of unknown length: all of it passes
+    std::chrono::steady_clock::time_point m_heldSince;
+
+    std::thread m_thread;
+    std::atomic<bool> m_stopping{false};
+    std::atomic<uint64_t> m_bytesIn{0};
+    std::atomic<uint64_t> m_bytesOut{0};
+    std::atomic<size_t> m_buffered{0};
+    std::atomic<uint64_t> m_rttUs{0};
+    std::atomic<uint64_t> m_pacedNanos{0};
+};
+
+#endif // SOCKETPUMP_H
@@ -0,0 +1,43 @@
+#include "tilehashgrid.h"
+
+#include <algorithm>
+
+bool TileHashGrid::update(const FramebufferView &fb, const QRect &rect)
+{
+    if (fb.width != m_width || fb.height != m_height || fb.bytesPerPixel != m_bytesPerPixel) {
+        m_width = fb.width;
+        m_height = fb.height;
+        m_bytesPerPixel = fb.bytesPerPixel;
+        m_columns = (m_width + TILE_SIZE - 1) / TILE_SIZE;
+        int rows = (m_height + TILE_SIZE - 1) / TILE_SIZE;
+        m_hashes.assign(static_cast<size_t>(m_columns) * rows, 0);
+    }
+
+    QRect area = rect & QRect(0, 0, m_width, m_height);
+    if (area.isEmpty() || !fb.pixels) {
+        return true;
+    }
+
+    // Every tile is rehashed, so the grid stays in step with the framebuffer
+    bool changed = false;
+    for (int tileY = area.top() / TILE_SIZE; tileY <= area.bottom() / TILE_SIZE; tileY++) {
+        int y = tileY * TILE_SIZE;
+        int h = std::min(TILE_SIZE, m_height - y);
+        for (int tileX = area.left() / TILE_SIZE; tileX <= area.right() / TILE_SIZE; tileX++) {
+            int x = tileX * TILE_SIZE;
+            int w = std::min(TILE_SIZE, m_width - x);
+            uint64_t hash = fbops::hashRows(fb.pixels + y * fb.stride + x * m_bytesPerPixel, fb.stride, w * m_bytesPerPixel, h);
+            uint64_t &stored = m_hashes[static_cast<size_t>(tileY) * m_columns + tileX];
+            if (hash != stored) {
+                stored = hash;
+                changed = true;
+            }
+        }
+    }
+    return changed;
+}
+
+void TileHashGrid::reset()
+{
+    std::fill(m_hashes.begin(), m_hashes.end(), 0);
+}
@@ -0,0 +1,33 @@
+#ifndef TILEHASHGRID_H
+#define TILEHASHGRID_H
+
+#include <QRect>
+#include <cstdint>
+#include <vector>
+#include "framebufferops.h"
+
+// Hashes of the framebuffer's 16x16 tiles, to tell a decoded rectangle that left the pixels
+// as they were (servers without damage tracking resend static areas every frame) from one
+// that changed them. Comparing the result after the decoder finished also catches hextile
+// tiles that are filled with the background and then painted back to what they showed.
+//
+// VNC thread only. A tile is unknown (counts as changed) until it has been hashed once.
+class TileHashGrid
+{
+public:
+    static const int TILE_SIZE = 16;
+
+    // Rehashes the tiles rect touches; true if any of them differs from its last hash
+    bool update(const FramebufferView &fb, const QRect &rect);
+    // Forgets every tile, e.g. while the framebuffer cannot be read
+    void reset();
+
+private:
+    int m_width = 0;
+    int m_height = 0;
+    int m_bytesPerPixel = 0;
+    int m_columns = 0;
+    std::vector<uint64_t> m_hashes;  // 0 = unknown
+};
+
+#endif // TILEHASHGRID_H
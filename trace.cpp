@@ -0,0 +1,187 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace trace {
+
+std::atomic<bool> g_enabled{false};
+
+namespace {
+
+const uint64_t RING_CAPACITY = 1 << 16;  // Spans kept per thread; oldest are overwritten
+
+struct Event
+{
+    const char *name;
+    const char *detail;
+    int64_t start;
+    int64_t duration;
+};
+
+// Written only by its owning thread; head is published with release so flush() sees whole events
+struct ThreadBuffer
+{
+    int id = 0;
+    std::string name;
+    std::unique_ptr<Event[]> events{new Event[RING_CAPACITY]};
+    std::atomic<uint64_t> head{0};
+};
+
+std::mutex g_registryMutex;
+std::vector<std::unique_ptr<ThreadBuffer>> g_buffers;  // Outlive their threads until flush
+std::vector<ThreadBuffer *> g_freeBuffers;             // Of finished threads, for the next new one
+std::string g_path;
+const auto g_epoch = std::chrono::steady_clock::now();
+
+// Hands the thread's buffer on when the thread ends, so a session that reconnects for hours
+// keeps one buffer per live thread instead of one per thread it ever started. The next
+// thread continues the ring: earlier spans stay until overwritten, under the same id.
+struct BufferLease
+{
+    ThreadBuffer *buffer = nullptr;
+
+    ~BufferLease()
+    {
+        if (buffer) {
+            std::lock_guard<std::mutex> lock(g_registryMutex);
+            g_freeBuffers.push_back(buffer);
+        }
+    }
+};
+
+thread_local BufferLease t_lease;
+
+ThreadBuffer *threadBuffer()
+{
+    if (!t_lease.buffer) {
+        std::lock_guard<std::mutex> lock(g_registryMutex);
+        if (!g_freeBuffers.empty()) {
+            t_lease.buffer = g_freeBuffers.back();
+            g_freeBuffers.pop_back();
+        } else {
+            g_buffers.push_back(std::make_unique<ThreadBuffer>());
+            t_lease.buffer = g_buffers.back().get();
+            t_lease.buffer->id = static_cast<int>(g_buffers.size());
+        }
+    }
+    return t_lease.buffer;
+}
+
+void writeJsonString(std::ofstream &out, const char *text)
+{
+    out << '"';
+    for (const char *c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            out << '\\';
+        }
+        out << *c;
+    }
+    out << '"';
+}
+
+} // namespace
+
+bool configureFromEnvironment()
+{
+    const char *path = std::getenv("WVNCC_TRACE_FILE");
+    if (!path || !*path) {
+        return false;
+    }
+    g_path = path;
+    g_enabled = true;
+    std::cout << "[INFO] Tracing to " << g_path << std::endl;
+    return true;
+}
+
+int64_t now()
+{
+    // Offset by one so a valid timestamp is never zero (Span uses 0 for "not recording")
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_epoch).count() + 1;
+}
+
+void setThreadName(const char *name)
+{
+    if (!enabled()) {
+        return;
+    }
+    ThreadBuffer *buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(g_registryMutex);
+    // A reconnect's new VNC thread continues the buffer of the previous one, not another thread's
+    if (!buffer->name.empty() && buffer->name != name) {
+        auto named = std::find_if(g_freeBuffers.begin(), g_freeBuffers.end(),
+                                  [name](const ThreadBuffer *free) { return free->name == name; });
+        if (named != g_freeBuffers.end()) {
+            std::swap(*named, t_lease.buffer);
+            buffer = t_lease.buffer;
+        }
+    }
+    buffer->name = name;
+}
+
+void complete(const char *name, int64_t startNs, int64_t endNs, const char *detail)
+{
+    if (!enabled()) {
+        return;
+    }
+    ThreadBuffer *buffer = threadBuffer();
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    buffer->events[head % RING_CAPACITY] = Event{name, detail, startNs, endNs - startNs};
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+void flush()
+{
+    if (!enabled()) {
+        return;
+    }
+    g_enabled = false;
+
+    std::ofstream out(g_path, std::ios::trunc);
+    if (!out) {
+        std::cerr << "[ERROR] Failed to write trace file " << g_path << std::endl;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(g_registryMutex);
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for (const auto &buffer : g_buffers) {
+        if (!buffer->name.empty()) {
+            out << (first ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer->id
+                << ",\"args\":{\"name\":";
+            writeJsonString(out, buffer->name.c_str());
+            out << "}}";
+            first = false;
+        }
+
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t begin = head > RING_CAPACITY ? head - RING_CAPACITY : 0;
+        for (uint64_t i = begin; i < head; i++) {
+            const Event &event = buffer->events[i % RING_CAPACITY];
+            out << (first ? "" : ",\n") << "{\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id << ",\"name\":";
+            writeJsonString(out, event.name);
+            out << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << event.duration / 1000.0;
+            if (event.detail) {
+                out << ",\"args\":{\"detail\":";
+                writeJsonString(out, event.detail);
+                out << "}";
+            }
+            out << "}";
+            first = false;
+        }
+    }
+    out << "\n]}\n";
+    std::cout << "[INFO] Trace written to " << g_path << std::endl;
+}
+
+} // namespace trace
@@ -0,0 +1,66 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+
+// Opt-in span recording in Chrome Trace Event format (loadable in Perfetto / chrome://tracing).
+// Enabled by setting WVNCC_TRACE_FILE. Each thread writes into its own ring buffer without
+// locking; flush() writes the retained spans at shutdown. When disabled a span costs one load.
+namespace trace {
+
+extern std::atomic<bool> g_enabled;
+
+inline bool enabled()
+{
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+// Reads WVNCC_TRACE_FILE; returns true if tracing was enabled
+bool configureFromEnvironment();
+
+// Writes all recorded spans to the configured file. Call once writer threads have stopped.
+void flush();
+
+// Names the calling thread in the trace
+void setThreadName(const char *name);
+
+// Monotonic timestamp in nanoseconds
+int64_t now();
+
+// Records a finished span; name and detail must be string literals (stored by pointer)
+void complete(const char *name, int64_t startNs, int64_t endNs, const char *detail = nullptr);
+
+class Span
+{
+public:
+    explicit Span(const char *name, const char *detail = nullptr)
+        : m_name(name)
+        , m_detail(detail)
+        , m_start(enabled() ? now() : 0)
+    {
+    }
+
+    ~Span()
+    {
+        if (m_start != 0) {
+            complete(m_name, m_start, now(), m_detail);
+        }
+    }
+
+    Span(const Span &) = delete;
+    Span &operator=(const Span &) = delete;
+
+private:
+    const char *m_name;
+    const char *m_detail;
+    int64_t m_start;
+};
+
+} // namespace trace
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SPAN(name) trace::Span TRACE_CONCAT(traceSpan, __LINE__)(name)
+
+#endif // TRACE_H
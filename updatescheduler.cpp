@@ -0,0 +1,24 @@
+#include "updatescheduler.h"
+#include "bandwidthbudget.h"
+
+#include <algorithm>
+
+std::chrono::nanoseconds UpdateScheduler::delay(uint64_t receivedBytes)
+{
+    std::chrono::nanoseconds wait(0);
+
+    int fps = maxFps();
+    if (fps > 0) {
+        Clock::time_point next = m_lastRequest + std::chrono::nanoseconds(1000000000 / fps);
+        wait = std::max(wait, std::chrono::duration_cast<std::chrono::nanoseconds>(next - Clock::now()));
+    }
+
+    if (m_budget) {
+        if (receivedBytes > m_receivedBytes) {
+            m_budget->consume(receivedBytes - m_receivedBytes);
+        }
+        m_receivedBytes = receivedBytes;
+        wait = std::max(wait, m_budget->delay());
+    }
+    return wait;
+}
@@ -0,0 +1,39 @@
+#ifndef UPDATESCHEDULER_H
+#define UPDATESCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+class BandwidthBudget;
+
+// Paces the framebuffer update requests: at most maxFps per second, and none while the
+// shared budget is in debt. libvncclient sends the next request as soon as it has handled an
+// update, so the socket reader holds that request back instead of the decoder holding back
+// data that has already arrived. Sessions without the socket reader (TLS) fall back to
+// delaying the read of the next message, which TCP flow control turns into a slower server.
+class UpdateScheduler
+{
+public:
+    // 0 = unlimited; may be changed from any thread
+    void setMaxFps(int fps) { m_maxFps.store(fps, std::memory_order_relaxed); }
+    int maxFps() const { return m_maxFps.load(std::memory_order_relaxed); }
+    void setBudget(BandwidthBudget *budget) { m_budget = budget; }
+
+    // Socket reader thread while an update request is held (VNC thread, before handling a
+    // message, without one). receivedBytes is the session's running total of bytes from the
+    // server; whatever arrived since the last call is charged to the budget.
+    std::chrono::nanoseconds delay(uint64_t receivedBytes);
+    // Same thread, when an update request went out
+    void requestSent() { m_lastRequest = Clock::now(); }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::atomic<int> m_maxFps{0};
+    BandwidthBudget *m_budget = nullptr;
+    uint64_t m_receivedBytes = 0;
+    Clock::time_point m_lastRequest;
+};
+
+#endif // UPDATESCHEDULER_H
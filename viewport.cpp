@@ -0,0 +1,80 @@
+#include "viewport.h"
+
+#include <algorithm>
+#include <cmath>
+
+QPointF ViewportMapping::toRemote(const QPointF &windowPos) const
+{
+    if (!isValid()) {
+        return QPointF();
+    }
+    double x = source.x() + (windowPos.x() - target.x()) / static_cast<double>(target.width()) * source.width();
+    double y = source.y() + (windowPos.y() - target.y()) / static_cast<double>(target.height()) * source.height();
+    return QPointF(x, y);
+}
+
+QRectF ViewportMapping::toWindow(const QRectF &remote) const
+{
+    if (!isValid()) {
+        return QRectF();
+    }
+    double sx = target.width() / source.width();
+    double sy = target.height() / source.height();
+    return QRectF(target.x() + (remote.x() - source.x()) * sx, target.y() + (remote.y() - source.y()) * sy,
+                  remote.width() * sx, remote.height() * sy);
+}
+
+QRect ViewportMapping::requestRect(const QSize &framebufferSize, double margin) const
+{
+    if (!isValid()) {
+        return QRect();
+    }
+    double dx = source.width() * margin;
+    double dy = source.height() * margin;
+    int left = static_cast<int>(std::floor(source.left() - dx));
+    int top = static_cast<int>(std::floor(source.top() - dy));
+    int right = static_cast<int>(std::ceil(source.right() + dx));
+    int bottom = static_cast<int>(std::ceil(source.bottom() + dy));
+    return QRect(QPoint(left, top), QPoint(right - 1, bottom - 1)) & QRect(QPoint(0, 0), framebufferSize);
+}
+
+ViewportMapping computeViewportMapping(const QSize &framebufferSize, const QRect &area, double zoom, const QPointF &center)
+{
+    ViewportMapping mapping;
+    if (framebufferSize.isEmpty() || area.isEmpty()) {
+        return mapping;
+    }
+
+    if (zoom <= 0.0) {
+        // Fit whole framebuffer, centered
+        QSize scaledSize = framebufferSize.scaled(area.size(), Qt::KeepAspectRatio);
+        int x = area.x() + (area.width() - scaledSize.width()) / 2;
+        int y = area.y() + (area.height() - scaledSize.height()) / 2;
+        mapping.target = QRect(x, y, scaledSize.width(), scaledSize.height());
+        mapping.source = QRectF(0, 0, framebufferSize.width(), framebufferSize.height());
+        return mapping;
+    }
+
+    // Visible part of the framebuffer; a dimension smaller than the window is centered instead of panned
+    double sourceWidth = std::min(area.width() / zoom, static_cast<double>(framebufferSize.width()));
+    double sourceHeight = std::min(area.height() / zoom, static_cast<double>(framebufferSize.height()));
+    double left = std::clamp(center.x() - sourceWidth / 2, 0.0, framebufferSize.width() - sourceWidth);
+    double top = std::clamp(center.y() - sourceHeight / 2, 0.0, framebufferSize.height() - sourceHeight);
+    mapping.source = QRectF(left, top, sourceWidth, sourceHeight);
+
+    int targetWidth = std::min(area.width(), static_cast<int>(std::lround(sourceWidth * zoom)));
+    int targetHeight = std::min(area.height(), static_cast<int>(std::lround(sourceHeight * zoom)));
+    mapping.target = QRect(area.x() + (area.width() - targetWidth) / 2,
+                           area.y() + (area.height() - targetHeight) / 2,
+                           targetWidth, targetHeight);
+    return mapping;
+}
+
+double fitScale(const QSize &framebufferSize, const QRect &area)
+{
+    if (framebufferSize.isEmpty() || area.isEmpty()) {
+        return 1.0;
+    }
+    return std::min(static_cast<double>(area.width()) / framebufferSize.width(),
+                    static_cast<double>(area.height()) / framebufferSize.height());
+}
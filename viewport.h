@@ -0,0 +1,34 @@
+#ifndef VIEWPORT_H
+#define VIEWPORT_H
+
+#include <QPointF>
+#include <QRect>
+#include <QRectF>
+#include <QSize>
+
+// Mapping between window pixels and remote framebuffer pixels.
+// target is where the framebuffer is drawn, source is the part of the framebuffer shown there.
+struct ViewportMapping
+{
+    QRect target;
+    QRectF source;
+
+    bool isValid() const { return !target.isEmpty() && !source.isEmpty(); }
+
+    // Convert a window position to (unclamped) framebuffer coordinates
+    QPointF toRemote(const QPointF &windowPos) const;
+    // Convert a framebuffer rectangle to window coordinates (not clipped to target)
+    QRectF toWindow(const QRectF &remote) const;
+
+    // Visible source area grown by margin (fraction of its size) on each side, clipped to the framebuffer
+    QRect requestRect(const QSize &framebufferSize, double margin) const;
+};
+
+// zoom <= 0 fits the whole framebuffer into area keeping the aspect ratio (letterboxed).
+// zoom > 0 shows the framebuffer at zoom window pixels per remote pixel around center.
+ViewportMapping computeViewportMapping(const QSize &framebufferSize, const QRect &area, double zoom, const QPointF &center);
+
+// Scale factor used by the fit-to-window mapping
+double fitScale(const QSize &framebufferSize, const QRect &area);
+
+#endif // VIEWPORT_H